@@ -5,6 +5,19 @@
 #include <string.h>
 
 #include <dlfcn.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/ioctl.h>
+#include <sys/prctl.h>
+#include <sys/ptrace.h>
+#include <signal.h>
+
+#include <linux/perf_event.h>
 
 #include "bt-private.h"
 
@@ -17,6 +30,15 @@
 
 bt_tester_t tester;
 
+/* the pass currently running, used to attribute assertions */
+static unsigned pass = BT_PASS_SETUP;
+
+/* the loop of the benchmark being run */
+static bt_test_function_t * bench = NULL;
+
+/* our slot on the result board or NULL */
+static struct bt_board_slot * slot = NULL;
+
 void bt_backtrace()
 {
 #ifdef HAVE_LIBUNWIND
@@ -32,11 +54,915 @@ void bt_backtrace()
     unw_get_proc_name(&cursor, buf, 512, &off);
     if (strcmp(buf, "main") == 0)
       return;
-    printf ("in [0x%016lx] @ %s() + %ld\n", (long) ip, buf, (long) off);
+    bt_logf("in [0x%016lx] @ %s() + %ld\n", (long) ip, buf, (long) off);
   }
 #endif
 }
 
+static inline
+uint64_t bt_now()
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return (uint64_t) ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+/*
+ * buffered logging, every thread formats into its own buffer so threads do
+ * not contend on a lock and the pipe sees few large writes
+ */
+
+#define BT_LOG_BUFFER (1 << 14)
+
+struct bt_log_buffer {
+  size_t length;
+  pid_t  tid;
+  volatile sig_atomic_t busy; /* set while data or length are updated */
+  char   data[BT_LOG_BUFFER];
+};
+
+static uint64_t epoch;
+static pthread_key_t logkey;
+static pthread_once_t logonce = PTHREAD_ONCE_INIT;
+static __thread struct bt_log_buffer * logbuffer = NULL;
+
+static
+void bt_log_write(const char * data, size_t length)
+{
+  ssize_t n;
+
+  while (length > 0) {
+    n = write(tester.fd, data, length);
+    if (n == -1 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      return;
+    data += n;
+    length -= n;
+  }
+}
+
+/* runs on thread exit */
+static
+void bt_log_release(void * buffer)
+{
+  struct bt_log_buffer * self = buffer;
+
+  bt_log_write(self->data, self->length);
+  free(self);
+}
+
+static
+void bt_log_key()
+{
+  pthread_key_create(&logkey, bt_log_release);
+}
+
+static
+struct bt_log_buffer * bt_log_buffer()
+{
+  if (!logbuffer) {
+    pthread_once(&logonce, bt_log_key);
+
+    logbuffer = malloc(sizeof(struct bt_log_buffer));
+    if (!logbuffer)
+      return NULL;
+
+    logbuffer->length = 0;
+    logbuffer->busy = 0;
+    logbuffer->tid = syscall(SYS_gettid);
+    pthread_setspecific(logkey, logbuffer);
+  }
+
+  return logbuffer;
+}
+
+void bt_log_flush()
+{
+  if (logbuffer) {
+    bt_log_write(logbuffer->data, logbuffer->length);
+    logbuffer->length = 0;
+  }
+}
+
+void bt_logf(const char * format, ...)
+{
+  struct bt_log_buffer * self;
+  uint64_t now;
+  va_list ap;
+  int length, n;
+  char * large;
+
+  /* nothing to buffer into, do it the slow way */
+  if (!(self = bt_log_buffer())) {
+    va_start(ap, format);
+    vdprintf(tester.fd, format, ap);
+    va_end(ap);
+    return;
+  }
+
+  now = bt_now() - epoch;
+
+  self->busy = 1;
+
+  for (int retry = 0; retry < 2; retry++) {
+    size_t room = BT_LOG_BUFFER - self->length;
+
+    n = snprintf(self->data + self->length, room,
+        "[%d +%llu.%06llu] ", (int) self->tid,
+        (unsigned long long) (now / 1000000000ull),
+        (unsigned long long) (now / 1000 % 1000000));
+
+    /* not even the prefix fits, the message is not formatted */
+    if ((size_t) n < room) {
+      va_start(ap, format);
+      length = vsnprintf(self->data + self->length + n, room - n, format, ap);
+      va_end(ap);
+
+      if ((size_t) n + length < room) {
+        self->length += n + length;
+        self->busy = 0;
+        return;
+      }
+    }
+
+    /* does not fit, make room and try again */
+    bt_log_flush();
+  }
+
+  /* larger than the whole buffer, the prefix is at its start */
+  va_start(ap, format);
+  length = vasprintf(&large, format, ap);
+  va_end(ap);
+  if (length != -1) {
+    bt_log_write(self->data, n);
+    bt_log_write(large, length);
+    free(large);
+  }
+
+  self->busy = 0;
+}
+
+/* writes out what the crashing thread has buffered before the default
+ * action takes place, unless the crash came while the buffer was updated */
+static
+void bt_log_fatal(int sig)
+{
+  if (logbuffer && !logbuffer->busy)
+    write(tester.fd, logbuffer->data, logbuffer->length);
+  raise(sig);
+}
+
+/**
+ * sends a message over the control channel
+ *
+ * @param[in] type the message type
+ * @param[in] iov the parts of the payload
+ * @param[in] iovcnt the number of parts
+ */
+
+static
+void bt_send(uint16_t type, const struct iovec * iov, int iovcnt)
+{
+  struct bt_msg_hdr hdr = {BT_PROTO_VERSION, type, 0};
+  struct iovec      vec[iovcnt + 1];
+  struct msghdr     msg;
+
+  if (tester.cfd == -1)
+    return;
+
+  vec[0].iov_base = &hdr;
+  vec[0].iov_len = sizeof(hdr);
+  for (int i = 0; i < iovcnt; i++) {
+    vec[i + 1] = iov[i];
+    hdr.length += iov[i].iov_len;
+  }
+
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = vec;
+  msg.msg_iovlen = iovcnt + 1;
+
+  sendmsg(tester.cfd, &msg, MSG_NOSIGNAL);
+}
+
+static
+void bt_send_where(uint16_t type, const char * file, int line, const char * text)
+{
+  struct bt_msg_where where;
+  size_t max = (BT_MSG_MAX - sizeof(struct bt_msg_hdr) - sizeof(where)) / 2;
+
+  memset(&where, 0, sizeof(where));
+  where.pass = pass;
+  where.line = line;
+  where.file_length = file ? strnlen(file, max - 1) + 1 : 0;
+  where.text_length = text ? strnlen(text, max - 1) + 1 : 0;
+
+  struct iovec iov[3] = {
+    {&where, sizeof(where)},
+    {(void *) file, where.file_length},
+    {(void *) text, where.text_length},
+  };
+
+  bt_send(type, iov, 3);
+}
+
+void bt_assertion(const char * file, int line, const char * expression)
+{
+  bt_send_where(BT_MSG_ASSERT, file, line, expression);
+}
+
+void bt_ignored(const char * file, int line, const char * reason)
+{
+  bt_send_where(BT_MSG_IGNORE, file, line, reason);
+}
+
+static inline
+uint64_t bt_tv_us(struct timeval tv)
+{
+  return (uint64_t) tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+/*
+ * performance counters
+ *
+ * only opened if the butcher asks for them (see BT_FLAG_PERF), every event
+ * is opened on its own, so an event the machine lacks does not take the
+ * others along; only what runs in user space is counted if the kernel does
+ * not allow more (see perf_event_paranoid) and the hardware events are
+ * given up on as soon as one of them cannot be opened at all, there is no
+ * PMU or no access to it then, so a test does not pay for a row of failing
+ * calls; the counters are
+ * reset and enabled right before a pass and disabled right after it, an
+ * event that had to share the PMU with others is scaled by the time it
+ * was actually counting
+ */
+
+static const struct {
+  uint32_t type;
+  uint64_t config;
+} bt_perf_events[BT_PERF_MAX] = {
+  [BT_PERF_CYCLES] = {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+  [BT_PERF_INSTRUCTIONS] = {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+  [BT_PERF_BRANCHES] = {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_INSTRUCTIONS},
+  [BT_PERF_BRANCH_MISSES] = {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+  [BT_PERF_CACHE_REFERENCES] = {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_REFERENCES},
+  [BT_PERF_CACHE_MISSES] = {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+  [BT_PERF_TASK_CLOCK] = {PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK},
+  [BT_PERF_PAGE_FAULTS] = {PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS},
+  [BT_PERF_CONTEXT_SWITCHES] = {PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES},
+  [BT_PERF_CPU_MIGRATIONS] = {PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CPU_MIGRATIONS},
+};
+
+/* -1 for the events that could not be opened */
+static int perf_fds[BT_PERF_MAX];
+
+static
+void bt_perf_open(int enabled)
+{
+  struct perf_event_attr attr;
+  int hardware = 1;
+
+  for (int e = 0; e < BT_PERF_MAX; e++)
+    perf_fds[e] = -1;
+
+  if (!enabled)
+    return;
+
+  for (int e = 0; e < BT_PERF_MAX; e++) {
+    if (bt_perf_events[e].type == PERF_TYPE_HARDWARE && !hardware)
+      continue;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = bt_perf_events[e].type;
+    attr.config = bt_perf_events[e].config;
+    attr.disabled = 1;
+    attr.inherit = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+    perf_fds[e] = syscall(SYS_perf_event_open, &attr, 0, -1, -1, PERF_FLAG_FD_CLOEXEC);
+    if (perf_fds[e] == -1 && (errno == EACCES || errno == EPERM)) {
+      attr.exclude_kernel = 1;
+      perf_fds[e] = syscall(SYS_perf_event_open, &attr, 0, -1, -1, PERF_FLAG_FD_CLOEXEC);
+    }
+    if (perf_fds[e] == -1 && bt_perf_events[e].type == PERF_TYPE_HARDWARE
+        && (errno == ENOENT || errno == EOPNOTSUPP || errno == EACCES || errno == EPERM))
+      hardware = 0;
+  }
+}
+
+static
+void bt_perf_start(void)
+{
+  for (int e = 0; e < BT_PERF_MAX; e++) {
+    if (perf_fds[e] == -1)
+      continue;
+    ioctl(perf_fds[e], PERF_EVENT_IOC_RESET, 0);
+    ioctl(perf_fds[e], PERF_EVENT_IOC_ENABLE, 0);
+  }
+}
+
+static
+void bt_perf_stop(bt_counters_t * counters)
+{
+  struct {
+    uint64_t value;
+    uint64_t enabled;
+    uint64_t running;
+  } count;
+
+  for (int e = 0; e < BT_PERF_MAX; e++) {
+    if (perf_fds[e] != -1)
+      ioctl(perf_fds[e], PERF_EVENT_IOC_DISABLE, 0);
+  }
+
+  for (int e = 0; e < BT_PERF_MAX; e++) {
+    if (perf_fds[e] == -1 || read(perf_fds[e], &count, sizeof(count)) != sizeof(count))
+      continue;
+    /* the event never got onto the PMU */
+    if (!count.running && count.enabled)
+      continue;
+    if (count.running < count.enabled)
+      count.value = (double) count.value * count.enabled / count.running;
+    counters->perf[e] = count.value;
+    counters->perf_mask |= 1u << e;
+  }
+}
+
+/*
+ * instruction counting
+ *
+ * in instruction mode (see BT_FLAG_INSTRUCTIONS) the passes and the samples
+ * of benchmarks are measured in instructions retired in user space, which
+ * unlike the time do not depend on what else the machine is doing; they
+ * are counted by a pinned counter of their own on the PMU or, where there
+ * is none, by single stepping: a tracer forked at the start attaches to us
+ * and steps through whatever runs between two BT_INSN_SIGNAL, all else runs
+ * at full speed; a step is a user space instruction or a whole syscall and
+ * only the thread that counts is stepped, so threads the code starts are
+ * not counted; the instructions of the counting itself are measured once
+ * and taken off
+ */
+
+#define BT_INSN_SIGNAL SIGRTMAX
+
+static int instructions = 0;  /* instruction mode */
+static int insn_ready = 0;    /* whether there is a way to count them */
+static int insn_fd = -1;      /* the counter on the PMU */
+static pid_t insn_tracer = -1;
+static volatile uint64_t * insn_steps = NULL; /* shared with the tracer */
+static uint64_t insn_overhead = 0;
+
+static
+void bt_insn_trace(pid_t tracee, int ready)
+{
+  uint64_t count = 0;
+  int counting = 0, status;
+
+  if (ptrace(PTRACE_SEIZE, tracee, NULL, NULL) == -1)
+    _exit(1);
+  if (write(ready, "", 1) != 1)
+    _exit(1);
+  /* the output and the control channel are none of our business */
+  closefrom(0);
+
+  while (waitpid(tracee, &status, 0) != -1 && WIFSTOPPED(status)) {
+    int sig = WSTOPSIG(status);
+
+    if (sig == BT_INSN_SIGNAL) {
+      if (counting)
+        *insn_steps = count;
+      counting = !counting;
+      count = 0;
+      sig = 0;
+    } else if (sig == SIGTRAP && counting) {
+      count++;
+      sig = 0;
+    } else if (status >> 16) {
+      /* a ptrace event, there is no signal to deliver */
+      sig = 0;
+    }
+
+    ptrace(counting ? PTRACE_SINGLESTEP : PTRACE_CONT, tracee, NULL, (void *) (long) sig);
+  }
+
+  _exit(0);
+}
+
+static
+void bt_insn_begin(void)
+{
+  if (insn_fd != -1) {
+    ioctl(insn_fd, PERF_EVENT_IOC_RESET, 0);
+    ioctl(insn_fd, PERF_EVENT_IOC_ENABLE, 0);
+  } else {
+    raise(BT_INSN_SIGNAL);
+  }
+}
+
+static
+uint64_t bt_insn_end(void)
+{
+  uint64_t count = 0;
+
+  if (insn_fd != -1) {
+    ioctl(insn_fd, PERF_EVENT_IOC_DISABLE, 0);
+    /* a pinned counter that lost the PMU reads nothing */
+    if (read(insn_fd, &count, sizeof(count)) != sizeof(count))
+      count = 0;
+  } else {
+    raise(BT_INSN_SIGNAL);
+    count = *insn_steps;
+  }
+
+  return count > insn_overhead ? count - insn_overhead : 0;
+}
+
+/**
+ * sets up counting instructions, on the PMU if it is there, by a tracer if
+ * not
+ *
+ * @return whether instructions can be counted
+ */
+
+static
+int bt_insn_open(void)
+{
+  struct perf_event_attr attr;
+  int ready[2];
+  pid_t tracer;
+  char c;
+
+  memset(&attr, 0, sizeof(attr));
+  attr.size = sizeof(attr);
+  attr.type = PERF_TYPE_HARDWARE;
+  attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+  attr.disabled = 1;
+  attr.pinned = 1;
+  attr.exclude_kernel = 1;
+  attr.exclude_hv = 1;
+
+  insn_fd = syscall(SYS_perf_event_open, &attr, 0, -1, -1, PERF_FLAG_FD_CLOEXEC);
+  if (insn_fd == -1) {
+    insn_steps = mmap(NULL, sizeof(uint64_t), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (insn_steps == MAP_FAILED || pipe2(ready, O_CLOEXEC) == -1) {
+      insn_steps = NULL;
+      return 0;
+    }
+
+    /* the tracer is our child, Yama only lets it attach if we say so */
+    prctl(PR_SET_PTRACER, PR_SET_PTRACER_ANY, 0, 0, 0);
+    fflush(NULL);
+    tracer = fork();
+    if (tracer == 0) {
+      close(ready[0]);
+      bt_insn_trace(getppid(), ready[1]);
+    }
+    close(ready[1]);
+
+    /* nothing to read if the tracer could not attach */
+    if (tracer == -1 || read(ready[0], &c, 1) != 1) {
+      if (tracer != -1)
+        waitpid(tracer, NULL, 0);
+      close(ready[0]);
+      prctl(PR_SET_PTRACER, 0, 0, 0, 0);
+      insn_steps = NULL;
+      return 0;
+    }
+    close(ready[0]);
+    prctl(PR_SET_PTRACER, 0, 0, 0, 0);
+    insn_tracer = tracer;
+
+    /* should the tracer go away, the markers must not kill us */
+    signal(BT_INSN_SIGNAL, SIG_IGN);
+  }
+
+  /* what counting nothing counts */
+  insn_overhead = 0;
+  for (int k = 0; k < 3; k++) {
+    uint64_t count;
+
+    bt_insn_begin();
+    count = bt_insn_end();
+    if (k == 0 || count < insn_overhead)
+      insn_overhead = count;
+  }
+
+  return 1;
+}
+
+/* the tracer would only go away with us and linger unreaped, killing it
+ * detaches it */
+static
+void bt_insn_close(void)
+{
+  if (insn_tracer == -1)
+    return;
+
+  kill(insn_tracer, SIGKILL);
+  waitpid(insn_tracer, NULL, 0);
+  insn_tracer = -1;
+}
+
+/**
+ * runs a setup, test or teardown function and sends its result, timing and
+ * resource usage over the control channel
+ *
+ * @param[in] p the pass to run
+ * @param[in] fn the function to call
+ * @param[in] object the object to pass to the function
+ * @param[out] objectp a pointer to the object the function can replace
+ *
+ * @return the result of the pass (BT_TEST_*)
+ */
+
+static
+int bt_run_pass(unsigned p, bt_test_function_t * fn, void * object, void ** objectp)
+{
+  struct bt_msg_phase    phase;
+  struct bt_msg_counters counters;
+  struct rusage          before, after;
+  uint64_t               insn = 0;
+  int                    result;
+
+  pass = p;
+
+  memset(&counters, 0, sizeof(counters));
+  getrusage(RUSAGE_SELF, &before);
+  phase.start = bt_now();
+
+  if (slot) {
+    bt_board_slot_begin(slot);
+    slot->pass = p;
+    slot->start[p] = phase.start;
+    bt_board_slot_end(slot);
+  }
+
+  bt_perf_start();
+  /* a benchmark counts its samples by itself */
+  if (insn_ready && !bench)
+    bt_insn_begin();
+  result = (*fn)(object, objectp);
+  if (insn_ready && !bench)
+    insn = bt_insn_end();
+  bt_perf_stop(&counters.counters);
+  if (insn_ready && !bench) {
+    counters.counters.perf[BT_PERF_INSTRUCTIONS] = insn;
+    counters.counters.perf_mask |= 1u << BT_PERF_INSTRUCTIONS;
+  }
+  phase.end = bt_now();
+  getrusage(RUSAGE_SELF, &after);
+
+  phase.pass = p;
+  if (result == BT_RESULT_OK)
+    phase.result = BT_TEST_SUCCEEDED;
+  else if (result == BT_RESULT_IGNORE)
+    phase.result = BT_TEST_IGNORED;
+  else if (result == BT_RESULT_FAIL)
+    phase.result = BT_TEST_FAILED;
+  else
+    phase.result = BT_TEST_CORRUPTED;
+
+  counters.pass = p;
+  counters.counters.utime = bt_tv_us(after.ru_utime) - bt_tv_us(before.ru_utime);
+  counters.counters.stime = bt_tv_us(after.ru_stime) - bt_tv_us(before.ru_stime);
+  counters.counters.maxrss = after.ru_maxrss;
+  counters.counters.minflt = after.ru_minflt - before.ru_minflt;
+  counters.counters.majflt = after.ru_majflt - before.ru_majflt;
+  counters.counters.nvcsw = after.ru_nvcsw - before.ru_nvcsw;
+  counters.counters.nivcsw = after.ru_nivcsw - before.ru_nivcsw;
+
+  if (slot) {
+    bt_board_slot_begin(slot);
+    slot->results[p] = phase.result;
+    slot->end[p] = phase.end;
+    slot->counters[p] = counters.counters;
+    bt_board_slot_end(slot);
+  }
+
+  {
+    struct iovec iov = {&counters, sizeof(counters)};
+    bt_send(BT_MSG_COUNTERS, &iov, 1);
+  }
+  {
+    struct iovec iov = {&phase, sizeof(phase)};
+    bt_send(BT_MSG_PHASE, &iov, 1);
+  }
+
+  return phase.result;
+}
+
+/*
+ * benchmarks
+ *
+ * the number of operations per sample is raised until a sample takes
+ * BT_BENCH_SAMPLE_NS, which also warms up caches, branch predictors and
+ * the clock of the cpu; samples taken until BT_BENCH_WARMUP_NS have passed
+ * are thrown away, then BT_BENCH_SAMPLES are taken, fewer if the operation
+ * is so slow that BT_BENCH_TIME_NS are over before; a BT_BENCH_RANGE() is
+ * calibrated and sampled for every input size, it is warmed up once and
+ * takes BT_BENCH_RANGE_SAMPLES per size, so a range takes about as long as
+ * a few benchmarks
+ *
+ * counting instructions (see above) there is nothing to warm up but lazy
+ * binding and the first touch of memory, which the first run pays for, and
+ * the samples hardly vary, so BT_BENCH_INSN_SAMPLES are plenty; on the PMU
+ * a sample is made at least BT_BENCH_INSN_SAMPLE instructions long, so the
+ * odd instruction the counter is off by does not show, single stepping is
+ * exact and slow, it does one operation per sample
+ */
+
+#define BT_BENCH_SAMPLES 30
+#define BT_BENCH_RANGE_SAMPLES 10
+#define BT_BENCH_SAMPLES_MIN 5
+#define BT_BENCH_SAMPLE_NS 10000000ull   /* 10 ms */
+#define BT_BENCH_WARMUP_NS 100000000ull  /* 100 ms */
+#define BT_BENCH_TIME_NS 3000000000ull   /* 3 s */
+#define BT_BENCH_OPERATIONS_MAX (1ull << 32)
+#define BT_BENCH_INSN_SAMPLES 5
+#define BT_BENCH_INSN_SAMPLE 1000000ull
+
+/**
+ * runs the loop of the benchmark once
+ *
+ * @param[in] operations the number of operations
+ * @param[in] n the input size
+ * @param[out] ns a pointer to hold the time it took
+ *
+ * @return the result of the loop (BT_RESULT_*)
+ */
+
+static
+int bt_bench_sample(unsigned long long operations, unsigned long n, uint64_t * ns)
+{
+  bt_bench_arg_t arg = {operations, n};
+  uint64_t start;
+  int result;
+
+  start = bt_now();
+  result = (*bench)(&arg, NULL);
+  *ns = bt_now() - start;
+
+  return result;
+}
+
+/**
+ * runs the loop of the benchmark once and counts its instructions
+ *
+ * @param[in] operations the number of operations
+ * @param[in] n the input size
+ * @param[out] count a pointer to hold the number of instructions
+ *
+ * @return the result of the loop (BT_RESULT_*)
+ */
+
+static
+int bt_bench_sample_insn(unsigned long long operations, unsigned long n, uint64_t * count)
+{
+  bt_bench_arg_t arg = {operations, n};
+  int result;
+
+  bt_insn_begin();
+  result = (*bench)(&arg, NULL);
+  *count = bt_insn_end();
+
+  return result;
+}
+
+/**
+ * summarizes the samples of one input size and sends them over the control
+ * channel
+ *
+ * @param[in] n the input size, 0 for BT_BENCH()
+ * @param[in] operations the number of operations per sample
+ * @param[in] unit what the samples count (BT_BENCH_*)
+ * @param[in,out] samples the samples, sorted on return
+ * @param[in] count the number of samples
+ */
+
+static
+void bt_bench_send(unsigned long n, unsigned long long operations, unsigned unit,
+    double * samples, unsigned count)
+{
+  struct bt_msg_bench msg;
+
+  memset(&msg, 0, sizeof(msg));
+  msg.pass = pass;
+  msg.bench.operations = operations;
+  msg.bench.n = n;
+  bt_stats_summary(samples, count, &msg.bench);
+  msg.bench.unit = unit;
+
+  {
+    struct iovec iov[2] = {
+      {&msg, sizeof(msg)},
+      {samples, sizeof(double) * count},
+    };
+    bt_send(BT_MSG_BENCH, iov, 2);
+  }
+}
+
+/**
+ * samples the benchmark for one input size in instructions and sends the
+ * samples over the control channel
+ *
+ * @param[in] n the input size, 0 for BT_BENCH()
+ * @param[in] max the number of samples to take
+ *
+ * @return the result of the benchmark (BT_RESULT_*)
+ */
+
+static
+int bt_bench_size_insn(unsigned long n, unsigned max)
+{
+  double samples[BT_BENCH_INSN_SAMPLES];
+  unsigned long long operations = 1;
+  uint64_t count;
+  unsigned k;
+  int result;
+
+  if (!insn_ready) {
+    bt_logf("cannot count instructions, there is neither a PMU nor ptrace(2)\n");
+    return BT_RESULT_FAIL;
+  }
+
+  result = bt_bench_sample_insn(operations, n, &count);
+  if (result != BT_RESULT_OK)
+    return result;
+
+  while (insn_fd != -1 && count < BT_BENCH_INSN_SAMPLE && operations < BT_BENCH_OPERATIONS_MAX) {
+    if (count < BT_BENCH_INSN_SAMPLE / 100)
+      operations *= 100;
+    else
+      operations = operations * BT_BENCH_INSN_SAMPLE / count + 1;
+    result = bt_bench_sample_insn(operations, n, &count);
+    if (result != BT_RESULT_OK)
+      return result;
+  }
+
+  if (max > BT_BENCH_INSN_SAMPLES)
+    max = BT_BENCH_INSN_SAMPLES;
+  for (k = 0; k < max; k++) {
+    result = bt_bench_sample_insn(operations, n, &count);
+    if (result != BT_RESULT_OK)
+      return result;
+    samples[k] = (double) count / operations;
+  }
+
+  bt_bench_send(n, operations, BT_BENCH_INSTRUCTIONS, samples, k);
+
+  return BT_RESULT_OK;
+}
+
+/**
+ * samples the benchmark for one input size and sends the samples over the
+ * control channel
+ *
+ * @param[in] n the input size, 0 for BT_BENCH()
+ * @param[in] warmup whether to warm up after the calibration
+ * @param[in] max the number of samples to take
+ *
+ * @return the result of the benchmark (BT_RESULT_*)
+ */
+
+static
+int bt_bench_size(unsigned long n, int warmup, unsigned max)
+{
+  double samples[BT_BENCH_SAMPLES];
+  unsigned long long operations = 1;
+  uint64_t ns, start;
+  unsigned count = 0;
+  int result;
+
+  if (instructions)
+    return bt_bench_size_insn(n, max);
+
+  start = bt_now();
+
+  /* calibrate, overshooting a bit rather than taking more rounds */
+  for (;;) {
+    result = bt_bench_sample(operations, n, &ns);
+    if (result != BT_RESULT_OK)
+      return result;
+    if (ns >= BT_BENCH_SAMPLE_NS) {
+      operations = operations * BT_BENCH_SAMPLE_NS / ns;
+      break;
+    }
+    /* the compiler threw the body away, it would never take long enough */
+    if (operations >= BT_BENCH_OPERATIONS_MAX)
+      break;
+    if (ns < BT_BENCH_SAMPLE_NS / 100)
+      operations *= 100;
+    else
+      operations = operations * BT_BENCH_SAMPLE_NS * 6 / 5 / ns + 1;
+  }
+  if (!operations)
+    operations = 1;
+
+  while (warmup && bt_now() - start < BT_BENCH_WARMUP_NS) {
+    result = bt_bench_sample(operations, n, &ns);
+    if (result != BT_RESULT_OK)
+      return result;
+  }
+
+  start = bt_now();
+  while (count < max
+      && (count < BT_BENCH_SAMPLES_MIN || bt_now() - start < BT_BENCH_TIME_NS)) {
+    result = bt_bench_sample(operations, n, &ns);
+    if (result != BT_RESULT_OK)
+      return result;
+    samples[count++] = (double) ns / operations;
+  }
+
+  bt_bench_send(n, operations, BT_BENCH_NS, samples, count);
+
+  return BT_RESULT_OK;
+}
+
+/**
+ * runs a benchmark, over all of its input sizes if it has a range; the
+ * signature is the one of a test, so it runs as a pass
+ *
+ * @return the result of the benchmark (BT_RESULT_*)
+ */
+
+static
+int bt_bench(void * object, void ** objectp)
+{
+  const bt_bench_range_t * range = NULL;
+  int result;
+
+  UNUSED_PARAM(object);
+  UNUSED_PARAM(objectp);
+
+  result = (*bench)(NULL, (void **) &range);
+  if (result != BT_RESULT_OK)
+    return result;
+
+  if (!range)
+    return bt_bench_size(0, 1, BT_BENCH_SAMPLES);
+
+  if (range->from < 1 || range->to < range->from || range->multiplier < 2) {
+    bt_logf("invalid range [%lu, %lu] * %lu\n", range->from, range->to, range->multiplier);
+    return BT_RESULT_FAIL;
+  }
+
+  for (unsigned long n = range->from;;) {
+    result = bt_bench_size(n, n == range->from, BT_BENCH_RANGE_SAMPLES);
+    if (result != BT_RESULT_OK)
+      return result;
+    if (n > range->to / range->multiplier)
+      break;
+    n *= range->multiplier;
+  }
+
+  return BT_RESULT_OK;
+}
+
+/**
+ * maps our slot of the result board the butcher passed us
+ *
+ * @param[in] board the descriptor of the board
+ * @param[in] index the index of our slot
+ *
+ * @return the slot or NULL
+ */
+
+static
+struct bt_board_slot * bt_board_attach(const char * board, const char * index)
+{
+  struct bt_board * map;
+  struct stat st;
+  unsigned long n;
+  int fd;
+
+  if (!board || !index)
+    return NULL;
+
+  fd = atoi(board);
+  n = strtoul(index, NULL, 10);
+
+  if (fstat(fd, &st) == -1 || (size_t) st.st_size < sizeof(struct bt_board))
+    return NULL;
+
+  map = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED)
+    return NULL;
+
+  if (map->magic != BT_BOARD_MAGIC || map->version != BT_BOARD_VERSION
+      || map->slot_size != sizeof(struct bt_board_slot) || n >= map->nslots
+      || sizeof(struct bt_board) + map->nslots * sizeof(struct bt_board_slot) > (size_t) st.st_size) {
+    munmap(map, st.st_size);
+    return NULL;
+  }
+
+  return &map->slots[n];
+}
+
 static inline
 int get_env_bool(const char * name, int def)
 {
@@ -60,18 +986,58 @@ int get_env_bool(const char * name, int def)
   return ret;
 }
 
+/**
+ * looks up the function of a record, the records in bexec are numbered
+ * first, the compact ones follow
+ *
+ * @param[in] bsect the records in bexec or NULL
+ * @param[in] bsect_end the end of bsect
+ * @param[in] csect the records in bexec_compact or NULL
+ * @param[in] csect_end the end of csect
+ * @param[in] id the number of the record
+ * @param[out] flags a pointer to hold the flags of the record or NULL
+ *
+ * @return the function or NULL if there is no such record
+ */
+
+static
+bt_test_function_t * bt_function(const bt_fn_t * bsect, const bt_fn_t * bsect_end,
+    const bt_rec_t * csect, const bt_rec_t * csect_end, unsigned long id, unsigned long * flags)
+{
+  const bt_rec_t * rec;
+
+  if (id < (unsigned long) (bsect_end - bsect)) {
+    if (flags)
+      *flags = bsect[id].flags;
+    return bsect[id].function;
+  }
+
+  id -= bsect_end - bsect;
+  if (id >= (unsigned long) (csect_end - csect))
+    return NULL;
+
+  rec = &csect[id];
+  if (flags)
+    *flags = rec->flags;
+  return (bt_test_function_t *) (uintptr_t) ((const char *) &rec->function + rec->function);
+}
+
 int main(int argc, char * argv[], char * env[])
 {
   void * dl_handle;
-  void * object;
-  int    result, test_result, verbose, envdump, unload, wres;
+  void * object = NULL;
+  int    result, verbose, envdump, unload, wres;
+  unsigned long flags = 0;
 
   UNUSED_PARAM(argc);
   UNUSED_PARAM(argv);
 
+  epoch = bt_now();
+
   verbose = get_env_bool("butcher_verbose", 0);
   envdump = get_env_bool("butcher_envdump", 0);
   unload = get_env_bool("butcher_unload", 1);
+  instructions = get_env_bool("butcher_instructions", 0);
 
   if (envdump) {
     fprintf(stderr, "BEXEC here ( env -i ");
@@ -102,15 +1068,18 @@ int main(int argc, char * argv[], char * env[])
     exit(-1);
   }
 
-  const bt_fn_t * bsect;
-  if (!(bsect = dlsym(dl_handle, "__start_bexec"))) {
-    fprintf(stderr, "ERROR: no bexec section: %s\n", dlerror());
-    exit(-1);
-  }
+  /* either section may be missing, but not both */
+  const bt_fn_t * bsect = dlsym(dl_handle, "__start_bexec");
+  const bt_fn_t * bsect_end = dlsym(dl_handle, "__stop_bexec");
+  const bt_rec_t * csect = dlsym(dl_handle, "__start_bexec_compact");
+  const bt_rec_t * csect_end = dlsym(dl_handle, "__stop_bexec_compact");
 
-  const bt_fn_t * bsect_end;
-  if (!(bsect_end = dlsym(dl_handle, "__stop_bexec"))) {
-    fprintf(stderr, "ERROR: no valid bexec section: %s\n", dlerror());
+  if (!bsect || !bsect_end || bsect_end < bsect)
+    bsect = bsect_end = NULL;
+  if (!csect || !csect_end || csect_end < csect)
+    csect = csect_end = NULL;
+  if (!bsect && !csect) {
+    fprintf(stderr, "ERROR: no bexec section: %s\n", dlerror());
     exit(-1);
   }
 
@@ -118,6 +1087,8 @@ int main(int argc, char * argv[], char * env[])
 
   if (cfd) {
     tester.cfd = atoi(cfd);
+    /* the butcher polls, but we want to block rather than lose messages */
+    fcntl(tester.cfd, F_SETFL, fcntl(tester.cfd, F_GETFL) & ~O_NONBLOCK);
   } else {
     tester.cfd  = -1;
     oldstdout = stdout;
@@ -125,11 +1096,9 @@ int main(int argc, char * argv[], char * env[])
   }
 
   if (dl_setup) {
-    unsigned id = atol(dl_setup);
-    if (bsect + id < bsect_end) {
-      tester.setup = bsect[id].function;
-    } else {
-      fprintf(stderr, "ERROR: invalid setup function: %u\n", id);
+    tester.setup = bt_function(bsect, bsect_end, csect, csect_end, atol(dl_setup), NULL);
+    if (!tester.setup) {
+      fprintf(stderr, "ERROR: invalid setup function: %s\n", dl_setup);
       exit(-1);
     }
   } else {
@@ -137,25 +1106,19 @@ int main(int argc, char * argv[], char * env[])
   }
 
   if (dl_teardown) {
-    unsigned id = atol(dl_teardown);
-    if (bsect + id < bsect_end) {
-      tester.teardown = bsect[id].function;
-    } else {
-      fprintf(stderr, "ERROR: invalid setup function: %u\n", id);
+    tester.teardown = bt_function(bsect, bsect_end, csect, csect_end, atol(dl_teardown), NULL);
+    if (!tester.teardown) {
+      fprintf(stderr, "ERROR: invalid teardown function: %s\n", dl_teardown);
       exit(-1);
     }
   } else {
     tester.teardown = NULL;
   }
 
-  {
-    unsigned id = atol(dl_test);
-    if (bsect + id < bsect_end) {
-      tester.function = bsect[id].function;
-    } else {
-      fprintf(stderr, "ERROR: invalid setup function: %u\n", id);
-      exit(-1);
-    }
+  tester.function = bt_function(bsect, bsect_end, csect, csect_end, atol(dl_test), &flags);
+  if (!tester.function) {
+    fprintf(stderr, "ERROR: invalid test function: %s\n", dl_test);
+    exit(-1);
   }
 
   /* stdout will be redirected */
@@ -168,74 +1131,62 @@ int main(int argc, char * argv[], char * env[])
   if (wres && isatty(tester.fd))
     wres = 0;
 
-  struct result_rec rec = {
-    "\x01\x02\x03\x04",
-    {BT_TEST_NONE, BT_TEST_NONE, BT_TEST_NONE},
-    0
-  };
-
-  result = BT_TEST_NONE;
+  {
+    struct sigaction sa;
+    int fatal[] = {SIGSEGV, SIGBUS, SIGFPE, SIGILL, SIGABRT};
 
-  if (tester.setup) {
-    result = (*tester.setup)(NULL, &object);
-    if (result == BT_RESULT_OK)
-      rec.results[BT_PASS_SETUP] = BT_TEST_SUCCEEDED;
-    else if (result == BT_RESULT_IGNORE)
-      rec.results[BT_PASS_SETUP] = BT_TEST_IGNORED;
-    else if (result == BT_RESULT_FAIL)
-      rec.results[BT_PASS_SETUP] = BT_TEST_FAILED;
-  } else {
-    rec.results[BT_PASS_SETUP] = BT_TEST_NONE;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = bt_log_fatal;
+    sa.sa_flags = SA_RESETHAND | SA_NODEFER;
+    for (unsigned i = 0; i < sizeof(fatal) / sizeof(fatal[0]); i++)
+      sigaction(fatal[i], &sa, NULL);
   }
 
-  if (tester.cfd != -1) {
-    write(tester.cfd, &rec, sizeof(struct result_rec));
+  slot = bt_board_attach(getenv("butcher_board"), getenv("butcher_slot"));
+  if (slot) {
+    bt_board_slot_begin(slot);
+    slot->state = BT_SLOT_RUNNING;
+    slot->pid = getpid();
+    bt_board_slot_end(slot);
   }
 
-  /* does not make much sense to run the test if setup has failed */
-  if (result <= BT_TEST_SUCCEEDED) {
-    test_result = (*tester.function)(object, &object);
-
-    if (test_result == BT_RESULT_OK)
-      rec.results[BT_PASS_TEST] = BT_TEST_SUCCEEDED;
-    else if (test_result == BT_RESULT_IGNORE)
-      rec.results[BT_PASS_TEST] = BT_TEST_IGNORED;
-    else if (test_result == BT_RESULT_FAIL)
-      rec.results[BT_PASS_TEST] = BT_TEST_FAILED;
-    else
-      rec.results[BT_PASS_TEST] = BT_TEST_CORRUPTED;
+  bt_perf_open(get_env_bool("butcher_perf", 0));
+  if (instructions)
+    insn_ready = bt_insn_open();
 
-    if (tester.cfd != -1) {
-      write(tester.cfd, &rec, sizeof(struct result_rec));
-    }
-  }
+  bt_send(BT_MSG_HELLO, NULL, 0);
 
-  if (result <= BT_TEST_SUCCEEDED) {
-    if (tester.teardown) {
-      result = (*tester.teardown)(object, &object);
-      if (result == BT_RESULT_OK)
-        rec.results[BT_PASS_TEARDOWN] = BT_TEST_SUCCEEDED;
-      else if (result == BT_RESULT_IGNORE)
-        rec.results[BT_PASS_TEARDOWN] = BT_TEST_IGNORED;
-      else if (result == BT_RESULT_FAIL)
-        rec.results[BT_PASS_TEARDOWN] = BT_TEST_FAILED;
+  result = BT_TEST_NONE;
 
-      if (tester.cfd != -1) {
-        write(tester.cfd, &rec, sizeof(struct result_rec));
-      }
-    }
+  if (tester.setup)
+    result = bt_run_pass(BT_PASS_SETUP, tester.setup, NULL, &object);
+
+  /* does not make much sense to run the test if setup has failed */
+  if ((flags & BT_FN_KIND_MASK) == BT_FN_KIND_BENCH) {
+    bench = tester.function;
+    bt_run_pass(BT_PASS_TEST, bt_bench, NULL, &object);
+  } else if (result <= BT_TEST_SUCCEEDED) {
+    bt_run_pass(BT_PASS_TEST, tester.function, object, &object);
+
+    if (tester.teardown)
+      bt_run_pass(BT_PASS_TEARDOWN, tester.teardown, object, &object);
   }
 
   /* we are done */
-  rec.done = 1;
-
+  bt_log_flush();
   fflush(stdout);
   fflush(stderr);
 
-  if (tester.cfd != -1) {
-    write(tester.cfd, &rec, sizeof(struct result_rec));
+  if (slot) {
+    bt_board_slot_begin(slot);
+    slot->state = BT_SLOT_DONE;
+    bt_board_slot_end(slot);
   }
 
+  bt_insn_close();
+
+  bt_send(BT_MSG_DONE, NULL, 0);
+
   close(tester.fd);
 
   if (unload)
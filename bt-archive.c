@@ -0,0 +1,662 @@
+/* @@SOURCE-HEADER@@ */
+
+#include "bt-private.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/*
+ * the log archive
+ *
+ * the captured output of every test of a run, compressed in independent
+ * blocks of up to BT_ARCHIVE_BLOCK bytes; the layout is
+ *
+ *   "btarchv\0"
+ *   entry *                 one per test
+ *   index entry [count]     sorted by key
+ *   trailer
+ *
+ * where an entry is a struct bt_archive_entry, the name of the test and
+ * its blocks, each one a struct bt_archive_block followed by the data,
+ * terminated by an empty block; a block is stored as is if it does not
+ * compress
+ */
+
+#define BT_ARCHIVE_MAGIC "btarchv\0"
+#define BT_ARCHIVE_VERSION 1
+#define BT_ARCHIVE_BLOCK (64 * 1024)
+
+struct bt_archive_entry {
+  char     magic[4];
+  uint32_t name_length;
+  uint64_t key;
+};
+
+struct bt_archive_block {
+  uint32_t raw;
+  uint32_t stored;
+};
+
+struct bt_archive_index {
+  uint64_t key;
+  uint64_t offset;
+  uint64_t raw;
+  uint64_t stored;
+};
+
+struct bt_archive_trailer {
+  uint64_t index;
+  uint32_t count;
+  uint32_t version;
+  char     magic[8];
+};
+
+/*************************************************/
+/* a byte oriented LZ77 block compressor */
+
+/*
+ * a block is a sequence of tokens, each one a literal run followed by a
+ * match: the token byte holds both lengths in its nibbles (the match length
+ * minus BT_LZ_MIN), a nibble of 15 is continued by bytes that are added up
+ * until one is not 255; the literals follow, then the 16 bit offset of the
+ * match; the last token has no match
+ */
+
+#define BT_LZ_MIN 4
+#define BT_LZ_HASH_BITS 12
+#define BT_LZ_WINDOW 0xffff
+
+static inline
+uint32_t bt_lz_read32(const unsigned char * p)
+{
+  uint32_t v;
+
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+static inline
+uint32_t bt_lz_hash(uint32_t v)
+{
+  return (v * 2654435761u) >> (32 - BT_LZ_HASH_BITS);
+}
+
+static
+unsigned char * bt_lz_length(unsigned char * op, unsigned char * oe, size_t length)
+{
+  for (; length >= 255; length -= 255) {
+    if (op == oe)
+      return NULL;
+    *op++ = 255;
+  }
+  if (op == oe)
+    return NULL;
+  *op++ = length;
+
+  return op;
+}
+
+static
+unsigned char * bt_lz_sequence(unsigned char * op, unsigned char * oe,
+    const unsigned char * literals, size_t nliterals, size_t offset, size_t length)
+{
+  unsigned char * token;
+
+  if (op == oe)
+    return NULL;
+
+  token = op++;
+  *token = (nliterals < 15 ? nliterals : 15) << 4;
+  if (nliterals >= 15 && !(op = bt_lz_length(op, oe, nliterals - 15)))
+    return NULL;
+
+  if ((size_t) (oe - op) < nliterals)
+    return NULL;
+  memcpy(op, literals, nliterals);
+  op += nliterals;
+
+  if (!length)
+    return op;
+
+  if (oe - op < 2)
+    return NULL;
+  *op++ = offset & 0xff;
+  *op++ = offset >> 8;
+
+  length -= BT_LZ_MIN;
+  *token |= length < 15 ? length : 15;
+  if (length >= 15 && !(op = bt_lz_length(op, oe, length - 15)))
+    return NULL;
+
+  return op;
+}
+
+/**
+ * compresses a block
+ *
+ * @param[in] src the data to compress
+ * @param[in] length the length of src, at most BT_ARCHIVE_BLOCK
+ * @param[out] dst a buffer to hold the compressed data
+ * @param[in] size the size of dst
+ *
+ * @return the compressed length, 0 if it does not fit into dst
+ */
+
+static
+size_t bt_lz_compress(const unsigned char * src, size_t length, unsigned char * dst, size_t size)
+{
+  uint32_t table[1 << BT_LZ_HASH_BITS];
+  const unsigned char * ip = src, * anchor = src, * end = src + length, * ref;
+  unsigned char * op = dst, * oe = dst + size;
+  size_t misses = 0;
+
+  memset(table, 0xff, sizeof(table));
+
+  while (length >= BT_LZ_MIN && ip <= end - BT_LZ_MIN) {
+    uint32_t v = bt_lz_read32(ip);
+    uint32_t h = bt_lz_hash(v);
+
+    ref = table[h] != UINT32_MAX ? src + table[h] : NULL;
+    table[h] = ip - src;
+
+    if (!ref || ip - ref > BT_LZ_WINDOW || bt_lz_read32(ref) != v) {
+      /* step over data that does not compress faster and faster */
+      ip += 1 + (misses++ >> 6);
+      continue;
+    }
+    misses = 0;
+
+    size_t match = BT_LZ_MIN;
+    while (ip + match < end && ref[match] == ip[match])
+      match++;
+
+    op = bt_lz_sequence(op, oe, anchor, ip - anchor, ip - ref, match);
+    if (!op)
+      return 0;
+
+    ip += match;
+    anchor = ip;
+  }
+
+  op = bt_lz_sequence(op, oe, anchor, end - anchor, 0, 0);
+  if (!op)
+    return 0;
+
+  return op - dst;
+}
+
+/**
+ * decompresses a block
+ *
+ * @param[in] src the compressed data
+ * @param[in] length the length of src
+ * @param[out] dst a buffer to hold the data
+ * @param[in] size the size of dst
+ *
+ * @return the decompressed length, -1 if the data is corrupted
+ */
+
+static
+ssize_t bt_lz_decompress(const unsigned char * src, size_t length, unsigned char * dst, size_t size)
+{
+  const unsigned char * ip = src, * ie = src + length;
+  unsigned char * op = dst, * oe = dst + size;
+  size_t n;
+
+  while (ip < ie) {
+    unsigned token = *ip++;
+
+    n = token >> 4;
+    if (n == 15) {
+      do {
+        if (ip == ie)
+          return -1;
+        n += *ip;
+      } while (*ip++ == 255);
+    }
+    if ((size_t) (ie - ip) < n || (size_t) (oe - op) < n)
+      return -1;
+    memcpy(op, ip, n);
+    ip += n;
+    op += n;
+
+    if (ip == ie)
+      break;
+
+    if (ie - ip < 2)
+      return -1;
+    size_t offset = ip[0] | (ip[1] << 8);
+    ip += 2;
+    if (!offset || offset > (size_t) (op - dst))
+      return -1;
+
+    n = token & 15;
+    if (n == 15) {
+      do {
+        if (ip == ie)
+          return -1;
+        n += *ip;
+      } while (*ip++ == 255);
+    }
+    n += BT_LZ_MIN;
+    if ((size_t) (oe - op) < n)
+      return -1;
+
+    /* the match may overlap with its own output */
+    for (const unsigned char * ref = op - offset; n; n--)
+      *op++ = *ref++;
+  }
+
+  return op - dst;
+}
+
+/*************************************************/
+/* the reporter writing the archive */
+
+struct bt_archive {
+  FILE                    * fd;
+  uint64_t                  offset;
+  struct bt_archive_index * index;
+  unsigned                  count;
+  unsigned                  size;
+  struct bt_archive_index * cur;
+  size_t                    fill;
+  unsigned char             in[BT_ARCHIVE_BLOCK];
+  unsigned char             out[BT_ARCHIVE_BLOCK];
+};
+
+static
+int bt_archive_write(struct bt_archive * self, const void * data, size_t length)
+{
+  if (length && fwrite(data, length, 1, self->fd) != 1)
+    return_error(EIO);
+
+  self->offset += length;
+
+  return 0;
+}
+
+static
+int bt_archive_flush(struct bt_archive * self)
+{
+  struct bt_archive_block block;
+  size_t length;
+  int err;
+
+  if (!self->fill)
+    return 0;
+
+  length = bt_lz_compress(self->in, self->fill, self->out, self->fill - 1);
+
+  block.raw = self->fill;
+  block.stored = length ? length : self->fill;
+
+  err = bt_archive_write(self, &block, sizeof(block));
+  if (!err)
+    err = bt_archive_write(self, length ? self->out : self->in, block.stored);
+  if (err)
+    return_error(err);
+
+  self->cur->raw += block.raw;
+  self->cur->stored += sizeof(block) + block.stored;
+  self->fill = 0;
+
+  return 0;
+}
+
+static
+int bt_archive_feed(struct bt_archive * self, const void * data, size_t length)
+{
+  const unsigned char * p = data;
+  size_t n;
+  int err;
+
+  while (length) {
+    n = BT_ARCHIVE_BLOCK - self->fill;
+    n = n < length ? n : length;
+    memcpy(self->in + self->fill, p, n);
+    self->fill += n;
+    p += n;
+    length -= n;
+
+    if (self->fill == BT_ARCHIVE_BLOCK) {
+      err = bt_archive_flush(self);
+      if (err)
+        return_error(err);
+    }
+  }
+
+  return 0;
+}
+
+static
+int bt_archive_feed_file(struct bt_archive * self, const char * path)
+{
+  struct stat st;
+  void * map;
+  int fd, err;
+
+  fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (fd == -1)
+    return 0;
+
+  if (fstat(fd, &st) == -1 || st.st_size == 0) {
+    close(fd);
+    return 0;
+  }
+
+  map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED)
+    return 0;
+
+  madvise(map, st.st_size, MADV_SEQUENTIAL);
+  err = bt_archive_feed(self, map, st.st_size);
+  munmap(map, st.st_size);
+
+  return err;
+}
+
+static
+int bt_archive_run_start(bt_reporter_t * self)
+{
+  struct bt_archive * data;
+
+  data = calloc(1, sizeof(struct bt_archive));
+  if (!data)
+    return_error(ENOMEM);
+
+  data->fd = self->fd;
+  self->data = data;
+
+  return bt_archive_write(data, BT_ARCHIVE_MAGIC, 8);
+}
+
+static
+int bt_archive_test_end(bt_reporter_t * self, const bt_event_t * event)
+{
+  struct bt_archive * data = self->data;
+  struct bt_archive_entry entry;
+  struct bt_archive_block block = {0, 0};
+  const char * base;
+  int err;
+
+  if (event->result <= BT_TEST_NONE)
+    return 0;
+
+  if (data->count == data->size) {
+    unsigned size = data->size ? data->size * 2 : 64;
+    void * index = realloc(data->index, size * sizeof(struct bt_archive_index));
+    if (!index)
+      return_error(ENOMEM);
+    data->index = index;
+    data->size = size;
+  }
+
+  base = strrchr(event->elf, '/') ? strrchr(event->elf, '/') + 1 : event->elf;
+
+  memcpy(entry.magic, "btle", 4);
+  entry.name_length = strlen(base) + 1 + strlen(event->suite) + 1 + strlen(event->test);
+  entry.key = bt_test_key(event->elf, event->suite, event->test);
+
+  data->cur = &data->index[data->count++];
+  memset(data->cur, 0, sizeof(*data->cur));
+  data->cur->key = entry.key;
+  data->cur->offset = data->offset;
+
+  err = bt_archive_write(data, &entry, sizeof(entry));
+  if (!err) {
+    if (fprintf(data->fd, "%s/%s/%s", base, event->suite, event->test) < 0)
+      err = EIO;
+    data->offset += entry.name_length;
+  }
+  if (err)
+    return_error(err);
+
+  if (event->log) {
+    for (bt_log_line_t * line = event->log->lines; line; line = line->next) {
+      err = bt_archive_feed(data, line->contents, strlen(line->contents));
+      if (!err)
+        err = bt_archive_feed(data, "\n", 1);
+      if (err)
+        return_error(err);
+    }
+  }
+
+  if (event->logfile) {
+    err = bt_archive_feed_file(data, event->logfile);
+    if (err)
+      return_error(err);
+  }
+
+  err = bt_archive_flush(data);
+  if (!err)
+    err = bt_archive_write(data, &block, sizeof(block));
+  if (err)
+    return_error(err);
+
+  return 0;
+}
+
+static
+int bt_archive_index_compare(const void * a, const void * b)
+{
+  const struct bt_archive_index * x = a, * y = b;
+
+  if (x->key != y->key)
+    return x->key < y->key ? -1 : 1;
+  return x->offset < y->offset ? -1 : x->offset > y->offset;
+}
+
+static
+int bt_archive_run_end(bt_reporter_t * self)
+{
+  struct bt_archive * data = self->data;
+  struct bt_archive_trailer trailer;
+  int err;
+
+  qsort(data->index, data->count, sizeof(struct bt_archive_index), bt_archive_index_compare);
+
+  /* keep the index aligned, so it can be used in place */
+  err = bt_archive_write(data, "\0\0\0\0\0\0\0", -data->offset & 7);
+  if (err)
+    return_error(err);
+
+  memset(&trailer, 0, sizeof(trailer));
+  trailer.index = data->offset;
+  trailer.count = data->count;
+  trailer.version = BT_ARCHIVE_VERSION;
+  memcpy(trailer.magic, BT_ARCHIVE_MAGIC, sizeof(trailer.magic));
+
+  err = bt_archive_write(data, data->index, data->count * sizeof(struct bt_archive_index));
+  if (!err)
+    err = bt_archive_write(data, &trailer, sizeof(trailer));
+  if (err)
+    return_error(err);
+
+  return 0;
+}
+
+static
+void bt_archive_release(bt_reporter_t * self)
+{
+  struct bt_archive * data = self->data;
+
+  if (data) {
+    free(data->index);
+    free(data);
+  }
+}
+
+const bt_reporter_ops_t bt_archive_ops = {
+  .name = "archive",
+  .run_start = bt_archive_run_start,
+  .test_end = bt_archive_test_end,
+  .run_end = bt_archive_run_end,
+  .release = bt_archive_release,
+};
+
+/**
+ * stores the output of every test compressed in an archive
+ *
+ * @param[in] self the butcher
+ * @param[in] path the archive to write
+ *
+ * @return the operation error code
+ */
+
+int bt_archive(bt_t * self, const char * path)
+{
+  char * spec;
+  int err;
+
+  if (!self || !path)
+    return_error(EINVAL);
+
+  if (asprintf(&spec, "archive:%s", path) == -1)
+    return_error(ENOMEM);
+
+  err = bt_reporter(self, spec);
+  free(spec);
+
+  return err;
+}
+
+/*************************************************/
+
+/**
+ * prints the output of a single test from an archive
+ *
+ * @param[in] path the archive
+ * @param[in] name the test as "<elf>/<suite>/<test>" (the basename of elf)
+ * @param[in] fd the stream to print to
+ *
+ * @return the operation error code
+ */
+
+int bt_archive_show(const char * path, const char * name, FILE * fd)
+{
+  const struct bt_archive_trailer * trailer;
+  const struct bt_archive_index * index, * found = NULL;
+  const unsigned char * map = MAP_FAILED, * p, * pe;
+  unsigned char * out = NULL;
+  struct stat st;
+  uint64_t key;
+  size_t lo, hi;
+  int err, file;
+
+  if (!path || !name || !fd)
+    return_error(EINVAL);
+
+  err = bt_test_key_parse(name, &key);
+  if (err) {
+    fprintf(fd, "'%s' does not name a test as <elf>/<suite>/<test>\n", name);
+    return_error(err);
+  }
+
+  file = open(path, O_RDONLY | O_CLOEXEC);
+  if (file == -1)
+    return_error(errno);
+
+  if (fstat(file, &st) == -1) {
+    err = errno;
+    close(file);
+    return_error(err);
+  }
+
+  if ((size_t) st.st_size >= 8 + sizeof(*trailer))
+    map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+  close(file);
+
+  err = EINVAL;
+  if (map == MAP_FAILED)
+    goto failure;
+
+  trailer = (const struct bt_archive_trailer *) (map + st.st_size - sizeof(*trailer));
+  if (memcmp(map, BT_ARCHIVE_MAGIC, 8) != 0
+      || memcmp(trailer->magic, BT_ARCHIVE_MAGIC, sizeof(trailer->magic)) != 0
+      || trailer->version != BT_ARCHIVE_VERSION
+      || trailer->index > (uint64_t) st.st_size - sizeof(*trailer) || trailer->index & 7
+      || trailer->count > ((uint64_t) st.st_size - sizeof(*trailer) - trailer->index) / sizeof(*index))
+    goto failure;
+
+  /* find the first entry with the key, the names tell collisions apart */
+  index = (const struct bt_archive_index *) (map + trailer->index);
+  for (lo = 0, hi = trailer->count; lo < hi;) {
+    size_t mid = lo + (hi - lo) / 2;
+    if (index[mid].key < key)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+
+  for (; lo < trailer->count && index[lo].key == key; lo++) {
+    struct bt_archive_entry entry;
+
+    if (index[lo].offset > trailer->index - sizeof(entry))
+      goto failure;
+    memcpy(&entry, map + index[lo].offset, sizeof(entry));
+    if (entry.name_length == strlen(name)
+        && entry.name_length <= trailer->index - index[lo].offset - sizeof(entry)
+        && memcmp(map + index[lo].offset + sizeof(entry), name, entry.name_length) == 0) {
+      found = &index[lo];
+      break;
+    }
+  }
+
+  if (!found) {
+    fprintf(fd, "no log for '%s' in '%s'\n", name, path);
+    munmap((void *) map, st.st_size);
+    return 0;
+  }
+
+  out = malloc(BT_ARCHIVE_BLOCK);
+  if (!out) {
+    err = ENOMEM;
+    goto failure;
+  }
+
+  p = map + found->offset + sizeof(struct bt_archive_entry) + strlen(name);
+  pe = map + trailer->index;
+  for (;;) {
+    struct bt_archive_block block;
+
+    if ((size_t) (pe - p) < sizeof(block))
+      goto failure;
+    memcpy(&block, p, sizeof(block));
+    p += sizeof(block);
+
+    if (!block.raw)
+      break;
+    if (block.raw > BT_ARCHIVE_BLOCK || block.stored > block.raw || block.stored > (size_t) (pe - p))
+      goto failure;
+
+    if (block.stored == block.raw) {
+      fwrite(p, block.raw, 1, fd);
+    } else {
+      if (bt_lz_decompress(p, block.stored, out, block.raw) != (ssize_t) block.raw)
+        goto failure;
+      fwrite(out, block.raw, 1, fd);
+    }
+    p += block.stored;
+  }
+
+  free(out);
+  munmap((void *) map, st.st_size);
+
+  return 0;
+
+failure:
+  if (err == EINVAL)
+    fprintf(stderr, "'%s' is not a valid butcher log archive\n", path);
+  free(out);
+  if (map != MAP_FAILED)
+    munmap((void *) map, st.st_size);
+  return_error(err);
+}
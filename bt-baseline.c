@@ -0,0 +1,614 @@
+/* @@SOURCE-HEADER@@ */
+
+#include "bt-private.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+
+/*
+ * the benchmark baseline
+ *
+ * the timings of every test of a run, so a later run can be compared
+ * against them; the layout is
+ *
+ *   "btbasel\0"
+ *   entry *                 one per test
+ *   index entry [count]     sorted by key
+ *   trailer
+ *
+ * where an entry is a struct bt_baseline_entry followed by the summary and
+ * the samples of every input size of a benchmark, a bt_bench_t and
+ * double[nsamples] each; everything is 8 byte aligned
+ *
+ * tests have a single timing per run, so only benchmarks are compared: a
+ * benchmark regressed if, for one of its input sizes, the samples are
+ * larger than the ones of the baseline by the Mann-Whitney U test and the
+ * median grew by more than the threshold; the same goes for the performance
+ * counters (see BT_FLAG_PERF), one reading per pass is nothing to test, so
+ * they are neither stored nor compared, the samples of a benchmark are in
+ * instructions instead of ns under BT_FLAG_INSTRUCTIONS though
+ *
+ * a benchmark that regressed keeps the entry it had in the baseline that is
+ * replaced, so a regression cannot become the reference by running again
+ */
+
+#define BT_BASELINE_MAGIC "btbasel\0"
+#define BT_BASELINE_VERSION 1
+#define BT_BASELINE_ALPHA 0.01
+
+struct bt_baseline_entry {
+  char     magic[4];
+  uint32_t nbench;
+  uint64_t key;
+  uint64_t wall;       /* ns */
+  uint64_t utime;      /* us */
+  uint64_t stime;      /* us */
+  uint64_t maxrss;     /* kB */
+  int32_t  complexity; /* BT_O_*, -1 without a fit */
+  uint32_t reserved;
+};
+
+struct bt_baseline_index {
+  uint64_t key;
+  uint64_t offset;
+};
+
+struct bt_baseline_trailer {
+  uint64_t index;
+  uint32_t count;
+  uint32_t version;
+  char     magic[8];
+};
+
+/* a baseline loaded for comparison, or the one that is replaced */
+struct bt_baseline {
+  unsigned char                  * data;
+  size_t                           size;
+  const struct bt_baseline_index * index;
+  unsigned                         count;
+};
+
+/**
+ * loads a baseline into memory, it may be overwritten by the same run
+ *
+ * @param[out] baseline a pointer to a pointer to hold the baseline
+ * @param[in] path the file holding the baseline
+ *
+ * @return the operation error code
+ */
+
+int bt_baseline_load(bt_baseline_t ** baseline, const char * path)
+{
+  bt_baseline_t * self;
+  struct bt_baseline_trailer trailer;
+  struct stat st;
+  ssize_t length;
+  int err, fd;
+
+  if (!baseline || !path)
+    return_error(EINVAL);
+
+  fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (fd == -1)
+    return_error(errno);
+
+  self = calloc(1, sizeof(bt_baseline_t));
+  if (!self) {
+    close(fd);
+    return_error(ENOMEM);
+  }
+
+  if (fstat(fd, &st) == -1) {
+    err = errno;
+    goto failure;
+  }
+
+  err = EINVAL;
+  if ((size_t) st.st_size < 8 + sizeof(trailer))
+    goto failure;
+
+  self->size = st.st_size;
+  self->data = malloc(self->size);
+  if (!self->data) {
+    err = ENOMEM;
+    goto failure;
+  }
+
+  for (size_t done = 0; done < self->size; done += length) {
+    length = pread(fd, self->data + done, self->size - done, done);
+    if (length <= 0) {
+      err = length ? errno : EINVAL;
+      goto failure;
+    }
+  }
+
+  err = EINVAL;
+  memcpy(&trailer, self->data + self->size - sizeof(trailer), sizeof(trailer));
+  if (memcmp(self->data, BT_BASELINE_MAGIC, 8) != 0
+      || memcmp(trailer.magic, BT_BASELINE_MAGIC, sizeof(trailer.magic)) != 0
+      || trailer.version != BT_BASELINE_VERSION
+      || trailer.index > self->size - sizeof(trailer) || trailer.index & 7
+      || trailer.count > (self->size - sizeof(trailer) - trailer.index) / sizeof(struct bt_baseline_index))
+    goto failure;
+
+  /* the buffer of malloc() is aligned, so the index can be used in place */
+  self->index = (const struct bt_baseline_index *) (self->data + trailer.index);
+  self->count = trailer.count;
+
+  close(fd);
+
+  *baseline = self;
+
+  return 0;
+
+failure:
+  if (err == EINVAL)
+    fprintf(stderr, "'%s' is not a butcher baseline\n", path);
+  close(fd);
+  bt_baseline_release(&self);
+  return_error(err);
+}
+
+/**
+ * releases a baseline
+ *
+ * @param[in] baseline a pointer to a pointer holding the baseline
+ */
+
+void bt_baseline_release(bt_baseline_t ** baseline)
+{
+  if (!baseline || !*baseline)
+    return;
+
+  free((*baseline)->data);
+  free(*baseline);
+
+  *baseline = NULL;
+}
+
+/**
+ * finds the entry of a test
+ *
+ * @param[in] self the baseline
+ * @param[in] key the key of the test (see bt_test_key())
+ *
+ * @return the entry or NULL if it is not there or damaged
+ */
+
+static
+const struct bt_baseline_entry * bt_baseline_find(const bt_baseline_t * self, uint64_t key)
+{
+  const struct bt_baseline_entry * entry;
+  size_t lo, hi, end;
+
+  for (lo = 0, hi = self->count; lo < hi;) {
+    size_t mid = lo + (hi - lo) / 2;
+    if (self->index[mid].key < key)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+
+  if (lo == self->count || self->index[lo].key != key)
+    return NULL;
+
+  end = (const unsigned char *) self->index - self->data;
+  if (self->index[lo].offset & 7 || self->index[lo].offset > end - sizeof(*entry))
+    return NULL;
+
+  entry = (const struct bt_baseline_entry *) (self->data + self->index[lo].offset);
+  if (memcmp(entry->magic, "btbe", 4) != 0 || entry->key != key || entry->nbench > BT_BENCH_SIZES_MAX)
+    return NULL;
+
+  return entry;
+}
+
+/**
+ * measures an entry with the benchmarks following it
+ *
+ * @param[in] self the baseline
+ * @param[in] entry the entry (see bt_baseline_find())
+ *
+ * @return the size of the entry or 0 if it is damaged
+ */
+
+static
+size_t bt_baseline_entry_size(const bt_baseline_t * self, const struct bt_baseline_entry * entry)
+{
+  const unsigned char * p = (const unsigned char *) (entry + 1), * end = (const unsigned char *) self->index;
+
+  for (unsigned k = 0; k < entry->nbench; k++) {
+    const bt_bench_t * bench = (const bt_bench_t *) p;
+
+    if ((size_t) (end - p) < sizeof(bt_bench_t) || bench->nsamples > BT_BENCH_SAMPLES_MAX
+        || (size_t) (end - p) < sizeof(bt_bench_t) + sizeof(double) * bench->nsamples)
+      return 0;
+    p += sizeof(bt_bench_t) + sizeof(double) * bench->nsamples;
+  }
+
+  return p - (const unsigned char *) entry;
+}
+
+/**
+ * compares a benchmark that passed against its baseline
+ *
+ * @param[in] self the baseline
+ * @param[in] key the key of the benchmark (see bt_test_key())
+ * @param[in] test the benchmark
+ * @param[in] threshold the slowdown tolerated, 0.05 for 5%
+ * @param[out] regressed a pointer to hold whether the benchmark regressed
+ * @param[out] message a buffer to hold what regressed
+ * @param[in] size the size of message
+ *
+ * @return the operation error code
+ */
+
+int bt_baseline_check(const bt_baseline_t * self, uint64_t key, const bt_test_t * test,
+    double threshold, int * regressed, char * message, size_t size)
+{
+  const struct bt_baseline_entry * entry;
+  const unsigned char * p, * end;
+  double worst = 0;
+  int length = 0;
+
+  if (!self || !test || !regressed || !message || !size)
+    return_error(EINVAL);
+
+  *regressed = 0;
+  message[0] = '\0';
+
+  entry = bt_baseline_find(self, key);
+  if (!entry)
+    return 0;
+
+  end = (const unsigned char *) self->index;
+  p = (const unsigned char *) (entry + 1);
+
+  for (unsigned k = 0; k < entry->nbench; k++) {
+    const bt_bench_t * old = (const bt_bench_t *) p;
+    const double * samples = (const double *) (old + 1);
+    double change, pvalue;
+
+    if ((size_t) (end - p) < sizeof(bt_bench_t) || old->nsamples > BT_BENCH_SAMPLES_MAX
+        || (size_t) (end - p) < sizeof(bt_bench_t) + sizeof(double) * old->nsamples)
+      return 0;
+    p += sizeof(bt_bench_t) + sizeof(double) * old->nsamples;
+
+    for (unsigned i = 0; i < test->nbench; i++) {
+      /* instructions do not compare to ns */
+      if (test->bench[i].n != old->n || test->bench[i].unit != old->unit || old->median <= 0)
+        continue;
+
+      change = test->bench[i].median / old->median - 1;
+      if (change <= threshold || change <= worst)
+        break;
+
+      pvalue = bt_stats_mann_whitney(samples, old->nsamples, test->samples[i], test->bench[i].nsamples);
+      if (pvalue >= BT_BASELINE_ALPHA)
+        break;
+
+      worst = change;
+      *regressed = 1;
+      if (test->nbench > 1 || old->n)
+        length = snprintf(message, size, "(regressed at n=%llu: %.4g -> %.4g %s, %+.1f%%, p=%.2g",
+            (unsigned long long) old->n, old->median, test->bench[i].median, bt_bench_unit(old),
+            change * 100, pvalue);
+      else
+        length = snprintf(message, size, "(regressed: %.4g -> %.4g %s, %+.1f%%, p=%.2g",
+            old->median, test->bench[i].median, bt_bench_unit(old), change * 100, pvalue);
+      break;
+    }
+  }
+
+  if (!*regressed)
+    return 0;
+
+  /* a change of the complexity says more than any single size */
+  if (test->fit && entry->complexity >= 0 && entry->complexity < BT_O_MAX
+      && (int) test->fit->complexity != entry->complexity && length >= 0 && (size_t) length < size)
+    length += snprintf(message + length, size - length, ", %s -> %s",
+        bt_complexity_names[entry->complexity], bt_complexity_names[test->fit->complexity]);
+
+  if (length >= 0 && (size_t) length < size)
+    snprintf(message + length, size - length, ")");
+
+  return 0;
+}
+
+/**
+ * compares the benchmarks of the run against a baseline, the ones that got
+ * slower regress and fail the run
+ *
+ * @param[in] self the butcher
+ * @param[in] path the baseline (see bt_baseline())
+ * @param[in] threshold the slowdown tolerated, 0.05 for 5%
+ *
+ * @return the operation error code
+ */
+
+int bt_baseline_compare(bt_t * self, const char * path, double threshold)
+{
+  int err;
+
+  if (!self || !path || threshold < 0)
+    return_error(EINVAL);
+
+  if (self->baseline)
+    bt_baseline_release(&self->baseline);
+
+  err = bt_baseline_load(&self->baseline, path);
+  if (err)
+    return_error(err);
+
+  self->threshold = threshold;
+
+  return 0;
+}
+
+/**
+ * returns the number of benchmarks of the run that regressed
+ *
+ * @param[in] self the butcher
+ *
+ * @return the number of regressions
+ */
+
+unsigned bt_regressions(bt_t * self)
+{
+  return self ? self->regressions : 0;
+}
+
+/*************************************************/
+/* the reporter writing the baseline */
+
+struct bt_baseline_writer {
+  char                     * path;
+  char                     * tmp;
+  FILE                     * fd;
+  uint64_t                   offset;
+  struct bt_baseline_index * index;
+  unsigned                   count;
+  unsigned                   size;
+  bt_baseline_t            * old;  /* what is replaced, NULL if nothing */
+};
+
+static
+int bt_baseline_write(struct bt_baseline_writer * self, const void * data, size_t length)
+{
+  if (length && fwrite(data, length, 1, self->fd) != 1)
+    return_error(EIO);
+
+  self->offset += length;
+
+  return 0;
+}
+
+/* the baseline is written next to the old one and replaces it at the end
+ * of the run, which may have compared against it */
+static
+int bt_baseline_open(bt_reporter_t * self, const char * path)
+{
+  struct bt_baseline_writer * data;
+
+  data = calloc(1, sizeof(struct bt_baseline_writer));
+  if (!data)
+    return_error(ENOMEM);
+
+  data->path = strdup(path);
+  if (!data->path || asprintf(&data->tmp, "%s.tmp", path) == -1) {
+    free(data->path);
+    free(data);
+    return_error(ENOMEM);
+  }
+
+  self->data = data;
+
+  return 0;
+}
+
+static
+int bt_baseline_run_start(bt_reporter_t * self)
+{
+  struct bt_baseline_writer * data = self->data;
+
+  data->fd = fopen(data->tmp, "w");
+  if (!data->fd)
+    return_error(errno);
+
+  data->offset = 0;
+  data->count = 0;
+
+  /* without a baseline to replace, regressions are left out */
+  bt_baseline_release(&data->old);
+  if (access(data->path, F_OK) == 0)
+    bt_baseline_load(&data->old, data->path);
+
+  return bt_baseline_write(data, BT_BASELINE_MAGIC, 8);
+}
+
+/* makes room for and adds an entry to the index */
+static
+int bt_baseline_index_add(struct bt_baseline_writer * self, uint64_t key)
+{
+  if (self->count == self->size) {
+    unsigned size = self->size ? self->size * 2 : 64;
+    void * index = realloc(self->index, size * sizeof(struct bt_baseline_index));
+    if (!index)
+      return_error(ENOMEM);
+    self->index = index;
+    self->size = size;
+  }
+
+  self->index[self->count].key = key;
+  self->index[self->count].offset = self->offset;
+  self->count++;
+
+  return 0;
+}
+
+/* copies the entry of a test from the baseline that is replaced */
+static
+int bt_baseline_keep(struct bt_baseline_writer * self, uint64_t key)
+{
+  const struct bt_baseline_entry * entry;
+  size_t size;
+  int err;
+
+  if (!self->old)
+    return 0;
+
+  entry = bt_baseline_find(self->old, key);
+  if (!entry)
+    return 0;
+
+  size = bt_baseline_entry_size(self->old, entry);
+  if (!size)
+    return 0;
+
+  err = bt_baseline_index_add(self, key);
+  if (!err)
+    err = bt_baseline_write(self, entry, size);
+  if (err)
+    return_error(err);
+
+  return 0;
+}
+
+static
+int bt_baseline_test_end(bt_reporter_t * self, const bt_event_t * event)
+{
+  struct bt_baseline_writer * data = self->data;
+  struct bt_baseline_entry entry;
+  int err;
+
+  /* the timings of a test that did not get through are no reference, nor
+   * are the ones of a regression, it keeps the old ones */
+  if (event->result == BT_TEST_REGRESSED)
+    return bt_baseline_keep(data, bt_test_key(event->elf, event->suite, event->test));
+  if (event->result != BT_TEST_SUCCEEDED)
+    return 0;
+
+  memset(&entry, 0, sizeof(entry));
+  memcpy(entry.magic, "btbe", 4);
+  entry.nbench = event->nbench;
+  entry.key = bt_test_key(event->elf, event->suite, event->test);
+  entry.wall = event->wall;
+  entry.utime = (uint64_t) event->ru->ru_utime.tv_sec * 1000000 + event->ru->ru_utime.tv_usec;
+  entry.stime = (uint64_t) event->ru->ru_stime.tv_sec * 1000000 + event->ru->ru_stime.tv_usec;
+  entry.maxrss = event->ru->ru_maxrss;
+  entry.complexity = event->fit ? (int32_t) event->fit->complexity : -1;
+
+  err = bt_baseline_index_add(data, entry.key);
+  if (!err)
+    err = bt_baseline_write(data, &entry, sizeof(entry));
+  for (unsigned k = 0; !err && k < event->nbench; k++) {
+    err = bt_baseline_write(data, &event->bench[k], sizeof(bt_bench_t));
+    if (!err)
+      err = bt_baseline_write(data, event->samples[k], sizeof(double) * event->bench[k].nsamples);
+  }
+  if (err)
+    return_error(err);
+
+  return 0;
+}
+
+static
+int bt_baseline_index_compare(const void * a, const void * b)
+{
+  const struct bt_baseline_index * x = a, * y = b;
+
+  if (x->key != y->key)
+    return x->key < y->key ? -1 : 1;
+  return x->offset < y->offset ? -1 : x->offset > y->offset;
+}
+
+static
+int bt_baseline_run_end(bt_reporter_t * self)
+{
+  struct bt_baseline_writer * data = self->data;
+  struct bt_baseline_trailer trailer;
+  int err;
+
+  qsort(data->index, data->count, sizeof(struct bt_baseline_index), bt_baseline_index_compare);
+
+  memset(&trailer, 0, sizeof(trailer));
+  trailer.index = data->offset;
+  trailer.count = data->count;
+  trailer.version = BT_BASELINE_VERSION;
+  memcpy(trailer.magic, BT_BASELINE_MAGIC, sizeof(trailer.magic));
+
+  err = bt_baseline_write(data, data->index, data->count * sizeof(struct bt_baseline_index));
+  if (!err)
+    err = bt_baseline_write(data, &trailer, sizeof(trailer));
+  if (!err && fclose(data->fd) == EOF)
+    err = EIO;
+  else if (err)
+    fclose(data->fd);
+  data->fd = NULL;
+  if (err)
+    return_error(err);
+
+  if (rename(data->tmp, data->path) == -1)
+    return_error(errno);
+
+  return 0;
+}
+
+static
+void bt_baseline_writer_release(bt_reporter_t * self)
+{
+  struct bt_baseline_writer * data = self->data;
+
+  if (data) {
+    /* a run that did not end leaves the old baseline alone */
+    if (data->fd) {
+      fclose(data->fd);
+      unlink(data->tmp);
+    }
+    free(data->path);
+    free(data->tmp);
+    free(data->index);
+    bt_baseline_release(&data->old);
+    free(data);
+  }
+}
+
+const bt_reporter_ops_t bt_baseline_ops = {
+  .name = "baseline",
+  .open = bt_baseline_open,
+  .run_start = bt_baseline_run_start,
+  .test_end = bt_baseline_test_end,
+  .run_end = bt_baseline_run_end,
+  .release = bt_baseline_writer_release,
+};
+
+/**
+ * stores the timings of every test in a baseline when the run is over
+ *
+ * @param[in] self the butcher
+ * @param[in] path the baseline to write, replaced if it exists
+ *
+ * @return the operation error code
+ */
+
+int bt_baseline(bt_t * self, const char * path)
+{
+  char * spec;
+  int err;
+
+  if (!self || !path)
+    return_error(EINVAL);
+
+  if (asprintf(&spec, "baseline:%s", path) == -1)
+    return_error(ENOMEM);
+
+  err = bt_reporter(self, spec);
+  free(spec);
+
+  return err;
+}
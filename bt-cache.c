@@ -0,0 +1,366 @@
+/* @@SOURCE-HEADER@@ */
+
+#include "bt-private.h"
+
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/*
+ * the manifest cache
+ *
+ * once the records of a shared object have been read, its registry is
+ * written to a file in the cache directory; the next time the object is
+ * loaded unchanged, the manifest is mapped and the registry is used in
+ * place, so the test section is not looked at again; the layout is
+ *
+ *   struct bt_manifest_hdr
+ *   bt_suite_t    [hdr.nsuites]
+ *   unsigned      [hdr.ntests]    ids
+ *   unsigned      [hdr.ntests]    setupids
+ *   unsigned      [hdr.ntests]    teardownids
+ *   uint32_t      [hdr.ntests]    names
+ *   uint32_t      [hdr.ntests]    tags
+ *   unsigned char [hdr.ntests]    kinds
+ *
+ * names are offsets into the object, so a manifest is only good for the
+ * very same file: it is named after the build-id of the object and checked
+ * against its size, objects without a build-id use their inode, size and
+ * modification time instead
+ */
+
+#define BT_MANIFEST_MAGIC "btmanif\0"
+#define BT_MANIFEST_VERSION 2
+
+struct bt_manifest_hdr {
+  char          magic[8];
+  uint32_t      version;
+  uint32_t      fncount;
+  uint32_t      nsuites;
+  uint32_t      ntests;
+  uint64_t      size;
+  uint64_t      dev;
+  uint64_t      ino;
+  int64_t       mtime_sec;
+  int64_t       mtime_nsec;
+  uint32_t      idlength; /* 0 if the object has no build-id */
+  unsigned char id[BT_BUILD_ID_MAX];
+};
+
+/**
+ * fills in the header of the manifest of an elf, which is what a manifest
+ * has to match to be used
+ *
+ * @param[in] elf the elf
+ * @param[out] hdr the header
+ */
+
+static
+void bt_manifest_hdr(bt_elf_t * elf, struct bt_manifest_hdr * hdr)
+{
+  const struct stat * st = bt_image_stat(elf->image);
+  size_t idlength = BT_BUILD_ID_MAX;
+
+  memset(hdr, 0, sizeof(struct bt_manifest_hdr));
+
+  memcpy(hdr->magic, BT_MANIFEST_MAGIC, sizeof(hdr->magic));
+  hdr->version = BT_MANIFEST_VERSION;
+  hdr->size = st->st_size;
+
+  if (bt_image_build_id(elf->image, hdr->id, &idlength) == 0) {
+    hdr->idlength = idlength;
+  } else {
+    hdr->dev = st->st_dev;
+    hdr->ino = st->st_ino;
+    hdr->mtime_sec = st->st_mtim.tv_sec;
+    hdr->mtime_nsec = st->st_mtim.tv_nsec;
+  }
+}
+
+/**
+ * builds the path of the manifest of an elf
+ *
+ * @param[in] dir the cache directory
+ * @param[in] hdr the header of the manifest
+ *
+ * @return the path (to be free()d) or NULL
+ */
+
+static
+char * bt_manifest_path(const char * dir, const struct bt_manifest_hdr * hdr)
+{
+  char name[2 * BT_BUILD_ID_MAX + 1];
+  char * path;
+
+  if (hdr->idlength) {
+    for (unsigned n = 0; n < hdr->idlength; n++)
+      sprintf(name + 2 * n, "%02x", hdr->id[n]);
+  } else {
+    /* FNV-1a of size, device, inode and modification time */
+    uint64_t h = bt_fnv1a(BT_FNV_BASIS, &hdr->size,
+        offsetof(struct bt_manifest_hdr, idlength) - offsetof(struct bt_manifest_hdr, size));
+
+    snprintf(name, sizeof(name), "%016llx", (unsigned long long) h);
+  }
+
+  if (asprintf(&path, "%s/%s.manifest", dir, name) == -1)
+    return NULL;
+
+  return path;
+}
+
+static inline
+size_t bt_manifest_size(uint32_t nsuites, uint32_t ntests)
+{
+  return sizeof(struct bt_manifest_hdr) + sizeof(bt_suite_t) * nsuites
+    + (sizeof(unsigned) * 3 + sizeof(uint32_t) * 2 + 1) * ntests;
+}
+
+/**
+ * sets up the registry of an elf from its cached manifest
+ *
+ * @param[in] elf the elf, which has not been loaded yet
+ *
+ * @return the operation error code (ENOENT if there is no usable manifest)
+ */
+
+int bt_cache_load(bt_elf_t * elf)
+{
+  struct bt_manifest_hdr hdr;
+  const struct bt_manifest_hdr * found;
+  unsigned char * map, * p;
+  struct stat st;
+  size_t strings_size;
+  char * path;
+  int fd;
+
+  if (!elf || !elf->butcher->cachedir)
+    return_error(EINVAL);
+
+  bt_manifest_hdr(elf, &hdr);
+
+  path = bt_manifest_path(elf->butcher->cachedir, &hdr);
+  if (!path)
+    return_error(ENOMEM);
+
+  fd = open(path, O_RDONLY | O_CLOEXEC);
+  free(path);
+  if (fd == -1)
+    return ENOENT;
+
+  if (fstat(fd, &st) == -1 || (size_t) st.st_size < sizeof(hdr)) {
+    close(fd);
+    return ENOENT;
+  }
+
+  /* private and writable, so the registry can be used as it is */
+  map = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED)
+    return ENOENT;
+
+  found = (const struct bt_manifest_hdr *) map;
+  if (memcmp(found->magic, hdr.magic, sizeof(hdr.magic)) != 0
+      || found->version != hdr.version || found->size != hdr.size
+      || found->idlength != hdr.idlength || memcmp(found->id, hdr.id, sizeof(hdr.id)) != 0
+      || found->dev != hdr.dev || found->ino != hdr.ino
+      || found->mtime_sec != hdr.mtime_sec || found->mtime_nsec != hdr.mtime_nsec
+      || found->ntests > found->fncount || found->nsuites > found->ntests
+      || (size_t) st.st_size != bt_manifest_size(found->nsuites, found->ntests))
+    goto stale;
+
+  elf->fncount = found->fncount;
+  elf->nsuites = found->nsuites;
+  elf->ntests = found->ntests;
+
+  p = map + sizeof(struct bt_manifest_hdr);
+  elf->suites = (bt_suite_t *) p;
+  p += sizeof(bt_suite_t) * elf->nsuites;
+  elf->ids = (unsigned *) p;
+  p += sizeof(unsigned) * elf->ntests;
+  elf->setupids = (unsigned *) p;
+  p += sizeof(unsigned) * elf->ntests;
+  elf->teardownids = (unsigned *) p;
+  p += sizeof(unsigned) * elf->ntests;
+  elf->names = (uint32_t *) p;
+  p += sizeof(uint32_t) * elf->ntests;
+  elf->tags = (uint32_t *) p;
+  p += sizeof(uint32_t) * elf->ntests;
+  elf->kinds = p;
+
+  /* a broken manifest must not lead anywhere outside of the object */
+  bt_image_data(elf->image, &strings_size);
+  for (unsigned s = 0, first = 0; s < elf->nsuites; s++) {
+    if (elf->suites[s].first != first || elf->suites[s].count > elf->ntests - first
+        || (elf->suites[s].name != BT_NO_NAME && elf->suites[s].name >= strings_size))
+      goto stale;
+    first += elf->suites[s].count;
+    if (s + 1 == elf->nsuites && first != elf->ntests)
+      goto stale;
+  }
+  for (unsigned t = 0; t < elf->ntests; t++) {
+    if (elf->ids[t] >= elf->fncount || elf->names[t] >= strings_size
+        || (elf->setupids[t] != BT_NO_ID && elf->setupids[t] >= elf->fncount)
+        || (elf->teardownids[t] != BT_NO_ID && elf->teardownids[t] >= elf->fncount))
+      goto stale;
+  }
+
+  elf->results = bt_arena_alloc(elf->arena, sizeof(*elf->results) * (elf->ntests + 1));
+  elf->tests = bt_arena_alloc(elf->arena, sizeof(bt_test_t) * (elf->ntests + 1));
+  if (!elf->results || !elf->tests) {
+    munmap(map, st.st_size);
+    return_error(ENOMEM);
+  }
+
+  memset(elf->results, BT_TEST_NONE, sizeof(*elf->results) * (elf->ntests + 1));
+  memset(elf->tests, 0, sizeof(bt_test_t) * (elf->ntests + 1));
+
+  /* the names as reading the records would have indexed them */
+  if (bt_table_init(&elf->index, elf->arena, elf->nsuites + elf->ntests)) {
+    munmap(map, st.st_size);
+    return_error(ENOMEM);
+  }
+  for (unsigned s = 0; s < elf->nsuites; s++) {
+    if (bt_table_add(&elf->index, BT_NO_ID, bt_elf_suite_name(elf, s), s))
+      goto stale;
+    for (unsigned t = elf->suites[s].first; t < elf->suites[s].first + elf->suites[s].count; t++) {
+      if (bt_table_add(&elf->index, s, bt_elf_test_name(elf, t), t))
+        goto stale;
+    }
+  }
+
+  elf->manifest = map;
+  elf->manifest_size = st.st_size;
+
+  return 0;
+
+stale:
+  munmap(map, st.st_size);
+  elf->fncount = elf->nsuites = elf->ntests = 0;
+  elf->suites = NULL;
+  elf->ids = elf->setupids = elf->teardownids = NULL;
+  elf->names = elf->tags = NULL;
+  elf->kinds = NULL;
+  memset(&elf->index, 0, sizeof(elf->index));
+  return ENOENT;
+}
+
+/**
+ * writes the manifest of a loaded elf to the cache
+ *
+ * @param[in] elf the elf
+ *
+ * @return the operation error code
+ */
+
+int bt_cache_store(bt_elf_t * elf)
+{
+  struct bt_manifest_hdr hdr;
+  char * path = NULL, * tmp = NULL;
+  FILE * file = NULL;
+  int fd, err = 0;
+
+  if (!elf || !elf->butcher->cachedir)
+    return_error(EINVAL);
+
+  bt_manifest_hdr(elf, &hdr);
+  hdr.fncount = elf->fncount;
+  hdr.nsuites = elf->nsuites;
+  hdr.ntests = elf->ntests;
+
+  path = bt_manifest_path(elf->butcher->cachedir, &hdr);
+  if (!path || asprintf(&tmp, "%s.XXXXXX", path) == -1) {
+    tmp = NULL;
+    err = ENOMEM;
+    goto failure;
+  }
+
+  /* the same object may be loaded twice at the same time */
+  fd = mkostemp(tmp, O_CLOEXEC);
+  if (fd == -1) {
+    free(tmp);
+    tmp = NULL;
+    err = errno;
+    goto failure;
+  }
+
+  file = fdopen(fd, "w");
+  if (!file) {
+    err = errno;
+    close(fd);
+    goto failure;
+  }
+
+  if (fwrite(&hdr, sizeof(hdr), 1, file) != 1
+      || fwrite(elf->suites, sizeof(bt_suite_t), elf->nsuites, file) != elf->nsuites
+      || fwrite(elf->ids, sizeof(unsigned), elf->ntests, file) != elf->ntests
+      || fwrite(elf->setupids, sizeof(unsigned), elf->ntests, file) != elf->ntests
+      || fwrite(elf->teardownids, sizeof(unsigned), elf->ntests, file) != elf->ntests
+      || fwrite(elf->names, sizeof(uint32_t), elf->ntests, file) != elf->ntests
+      || fwrite(elf->tags, sizeof(uint32_t), elf->ntests, file) != elf->ntests
+      || fwrite(elf->kinds, 1, elf->ntests, file) != elf->ntests) {
+    err = EIO;
+    goto failure;
+  }
+
+  if (fclose(file)) {
+    file = NULL;
+    err = EIO;
+    goto failure;
+  }
+  file = NULL;
+
+  /* readers see either the old manifest or the whole new one */
+  if (rename(tmp, path) == -1) {
+    err = errno;
+    goto failure;
+  }
+
+  free(tmp);
+  free(path);
+
+  return 0;
+
+failure:
+  if (file)
+    fclose(file);
+  if (tmp)
+    unlink(tmp);
+  free(tmp);
+  free(path);
+  return_error(err);
+}
+
+/**
+ * keeps the registries of loaded shared objects in a directory, so
+ * unchanged objects are loaded without reading their test section
+ *
+ * @param[in] self a pointer the butcher
+ * @param[in] dir the cache directory, created if it does not exist
+ *
+ * @return the operation error code
+ */
+
+int bt_cache(bt_t * self, const char * dir)
+{
+  if (!self || !dir)
+    return_error(EINVAL);
+
+  if (mkdir(dir, 0755) == -1 && errno != EEXIST) {
+    fprintf(self->fd, "could not create cache directory '%s'\n", dir);
+    return_error(errno);
+  }
+
+  free(self->cachedir);
+  self->cachedir = strdup(dir);
+  if (!self->cachedir)
+    return_error(ENOMEM);
+
+  return 0;
+}
@@ -0,0 +1,337 @@
+/* @@SOURCE-HEADER@@ */
+
+#include "bt-private.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include <sched.h>
+
+/*
+ * A/B comparison of two builds of the same test library
+ *
+ * the tests of the first object are matched by suite and name with the
+ * ones of the second, each pair is run a number of rounds, A and B in
+ * turn and pinned to the same core, so drift of the clock, the temperature
+ * or the load of the machine hits both sides alike; the report has the
+ * medians of both sides for every measure, the relative difference and how
+ * significant it is by the two sided Mann-Whitney U test:
+ *
+ *   *** p < 0.001, ** p < 0.01, * p < 0.05
+ */
+
+enum {
+  BT_AB_TIME,   /* of a benchmark, at its largest input size */
+  BT_AB_INSN,   /* of the test pass, if they were counted */
+  BT_AB_WALL,
+  BT_AB_CPU,
+  BT_AB_MAXRSS,
+  BT_AB_MINFLT,
+  BT_AB_MAJFLT,
+  BT_AB_NVCSW,
+  BT_AB_NIVCSW,
+  BT_AB_MAX
+};
+
+static const char * const bt_ab_names[BT_AB_MAX] = {
+  "time", "insn", "wall", "cpu", "maxrss", "minflt", "majflt", "nvcsw", "nivcsw",
+};
+
+static const char * const bt_ab_units[BT_AB_MAX] = {
+  "ns/op", "", "us", "us", "kB", "", "", "", "",
+};
+
+/**
+ * finds a test by suite and name in the index of the shared object
+ *
+ * @param[in] elf the shared object to look in
+ * @param[in] suite the name of the suite
+ * @param[in] test the name of the test
+ * @param[out] s a pointer to hold the index of the suite
+ * @param[out] t a pointer to hold the index of the test
+ *
+ * @return whether the test was found
+ */
+
+static
+int bt_compare_find(const bt_elf_t * elf, const char * suite, const char * test, unsigned * s, unsigned * t)
+{
+  *s = bt_table_get(&elf->index, BT_NO_ID, suite);
+  if (*s == BT_NO_ID)
+    return 0;
+
+  *t = bt_table_get(&elf->index, *s, test);
+
+  return *t != BT_NO_ID;
+}
+
+/* the core the tests are pinned to, the last one we may run on; it is the
+ * least likely to be busy with interrupts */
+static
+int bt_compare_cpu(void)
+{
+  cpu_set_t cpus;
+
+  if (sched_getaffinity(0, sizeof(cpus), &cpus) == -1)
+    return -1;
+
+  for (int cpu = CPU_SETSIZE - 1; cpu >= 0; cpu--) {
+    if (CPU_ISSET(cpu, &cpus))
+      return cpu;
+  }
+
+  return -1;
+}
+
+/**
+ * runs a test once more and takes its measures
+ *
+ * @param[in] self a pointer the butcher
+ * @param[in] elf the shared object where test is defined
+ * @param[in] s the index of the suite where test is defined
+ * @param[in] t the index of the test
+ * @param[out] values an array to hold the measures, [BT_AB_MAX] with a
+ *             stride of rounds
+ * @param[in] rounds the stride of values
+ * @param[out] passed a pointer to hold whether the test passed
+ *
+ * @return the operation error code
+ */
+
+static
+int bt_compare_run(bt_t * self, bt_elf_t * elf, unsigned s, unsigned t, double * values, unsigned rounds, int * passed)
+{
+  bt_test_t * test = &elf->tests[t];
+  const bt_counters_t * counters = &test->counters[BT_PASS_TEST];
+  int err;
+
+  /* nothing of the last round is needed */
+  if (test->log)
+    bt_log_delete(&test->log);
+  memset(test, 0, sizeof(bt_test_t));
+
+  err = bt_chopper(self, elf, s, t);
+  if (err)
+    return_error(err);
+
+  *passed = bt_worst_result(elf->results[t]) == BT_TEST_SUCCEEDED;
+
+  values[BT_AB_TIME * rounds] = test->nbench ? test->bench[test->nbench - 1].median : 0;
+  values[BT_AB_INSN * rounds] = counters->perf_mask & (1u << BT_PERF_INSTRUCTIONS)
+    ? counters->perf[BT_PERF_INSTRUCTIONS] : 0;
+  values[BT_AB_WALL * rounds] = test->elapsed[BT_PASS_TEST] / 1000.0;
+  values[BT_AB_CPU * rounds] = counters->utime + counters->stime;
+  values[BT_AB_MAXRSS * rounds] = counters->maxrss;
+  values[BT_AB_MINFLT * rounds] = counters->minflt;
+  values[BT_AB_MAJFLT * rounds] = counters->majflt;
+  values[BT_AB_NVCSW * rounds] = counters->nvcsw;
+  values[BT_AB_NIVCSW * rounds] = counters->nivcsw;
+
+  return 0;
+}
+
+static
+int bt_compare_double(const void * a, const void * b)
+{
+  double x = *(const double *) a, y = *(const double *) b;
+
+  return x < y ? -1 : x > y;
+}
+
+/**
+ * prints the measures of both sides of a test, a measure that is zero on
+ * both sides is left out
+ *
+ * @param[in] self a pointer the butcher
+ * @param[in] a the measures of A, [BT_AB_MAX][rounds], sorted on return
+ * @param[in] b the measures of B, likewise
+ * @param[in] rounds the number of rounds
+ * @param[in] bench the summary of the benchmark, NULL for a test
+ *
+ * @return the change of the measure that tells faster from slower if it
+ *         is significant, 0 otherwise
+ */
+
+static
+double bt_compare_print(bt_t * self, double * a, double * b, unsigned rounds, const bt_bench_t * bench)
+{
+  double leading = 0;
+  int lead;
+
+  /* the time of a benchmark, else what the run is timed in */
+  if (bench)
+    lead = BT_AB_TIME;
+  else
+    lead = self->instructions ? BT_AB_INSN : BT_AB_WALL;
+
+  for (int m = 0; m < BT_AB_MAX; m++) {
+    double * x = a + m * rounds, * y = b + m * rounds;
+    double mx, my, change, p;
+    const char * marker, * color = "";
+
+    qsort(x, rounds, sizeof(double), bt_compare_double);
+    qsort(y, rounds, sizeof(double), bt_compare_double);
+    if (x[rounds - 1] == 0 && y[rounds - 1] == 0)
+      continue;
+
+    mx = bt_stats_median(x, rounds);
+    my = bt_stats_median(y, rounds);
+    change = mx ? my / mx - 1 : 0;
+    p = bt_stats_difference(x, rounds, y, rounds);
+    marker = p < 0.001 ? "***" : p < 0.01 ? "**" : p < 0.05 ? "*" : "";
+
+    /* every measure is better when smaller */
+    if (*marker && self->color)
+      color = change > 0 ? RED : GREEN;
+
+    fprintf(self->fd, "   %-7s %12.4g -> %12.4g %-7s %s%+8.1f%%%s%s%s\n",
+        bt_ab_names[m], mx, my, m == BT_AB_TIME ? bt_bench_unit(bench) : bt_ab_units[m],
+        color, change * 100, *marker ? " " : "", marker, *color ? ENDCOL : "");
+
+    if (m == lead && *marker)
+      leading = change;
+  }
+
+  return leading;
+}
+
+/**
+ * runs the tests of the first two shared objects against each other, the
+ * tests are matched by suite and name, each pair is run in turn
+ *
+ * @param[in] self a pointer the butcher
+ * @param[in] rounds how many times each test of a pair is run
+ *
+ * @return the operation error code
+ */
+
+int bt_compare(bt_t * self, unsigned rounds)
+{
+  bt_elf_t * elfs[2], * elf;
+  double * values = NULL;
+  unsigned count = 0, faster = 0, slower = 0, failed = 0, missing = 0;
+  int err;
+
+  if (!self || !self->initialized || rounds < 2)
+    return_error(EINVAL);
+
+  while (!(err = bt_loader_take(self, &elf)) && elf) ;
+  if (err)
+    return_error(err);
+
+  elfs[0] = self->elfs;
+  elfs[1] = elfs[0] ? elfs[0]->next : NULL;
+  if (!elfs[1] || elfs[1]->next) {
+    fprintf(self->fd, "comparing needs exactly two shared objects\n");
+    return_error(EINVAL);
+  }
+  if (elfs[0]->stream || elfs[1]->stream) {
+    fprintf(self->fd, "streamed shared objects cannot be compared\n");
+    return_error(EINVAL);
+  }
+
+  err = bt_selector_compile(&self->selector);
+  if (err)
+    return_error(err);
+
+  values = malloc(sizeof(double) * 2 * BT_AB_MAX * rounds);
+  if (!values)
+    return_error(ENOMEM);
+
+  self->cpu = bt_compare_cpu();
+
+  fprintf(self->fd, "comparing A='%s%s%s' with B='%s%s%s', %u rounds",
+      self->color ? RED : "", elfs[0]->name, self->color ? ENDCOL : "",
+      self->color ? RED : "", elfs[1]->name, self->color ? ENDCOL : "", rounds);
+  if (self->cpu >= 0)
+    fprintf(self->fd, " on cpu %d", self->cpu);
+  fprintf(self->fd, "\n");
+
+  for (unsigned s = 0; s < elfs[0]->nsuites; s++) {
+    const bt_suite_t * suite = &elfs[0]->suites[s];
+    const char * sname = bt_elf_suite_name(elfs[0], s);
+
+    if (!bt_selector_suite(&self->selector, sname))
+      continue;
+
+    for (unsigned t = suite->first; t < suite->first + suite->count; t++) {
+      const char * tname = bt_elf_test_name(elfs[0], t);
+      unsigned bs, bt;
+      double * a = values, * b = values + BT_AB_MAX * rounds;
+      int passed[2] = {1, 1};
+      unsigned r;
+
+      if (!bt_selector_tags(&self->selector, elfs[0]->tags[t])
+          || !bt_selector_test(&self->selector, elfs[0]->name, sname, tname))
+        continue;
+
+      if (!bt_compare_find(elfs[1], sname, tname, &bs, &bt)) {
+        fprintf(self->fd, "suite '%s', test '%s' is only in A\n", sname, tname);
+        missing++;
+        continue;
+      }
+
+      for (r = 0; r < rounds && passed[0] && passed[1]; r++) {
+        err = bt_compare_run(self, elfs[0], s, t, a + r, rounds, &passed[0]);
+        if (!err && passed[0])
+          err = bt_compare_run(self, elfs[1], bs, bt, b + r, rounds, &passed[1]);
+        if (err)
+          goto failure;
+      }
+
+      fprintf(self->fd, "[%stest%s, suite='%s%s%s', name='%s%s%s']\n",
+          self->color ? PURPLE : "", self->color ? ENDCOL : "",
+          self->color ? GREEN : "", sname, self->color ? ENDCOL : "",
+          self->color ? RED : "", tname, self->color ? ENDCOL : "");
+
+      if (!passed[0] || !passed[1]) {
+        fprintf(self->fd, "   %sfailed in %s in round %u%s\n",
+            self->color ? RED : "", passed[0] ? "B" : "A", r, self->color ? ENDCOL : "");
+        failed++;
+        continue;
+      }
+
+      double change = bt_compare_print(self, a, b, rounds,
+          elfs[0]->tests[t].nbench ? &elfs[0]->tests[t].bench[elfs[0]->tests[t].nbench - 1] : NULL);
+      faster += change < 0;
+      slower += change > 0;
+      count++;
+    }
+  }
+
+  /* the other way around for the ones that are new */
+  for (unsigned s = 0; s < elfs[1]->nsuites; s++) {
+    const bt_suite_t * suite = &elfs[1]->suites[s];
+    const char * sname = bt_elf_suite_name(elfs[1], s);
+    unsigned as, at;
+
+    if (!bt_selector_suite(&self->selector, sname))
+      continue;
+
+    for (unsigned t = suite->first; t < suite->first + suite->count; t++) {
+      if (bt_selector_tags(&self->selector, elfs[1]->tags[t])
+          && bt_selector_test(&self->selector, elfs[1]->name, sname, bt_elf_test_name(elfs[1], t))
+          && !bt_compare_find(elfs[0], sname, bt_elf_test_name(elfs[1], t), &as, &at)) {
+        fprintf(self->fd, "suite '%s', test '%s' is only in B\n", sname, bt_elf_test_name(elfs[1], t));
+        missing++;
+      }
+    }
+  }
+
+  fprintf(self->fd, " => %u test%s compared: %s%u faster%s, %s%u slower%s [%u failed, %u unmatched]\n",
+      count, count == 1 ? "" : "s",
+      self->color ? GREEN : "", faster, self->color ? ENDCOL : "",
+      self->color ? RED : "", slower, self->color ? ENDCOL : "",
+      failed, missing);
+
+  self->cpu = -1;
+  free(values);
+
+  return 0;
+
+failure:
+  self->cpu = -1;
+  free(values);
+  return_error(err);
+}
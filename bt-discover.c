@@ -0,0 +1,338 @@
+/* @@SOURCE-HEADER@@ */
+
+#include "bt-private.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+/*
+ * discovery of shared objects with tests
+ *
+ * a build tree has thousands of shared objects, most of which have no
+ * tests; the tree is walked by a pool of threads sharing a stack of
+ * directories to read, every file that is named like a shared object has
+ * its section headers looked at (see bt_image_probe()), nothing is loaded;
+ * symbolic links are not followed, so every object is found once
+ */
+
+#define BT_WALK_THREADS_MIN 4
+#define BT_WALK_THREADS_MAX 32
+
+struct bt_walk {
+  pthread_mutex_t   lock;
+  pthread_cond_t    cond;
+  char           ** dirs;    /* directories to read */
+  unsigned          ndirs;
+  unsigned          dirsize;
+  unsigned          busy;    /* threads reading a directory */
+  char           ** found;
+  unsigned          nfound;
+  unsigned          foundsize;
+  int               err;
+};
+
+/**
+ * appends a string to a growing array
+ *
+ * @param[in,out] array a pointer to the array
+ * @param[in,out] count a pointer to the number of strings in the array
+ * @param[in,out] size a pointer to the capacity of the array
+ * @param[in] str the string
+ *
+ * @return the operation error code
+ */
+
+static
+int bt_walk_push(char *** array, unsigned * count, unsigned * size, char * str)
+{
+  if (*count == *size) {
+    char ** a = realloc(*array, sizeof(char *) * (*size ? *size * 2 : 16));
+    if (!a)
+      return_error(ENOMEM);
+    *array = a;
+    *size = *size ? *size * 2 : 16;
+  }
+
+  (*array)[(*count)++] = str;
+
+  return 0;
+}
+
+/**
+ * tells whether a file is named like a shared object, i.e. "*.so" or
+ * "*.so.*"
+ */
+
+static
+int bt_walk_candidate(const char * name)
+{
+  const char * p = name;
+
+  while ((p = strstr(p, ".so")) != NULL) {
+    if (p != name && (p[3] == '\0' || p[3] == '.'))
+      return 1;
+    p += 3;
+  }
+
+  return 0;
+}
+
+/**
+ * reads a directory, the subdirectories and the shared objects with tests
+ * in it are collected into arrays of their own
+ *
+ * @param[in] path the directory
+ * @param[out] dirs a pointer to the subdirectories
+ * @param[out] ndirs a pointer to the number of subdirectories
+ * @param[out] found a pointer to the shared objects
+ * @param[out] nfound a pointer to the number of shared objects
+ *
+ * @return the operation error code
+ */
+
+static
+int bt_walk_read(const char * path, char *** dirs, unsigned * ndirs, char *** found, unsigned * nfound)
+{
+  unsigned dirsize = 0, foundsize = 0;
+  struct dirent * entry;
+  struct stat st;
+  unsigned char type;
+  DIR * dir;
+  char * name;
+  int err = 0;
+
+  *dirs = *found = NULL;
+  *ndirs = *nfound = 0;
+
+  /* a directory that cannot be read has nothing to offer */
+  dir = opendir(path);
+  if (!dir)
+    return 0;
+
+  while ((entry = readdir(dir)) != NULL) {
+    if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
+      continue;
+
+    type = entry->d_type;
+    if (type == DT_UNKNOWN) {
+      if (fstatat(dirfd(dir), entry->d_name, &st, AT_SYMLINK_NOFOLLOW) == -1)
+        continue;
+      type = S_ISDIR(st.st_mode) ? DT_DIR : S_ISREG(st.st_mode) ? DT_REG : DT_UNKNOWN;
+    }
+
+    if (type != DT_DIR && (type != DT_REG || !bt_walk_candidate(entry->d_name)))
+      continue;
+
+    if (asprintf(&name, "%s/%s", path, entry->d_name) == -1) {
+      err = ENOMEM;
+      break;
+    }
+
+    if (type == DT_DIR) {
+      err = bt_walk_push(dirs, ndirs, &dirsize, name);
+    } else if (bt_image_probe(name) == 0) {
+      err = bt_walk_push(found, nfound, &foundsize, name);
+    } else {
+      free(name);
+      continue;
+    }
+    if (err) {
+      free(name);
+      break;
+    }
+  }
+
+  closedir(dir);
+
+  if (err)
+    return_error(err);
+
+  return 0;
+}
+
+/**
+ * the loop of a walker thread, which reads directories until there are
+ * none left and no other thread can come up with more
+ *
+ * @param[in] arg a pointer to the walk
+ *
+ * @return NULL
+ */
+
+static
+void * bt_walk_thread(void * arg)
+{
+  struct bt_walk * walk = arg;
+  char ** dirs, ** found, * path;
+  unsigned ndirs, nfound;
+  int err;
+
+  pthread_mutex_lock(&walk->lock);
+  for (;;) {
+    while (!walk->ndirs && walk->busy && !walk->err)
+      pthread_cond_wait(&walk->cond, &walk->lock);
+    if (!walk->ndirs || walk->err)
+      break;
+
+    path = walk->dirs[--walk->ndirs];
+    walk->busy++;
+    pthread_mutex_unlock(&walk->lock);
+
+    err = bt_walk_read(path, &dirs, &ndirs, &found, &nfound);
+    free(path);
+
+    pthread_mutex_lock(&walk->lock);
+    for (unsigned n = 0; n < ndirs; n++) {
+      if (!err)
+        err = bt_walk_push(&walk->dirs, &walk->ndirs, &walk->dirsize, dirs[n]);
+      if (err)
+        free(dirs[n]);
+    }
+    for (unsigned n = 0; n < nfound; n++) {
+      if (!err)
+        err = bt_walk_push(&walk->found, &walk->nfound, &walk->foundsize, found[n]);
+      if (err)
+        free(found[n]);
+    }
+    free(dirs);
+    free(found);
+    if (err && !walk->err)
+      walk->err = err;
+    walk->busy--;
+    pthread_cond_broadcast(&walk->cond);
+  }
+  pthread_mutex_unlock(&walk->lock);
+
+  return NULL;
+}
+
+static
+int bt_walk_cmp(const void * a, const void * b)
+{
+  return strcmp(*(char * const *) a, *(char * const *) b);
+}
+
+/**
+ * looks for shared objects with tests below a directory
+ *
+ * @param[in] self a pointer the butcher
+ * @param[in] dir the directory
+ * @param[out] count a pointer to hold the number of objects found
+ * @param[out] paths a pointer to hold the array of objects found, sorted by
+ *  path and good until the butcher is deleted
+ *
+ * @return the operation error code
+ *
+ * the paths can be passed to bt_loadv() as they are
+ */
+
+int bt_discover(bt_t * self, const char * dir, unsigned * count, char *** paths)
+{
+  struct bt_walk walk;
+  pthread_t * threads;
+  struct stat st;
+  long nthreads;
+  long started;
+  char * root;
+  int err = 0;
+
+  if (!self || !self->initialized || !dir || !count || !paths)
+    return_error(EINVAL);
+
+  *count = 0;
+  *paths = NULL;
+
+  if (stat(dir, &st) == -1) {
+    err = errno;
+    fprintf(self->fd, "could not read directory '%s'\n", dir);
+    return_error(err);
+  }
+  if (!S_ISDIR(st.st_mode)) {
+    fprintf(self->fd, "'%s' is not a directory\n", dir);
+    return_error(ENOTDIR);
+  }
+
+  nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+  /* walking is mostly waiting for the file system */
+  if (nthreads < BT_WALK_THREADS_MIN)
+    nthreads = BT_WALK_THREADS_MIN;
+  if (nthreads > BT_WALK_THREADS_MAX)
+    nthreads = BT_WALK_THREADS_MAX;
+
+  memset(&walk, 0, sizeof(walk));
+
+  /* no trailing slashes, they would end up in every path */
+  root = strdup(dir);
+  threads = malloc(sizeof(pthread_t) * nthreads);
+  if (!root || !threads) {
+    free(root);
+    free(threads);
+    return_error(ENOMEM);
+  }
+  for (size_t length = strlen(root); length > 1 && root[length - 1] == '/'; length--)
+    root[length - 1] = '\0';
+
+  err = bt_walk_push(&walk.dirs, &walk.ndirs, &walk.dirsize, root);
+  if (err) {
+    free(root);
+    free(threads);
+    return_error(err);
+  }
+
+  pthread_mutex_init(&walk.lock, NULL);
+  pthread_cond_init(&walk.cond, NULL);
+
+  for (started = 0; started < nthreads; started++) {
+    if (pthread_create(&threads[started], NULL, bt_walk_thread, &walk))
+      break;
+  }
+
+  /* no thread, no hurry */
+  if (!started)
+    bt_walk_thread(&walk);
+
+  for (long n = 0; n < started; n++)
+    pthread_join(threads[n], NULL);
+
+  pthread_mutex_destroy(&walk.lock);
+  pthread_cond_destroy(&walk.cond);
+  free(threads);
+
+  err = walk.err;
+
+  /* the order does not depend on which thread was first */
+  qsort(walk.found, walk.nfound, sizeof(char *), bt_walk_cmp);
+
+  if (!err && walk.nfound) {
+    *paths = bt_arena_alloc(&self->arena, sizeof(char *) * walk.nfound);
+    if (!*paths)
+      err = ENOMEM;
+    for (unsigned n = 0; !err && n < walk.nfound; n++) {
+      (*paths)[n] = bt_arena_strdup(&self->arena, walk.found[n]);
+      if (!(*paths)[n])
+        err = ENOMEM;
+    }
+  }
+
+  for (unsigned n = 0; n < walk.ndirs; n++)
+    free(walk.dirs[n]);
+  for (unsigned n = 0; n < walk.nfound; n++)
+    free(walk.found[n]);
+  free(walk.dirs);
+  free(walk.found);
+
+  if (err) {
+    *paths = NULL;
+    return_error(err);
+  }
+
+  *count = walk.nfound;
+
+  return 0;
+}
@@ -0,0 +1,623 @@
+/* @@SOURCE-HEADER@@ */
+
+#include "bt-private.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <time.h>
+
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/*
+ * the history database
+ *
+ * an append-only file of fixed size records, one per test and run, that is
+ * used through mmap(); the layout is
+ *
+ *   struct bt_history_hdr
+ *   struct bt_history_bucket [hdr.buckets]   open addressing index
+ *   struct bt_history_rec    [hdr.capacity]  records in order of appending
+ *
+ * a bucket holds the key of a test and the last record appended for it,
+ * every record links to the previous record of the same test, so the last
+ * N outcomes of a test are found by following N links
+ */
+
+#define BT_HISTORY_MAGIC "bthist\0\0"
+#define BT_HISTORY_VERSION 1
+#define BT_HISTORY_BUCKETS 1024
+#define BT_HISTORY_RECORDS 1024
+
+struct bt_history_hdr {
+  char     magic[8];
+  uint32_t version;
+  uint32_t record_size;
+  uint32_t buckets;  /* size of the index, a power of two */
+  uint32_t used;     /* occupied buckets */
+  uint32_t records;  /* records appended */
+  uint32_t capacity; /* records the file has room for */
+  uint32_t runs;
+  uint32_t reserved;
+};
+
+struct bt_history_bucket {
+  uint64_t key;
+  uint32_t last;  /* index + 1 of the last record, 0 for an empty bucket */
+  uint32_t count;
+};
+
+struct bt_history {
+  int                        fd;
+  int                        writable;
+  unsigned char            * map;
+  size_t                     size;
+  struct bt_history_hdr    * hdr;
+  struct bt_history_bucket * buckets;
+  bt_history_rec_t         * records;
+  uint64_t                   started;
+};
+
+static
+size_t bt_history_size(uint32_t buckets, uint32_t capacity)
+{
+  return sizeof(struct bt_history_hdr) + buckets * sizeof(struct bt_history_bucket)
+    + (size_t) capacity * sizeof(bt_history_rec_t);
+}
+
+static
+void bt_history_bind(bt_history_t * self)
+{
+  self->hdr = (struct bt_history_hdr *) self->map;
+  self->buckets = (struct bt_history_bucket *) (self->map + sizeof(struct bt_history_hdr));
+  self->records = (bt_history_rec_t *) (self->buckets + self->hdr->buckets);
+}
+
+static
+int bt_history_remap(bt_history_t * self, size_t size)
+{
+  void * map;
+
+  if (ftruncate(self->fd, size) == -1)
+    return_error(errno);
+
+  map = mremap(self->map, self->size, size, MREMAP_MAYMOVE);
+  if (map == MAP_FAILED)
+    return_error(errno);
+
+  self->map = map;
+  self->size = size;
+  bt_history_bind(self);
+
+  return 0;
+}
+
+static
+struct bt_history_bucket * bt_history_bucket(bt_history_t * self, uint64_t key)
+{
+  uint32_t mask = self->hdr->buckets - 1;
+
+  for (uint32_t i = key & mask;; i = (i + 1) & mask) {
+    if (!self->buckets[i].last || self->buckets[i].key == key)
+      return &self->buckets[i];
+  }
+}
+
+/**
+ * doubles the index, moving the records behind it
+ *
+ * @param[in] self the history
+ *
+ * @return the operation error code
+ */
+
+static
+int bt_history_grow_index(bt_history_t * self)
+{
+  uint32_t buckets = self->hdr->buckets * 2;
+  size_t   offset = buckets / 2 * sizeof(struct bt_history_bucket);
+  int      err;
+
+  err = bt_history_remap(self, bt_history_size(buckets, self->hdr->capacity));
+  if (err)
+    return_error(err);
+
+  memmove((unsigned char *) self->records + offset, self->records,
+      (size_t) self->hdr->records * sizeof(bt_history_rec_t));
+
+  self->hdr->buckets = buckets;
+  self->hdr->used = 0;
+  bt_history_bind(self);
+  memset(self->buckets, 0, buckets * sizeof(struct bt_history_bucket));
+
+  /* the links between records are indices, only the index has to be redone */
+  for (uint32_t n = 0; n < self->hdr->records; n++) {
+    struct bt_history_bucket * bucket = bt_history_bucket(self, self->records[n].key);
+    if (!bucket->last) {
+      bucket->key = self->records[n].key;
+      self->hdr->used++;
+    }
+    bucket->last = n + 1;
+    bucket->count++;
+  }
+
+  return 0;
+}
+
+/**
+ * opens a history database, creating it if needed
+ *
+ * @param[out] history a pointer to a pointer to hold the history
+ * @param[in] path the file holding the database
+ * @param[in] writable whether records are going to be appended, the
+ *            database is locked against other writers until it is closed
+ *
+ * @return the operation error code
+ */
+
+int bt_history_open(bt_history_t ** history, const char * path, int writable)
+{
+  bt_history_t * self;
+  struct stat st;
+  int err;
+
+  if (!history || !path)
+    return_error(EINVAL);
+
+  self = malloc(sizeof(bt_history_t));
+  if (!self)
+    return_error(ENOMEM);
+
+  memset(self, 0, sizeof(bt_history_t));
+  self->map = MAP_FAILED;
+  self->writable = writable;
+
+  self->fd = open(path, (writable ? O_RDWR | O_CREAT : O_RDONLY) | O_CLOEXEC, 0644);
+  if (self->fd == -1) {
+    err = errno;
+    goto failure;
+  }
+
+  if (flock(self->fd, writable ? LOCK_EX : LOCK_SH) == -1) {
+    err = errno;
+    goto failure;
+  }
+
+  if (fstat(self->fd, &st) == -1) {
+    err = errno;
+    goto failure;
+  }
+
+  if (st.st_size == 0) {
+    if (!writable) {
+      err = ENOENT;
+      goto failure;
+    }
+
+    struct bt_history_hdr hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, BT_HISTORY_MAGIC, sizeof(hdr.magic));
+    hdr.version = BT_HISTORY_VERSION;
+    hdr.record_size = sizeof(bt_history_rec_t);
+    hdr.buckets = BT_HISTORY_BUCKETS;
+    hdr.capacity = BT_HISTORY_RECORDS;
+
+    st.st_size = bt_history_size(hdr.buckets, hdr.capacity);
+    if (ftruncate(self->fd, st.st_size) == -1 || pwrite(self->fd, &hdr, sizeof(hdr), 0) != sizeof(hdr)) {
+      err = errno;
+      goto failure;
+    }
+  }
+
+  if ((size_t) st.st_size < sizeof(struct bt_history_hdr)) {
+    err = EINVAL;
+    goto failure;
+  }
+
+  self->size = st.st_size;
+  self->map = mmap(NULL, self->size, PROT_READ | (writable ? PROT_WRITE : 0), MAP_SHARED, self->fd, 0);
+  if (self->map == MAP_FAILED) {
+    err = errno;
+    goto failure;
+  }
+
+  self->hdr = (struct bt_history_hdr *) self->map;
+  if (memcmp(self->hdr->magic, BT_HISTORY_MAGIC, sizeof(self->hdr->magic)) != 0
+      || self->hdr->version != BT_HISTORY_VERSION
+      || self->hdr->record_size != sizeof(bt_history_rec_t)
+      || !self->hdr->buckets || (self->hdr->buckets & (self->hdr->buckets - 1))
+      || self->hdr->records > self->hdr->capacity
+      || bt_history_size(self->hdr->buckets, self->hdr->capacity) > self->size) {
+    fprintf(stderr, "'%s' is not a butcher history database\n", path);
+    err = EINVAL;
+    goto failure;
+  }
+
+  bt_history_bind(self);
+
+  *history = self;
+
+  return 0;
+
+failure:
+  bt_history_close(&self);
+  return_error(err);
+}
+
+/**
+ * closes a history database
+ *
+ * @param[in] history a pointer to a pointer holding the history
+ *
+ * @return the operation error code
+ */
+
+int bt_history_close(bt_history_t ** history)
+{
+  bt_history_t * self;
+
+  if (!history || !*history)
+    return_error(EINVAL);
+
+  self = *history;
+
+  if (self->map != MAP_FAILED) {
+    if (self->writable)
+      msync(self->map, self->size, MS_ASYNC);
+    munmap(self->map, self->size);
+  }
+  if (self->fd != -1)
+    close(self->fd);
+
+  free(self);
+
+  *history = NULL;
+
+  return 0;
+}
+
+/**
+ * starts a new run, records appended afterwards belong to it
+ *
+ * @param[in] self the history
+ *
+ * @return the number of the run
+ */
+
+uint32_t bt_history_run(bt_history_t * self)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_REALTIME, &ts);
+  self->started = (uint64_t) ts.tv_sec * 1000000000ull + ts.tv_nsec;
+
+  return ++self->hdr->runs;
+}
+
+/**
+ * appends a record, the key, run, time and link to the previous record are
+ * filled in
+ *
+ * @param[in] self the history
+ * @param[in] key the key of the test (see bt_test_key())
+ * @param[in] rec the record to append
+ *
+ * @return the operation error code
+ */
+
+int bt_history_append(bt_history_t * self, uint64_t key, const bt_history_rec_t * rec)
+{
+  struct bt_history_bucket * bucket;
+  bt_history_rec_t * dst;
+  int err;
+
+  if (!self || !self->writable || !rec)
+    return_error(EINVAL);
+
+  if ((self->hdr->used + 1) * 2 > self->hdr->buckets) {
+    err = bt_history_grow_index(self);
+    if (err)
+      return_error(err);
+  }
+
+  if (self->hdr->records == self->hdr->capacity) {
+    err = bt_history_remap(self, bt_history_size(self->hdr->buckets, self->hdr->capacity * 2));
+    if (err)
+      return_error(err);
+    self->hdr->capacity *= 2;
+  }
+
+  bucket = bt_history_bucket(self, key);
+  if (!bucket->last) {
+    bucket->key = key;
+    self->hdr->used++;
+  }
+
+  dst = &self->records[self->hdr->records];
+  *dst = *rec;
+  dst->key = key;
+  dst->prev = bucket->last;
+  dst->run = self->hdr->runs;
+  dst->time = self->started;
+
+  bucket->last = ++self->hdr->records;
+  bucket->count++;
+
+  return 0;
+}
+
+/**
+ * collects the most recent records of a test
+ *
+ * @param[in] self the history
+ * @param[in] key the key of the test
+ * @param[out] recs an array to hold pointers to the records, newest first
+ * @param[in] max the size of recs
+ *
+ * @return the number of records found
+ */
+
+unsigned bt_history_lookup(bt_history_t * self, uint64_t key, const bt_history_rec_t ** recs, unsigned max)
+{
+  struct bt_history_bucket * bucket;
+  unsigned n = 0;
+
+  bucket = bt_history_bucket(self, key);
+  if (!bucket->last)
+    return 0;
+
+  for (uint32_t i = bucket->last; i && i <= self->hdr->records && n < max; i = self->records[i - 1].prev)
+    recs[n++] = &self->records[i - 1];
+
+  return n;
+}
+
+static
+int bt_u64_compare(const void * a, const void * b)
+{
+  uint64_t x = *(const uint64_t *) a, y = *(const uint64_t *) b;
+
+  return x < y ? -1 : x > y;
+}
+
+/* nearest rank percentile of a sorted array */
+static
+uint64_t bt_percentile(const uint64_t * v, unsigned n, unsigned p)
+{
+  unsigned rank = (p * n + 99) / 100;
+
+  return n ? v[rank ? rank - 1 : 0] : 0;
+}
+
+/**
+ * prints statistics about the recent runs of a test
+ *
+ * @param[in] path the history database
+ * @param[in] name the test as "<elf>/<suite>/<test>" (the basename of elf)
+ * @param[in] window the number of most recent runs to look at
+ * @param[in] fd the stream to print to
+ *
+ * @return the operation error code
+ */
+
+int bt_history_stats(const char * path, const char * name, unsigned window, FILE * fd)
+{
+  bt_history_t * self = NULL;
+  const bt_history_rec_t ** recs = NULL;
+  uint64_t * wall = NULL, * cpu = NULL, maxrss = 0;
+  unsigned results[BT_TEST_MAX] = {0};
+  unsigned n, flips = 0;
+  uint64_t key;
+  int err;
+
+  if (!path || !name || !window || !fd)
+    return_error(EINVAL);
+
+  err = bt_test_key_parse(name, &key);
+  if (err) {
+    fprintf(fd, "'%s' does not name a test as <elf>/<suite>/<test>\n", name);
+    return_error(err);
+  }
+
+  err = bt_history_open(&self, path, 0);
+  if (err)
+    return_error(err);
+
+  recs = malloc(window * sizeof(*recs));
+  wall = malloc(window * sizeof(*wall));
+  cpu = malloc(window * sizeof(*cpu));
+  if (!recs || !wall || !cpu) {
+    err = ENOMEM;
+    goto failure;
+  }
+
+  n = bt_history_lookup(self, key, recs, window);
+  if (!n) {
+    fprintf(fd, "no history for '%s'\n", name);
+    goto finish;
+  }
+
+  for (unsigned i = 0; i < n; i++) {
+    wall[i] = recs[i]->wall;
+    cpu[i] = recs[i]->utime + recs[i]->stime;
+    if (recs[i]->maxrss > maxrss)
+      maxrss = recs[i]->maxrss;
+    if (recs[i]->result > BT_TEST_NONE && recs[i]->result < BT_TEST_MAX)
+      results[(int) recs[i]->result]++;
+    if (i && (recs[i]->result == BT_TEST_SUCCEEDED) != (recs[i - 1]->result == BT_TEST_SUCCEEDED))
+      flips++;
+  }
+
+  qsort(wall, n, sizeof(*wall), bt_u64_compare);
+  qsort(cpu, n, sizeof(*cpu), bt_u64_compare);
+
+  fprintf(fd, "history of '%s', last %u of %u runs:\n", name, n, self->hdr->runs);
+  fprintf(fd, "  succeeded:%u failed:%u ignored:%u corrupted:%u regressed:%u flips:%u\n",
+      results[BT_TEST_SUCCEEDED], results[BT_TEST_FAILED],
+      results[BT_TEST_IGNORED], results[BT_TEST_CORRUPTED], results[BT_TEST_REGRESSED], flips);
+  fprintf(fd, "  wall(us) p50:%llu p95:%llu max:%llu\n",
+      (unsigned long long) bt_percentile(wall, n, 50) / 1000,
+      (unsigned long long) bt_percentile(wall, n, 95) / 1000,
+      (unsigned long long) wall[n - 1] / 1000);
+  fprintf(fd, "  U+S(us) p50:%llu p95:%llu max:%llu\n",
+      (unsigned long long) bt_percentile(cpu, n, 50),
+      (unsigned long long) bt_percentile(cpu, n, 95),
+      (unsigned long long) cpu[n - 1]);
+  fprintf(fd, "  MRSS(kB) max:%llu\n", (unsigned long long) maxrss);
+  fprintf(fd, "  last build-id: ");
+  for (unsigned i = 0; i < recs[0]->build_id_length; i++)
+    fprintf(fd, "%02x", recs[0]->build_id[i]);
+  fprintf(fd, "%s\n", recs[0]->build_id_length ? "" : "(none)");
+
+finish:
+  free(recs);
+  free(wall);
+  free(cpu);
+  bt_history_close(&self);
+
+  return 0;
+
+failure:
+  free(recs);
+  free(wall);
+  free(cpu);
+  bt_history_close(&self);
+  return_error(err);
+}
+
+/**
+ * records the outcome of every test in a history database
+ *
+ * @param[in] self the butcher
+ * @param[in] path the file holding the database, created if needed
+ *
+ * @return the operation error code
+ */
+
+int bt_history(bt_t * self, const char * path)
+{
+  char * spec;
+  int err;
+
+  if (!self || !path)
+    return_error(EINVAL);
+
+  if (asprintf(&spec, "history:%s", path) == -1)
+    return_error(ENOMEM);
+
+  err = bt_reporter(self, spec);
+  free(spec);
+
+  return err;
+}
+
+/*************************************************/
+/* the reporter appending to the database */
+
+struct bt_history_reporter {
+  bt_history_t  * history;
+  char          * elf;
+  unsigned char   build_id[BT_BUILD_ID_MAX];
+  size_t          build_id_length;
+};
+
+static
+int bt_history_reporter_open(bt_reporter_t * self, const char * path)
+{
+  struct bt_history_reporter * data;
+  int err;
+
+  data = calloc(1, sizeof(struct bt_history_reporter));
+  if (!data)
+    return_error(ENOMEM);
+
+  err = bt_history_open(&data->history, path, 1);
+  if (err) {
+    free(data);
+    return_error(err);
+  }
+
+  self->data = data;
+
+  return 0;
+}
+
+static
+int bt_history_reporter_run_start(bt_reporter_t * self)
+{
+  struct bt_history_reporter * data = self->data;
+
+  bt_history_run(data->history);
+
+  return 0;
+}
+
+static
+int bt_history_reporter_test_end(bt_reporter_t * self, const bt_event_t * event)
+{
+  struct bt_history_reporter * data = self->data;
+  bt_history_rec_t rec;
+  bt_image_t * image;
+
+  if (event->result <= BT_TEST_NONE)
+    return 0;
+
+  /* tests come elf by elf, so one build-id lookup per elf is enough */
+  if (!data->elf || strcmp(data->elf, event->elf) != 0) {
+    free(data->elf);
+    data->elf = strdup(event->elf);
+    if (!data->elf)
+      return_error(ENOMEM);
+
+    data->build_id_length = 0;
+    if (bt_image_open(&image, event->elf) == 0) {
+      data->build_id_length = sizeof(data->build_id);
+      if (bt_image_build_id(image, data->build_id, &data->build_id_length))
+        data->build_id_length = 0;
+      bt_image_close(&image);
+    }
+  }
+
+  memset(&rec, 0, sizeof(rec));
+  rec.result = event->result;
+  memcpy(rec.results, event->results, BT_PASS_MAX);
+  rec.wall = event->wall;
+  rec.utime = (uint64_t) event->ru->ru_utime.tv_sec * 1000000 + event->ru->ru_utime.tv_usec;
+  rec.stime = (uint64_t) event->ru->ru_stime.tv_sec * 1000000 + event->ru->ru_stime.tv_usec;
+  rec.maxrss = event->ru->ru_maxrss;
+  rec.minflt = event->ru->ru_minflt;
+  rec.majflt = event->ru->ru_majflt;
+  rec.nvcsw = event->ru->ru_nvcsw;
+  rec.nivcsw = event->ru->ru_nivcsw;
+  rec.inblock = event->ru->ru_inblock;
+  rec.oublock = event->ru->ru_oublock;
+  rec.build_id_length = data->build_id_length;
+  memcpy(rec.build_id, data->build_id, data->build_id_length);
+
+  return bt_history_append(data->history, bt_test_key(event->elf, event->suite, event->test), &rec);
+}
+
+static
+void bt_history_reporter_release(bt_reporter_t * self)
+{
+  struct bt_history_reporter * data = self->data;
+
+  if (data) {
+    if (data->history)
+      bt_history_close(&data->history);
+    free(data->elf);
+    free(data);
+  }
+}
+
+const bt_reporter_ops_t bt_history_ops = {
+  .name = "history",
+  .open = bt_history_reporter_open,
+  .run_start = bt_history_reporter_run_start,
+  .test_end = bt_history_reporter_test_end,
+  .release = bt_history_reporter_release,
+};
@@ -0,0 +1,562 @@
+/* @@SOURCE-HEADER@@ */
+
+#include "bt-private.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <elf.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/*
+ * read-only access to a shared object on disk, without loading it
+ *
+ * only native ELF64 objects are understood, which is what the butcher
+ * runs on anyway
+ */
+
+struct bt_image {
+  const unsigned char * map;
+  size_t                size;
+  const Elf64_Ehdr    * ehdr;
+  const Elf64_Shdr    * shdrs;
+  const char          * shstrtab;
+  const Elf64_Phdr    * phdrs;
+  unsigned              phnum;
+  struct stat           st;
+
+  /* the relative relocations, if they are all in one run sorted by offset
+   * as linkers put them; relindex is 0 until this has been looked at and
+   * -1 if they are not */
+  const Elf64_Rela    * relative;
+  size_t                nrelative;
+  int                   relindex;
+};
+
+/**
+ * maps a shared object and validates its headers
+ *
+ * @param[out] image a pointer to a pointer to hold the image
+ * @param[in] path the file to map
+ *
+ * @return the operation error code
+ */
+
+int bt_image_open(bt_image_t ** image, const char * path)
+{
+  bt_image_t * self;
+  struct stat st;
+  void * map;
+  int fd, err;
+
+  if (!image || !path)
+    return_error(EINVAL);
+
+  fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (fd == -1)
+    return_error(errno);
+
+  if (fstat(fd, &st) == -1) {
+    err = errno;
+    close(fd);
+    return_error(err);
+  }
+
+  if ((size_t) st.st_size < sizeof(Elf64_Ehdr)) {
+    close(fd);
+    return_error(ENOEXEC);
+  }
+
+  map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  err = errno;
+  close(fd);
+  if (map == MAP_FAILED)
+    return_error(err);
+
+  self = malloc(sizeof(bt_image_t));
+  if (!self) {
+    munmap(map, st.st_size);
+    return_error(ENOMEM);
+  }
+
+  memset(self, 0, sizeof(bt_image_t));
+
+  self->map = map;
+  self->size = st.st_size;
+  self->st = st;
+  self->ehdr = map;
+
+  if (memcmp(self->ehdr->e_ident, ELFMAG, SELFMAG) != 0
+      || self->ehdr->e_ident[EI_CLASS] != ELFCLASS64
+      || self->ehdr->e_shentsize != sizeof(Elf64_Shdr)
+      || self->ehdr->e_shoff > self->size
+      || self->ehdr->e_shnum > (self->size - self->ehdr->e_shoff) / sizeof(Elf64_Shdr)
+      || self->ehdr->e_shstrndx >= self->ehdr->e_shnum) {
+    err = ENOEXEC;
+    goto failure;
+  }
+
+  self->shdrs = (const Elf64_Shdr *) (self->map + self->ehdr->e_shoff);
+
+  if (self->shdrs[self->ehdr->e_shstrndx].sh_offset >= self->size) {
+    err = ENOEXEC;
+    goto failure;
+  }
+  self->shstrtab = (const char *) self->map + self->shdrs[self->ehdr->e_shstrndx].sh_offset;
+
+  /* an object without program headers has nothing to load, which is fine
+   * for looking up the build-id */
+  if (self->ehdr->e_phnum && self->ehdr->e_phentsize == sizeof(Elf64_Phdr)
+      && self->ehdr->e_phoff <= self->size
+      && self->ehdr->e_phnum <= (self->size - self->ehdr->e_phoff) / sizeof(Elf64_Phdr)) {
+    self->phdrs = (const Elf64_Phdr *) (self->map + self->ehdr->e_phoff);
+    self->phnum = self->ehdr->e_phnum;
+  }
+
+  *image = self;
+
+  return 0;
+
+failure:
+  bt_image_close(&self);
+  return_error(err);
+}
+
+/**
+ * tells whether a file is a shared object with tests, without mapping it;
+ * only the ELF header and the section headers are read
+ *
+ * @param[in] path the file
+ *
+ * @return the operation error code (ENOENT if the object has no tests,
+ *  ENOEXEC if it is no shared object, neither is reported)
+ */
+
+int bt_image_probe(const char * path)
+{
+  Elf64_Ehdr ehdr;
+  Elf64_Shdr * shdrs = NULL;
+  char * shstrtab = NULL;
+  struct stat st;
+  size_t size;
+  int fd, err = ENOENT;
+
+  if (!path)
+    return_error(EINVAL);
+
+  /* files come and go in a build tree, which is not worth a complaint */
+  fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (fd == -1)
+    return errno;
+
+  if (fstat(fd, &st) == -1) {
+    err = errno;
+    goto failure;
+  }
+
+  if (pread(fd, &ehdr, sizeof(ehdr), 0) != sizeof(ehdr)
+      || memcmp(ehdr.e_ident, ELFMAG, SELFMAG) != 0
+      || ehdr.e_ident[EI_CLASS] != ELFCLASS64
+      || ehdr.e_type != ET_DYN
+      || ehdr.e_shentsize != sizeof(Elf64_Shdr)
+      || ehdr.e_shoff > (uint64_t) st.st_size
+      || ehdr.e_shnum > ((uint64_t) st.st_size - ehdr.e_shoff) / sizeof(Elf64_Shdr)
+      || ehdr.e_shstrndx >= ehdr.e_shnum) {
+    err = ENOEXEC;
+    goto failure;
+  }
+
+  shdrs = malloc(sizeof(Elf64_Shdr) * ehdr.e_shnum);
+  if (!shdrs) {
+    err = ENOMEM;
+    goto failure;
+  }
+
+  size = sizeof(Elf64_Shdr) * ehdr.e_shnum;
+  if (pread(fd, shdrs, size, ehdr.e_shoff) != (ssize_t) size
+      || shdrs[ehdr.e_shstrndx].sh_offset > (uint64_t) st.st_size
+      || shdrs[ehdr.e_shstrndx].sh_size > (uint64_t) st.st_size - shdrs[ehdr.e_shstrndx].sh_offset) {
+    err = ENOEXEC;
+    goto failure;
+  }
+
+  size = shdrs[ehdr.e_shstrndx].sh_size;
+  shstrtab = malloc(size + 1);
+  if (!shstrtab) {
+    err = ENOMEM;
+    goto failure;
+  }
+
+  if (pread(fd, shstrtab, size, shdrs[ehdr.e_shstrndx].sh_offset) != (ssize_t) size) {
+    err = ENOEXEC;
+    goto failure;
+  }
+  shstrtab[size] = '\0';
+
+  for (unsigned n = 0; n < ehdr.e_shnum; n++) {
+    if (shdrs[n].sh_name >= size || !shdrs[n].sh_size)
+      continue;
+    if (strcmp(shstrtab + shdrs[n].sh_name, "bexec") == 0
+        || strcmp(shstrtab + shdrs[n].sh_name, "bexec_compact") == 0) {
+      err = 0;
+      break;
+    }
+  }
+
+failure:
+  free(shstrtab);
+  free(shdrs);
+  close(fd);
+  if (err == ENOMEM)
+    return_error(err);
+  return err;
+}
+
+/**
+ * unmaps a shared object
+ *
+ * @param[in] image a pointer to a pointer holding the image
+ *
+ * @return the operation error code
+ */
+
+int bt_image_close(bt_image_t ** image)
+{
+  bt_image_t * self;
+
+  if (!image || !*image)
+    return_error(EINVAL);
+
+  self = *image;
+
+  munmap((void *) self->map, self->size);
+  free(self);
+
+  *image = NULL;
+
+  return 0;
+}
+
+/**
+ * returns the contents of the file
+ *
+ * @param[in] self the image
+ * @param[out] size a pointer to hold the size of the file
+ *
+ * @return the mapping of the file
+ */
+
+const void * bt_image_data(bt_image_t * self, size_t * size)
+{
+  *size = self->size;
+  return self->map;
+}
+
+/**
+ * returns what fstat() said about the file when it was mapped
+ *
+ * @param[in] self the image
+ *
+ * @return the status of the file
+ */
+
+const struct stat * bt_image_stat(bt_image_t * self)
+{
+  return &self->st;
+}
+
+/**
+ * looks up the GNU build-id of a shared object
+ *
+ * @param[in] self the image
+ * @param[out] id a buffer to hold the id
+ * @param[in,out] length the size of id, on return the length of the id
+ *
+ * @return the operation error code (ENOENT if there is no build-id)
+ */
+
+int bt_image_build_id(bt_image_t * self, unsigned char * id, size_t * length)
+{
+  const Elf64_Shdr * shdr;
+  const unsigned char * p, * pe;
+  const Elf64_Nhdr * note;
+
+  if (!self || !id || !length)
+    return_error(EINVAL);
+
+  for (unsigned n = 0; n < self->ehdr->e_shnum; n++) {
+    shdr = &self->shdrs[n];
+    if (shdr->sh_type != SHT_NOTE || shdr->sh_offset > self->size
+        || shdr->sh_size > self->size - shdr->sh_offset)
+      continue;
+
+    p = self->map + shdr->sh_offset;
+    pe = p + shdr->sh_size;
+    while (p + sizeof(Elf64_Nhdr) <= pe) {
+      note = (const Elf64_Nhdr *) p;
+      p += sizeof(Elf64_Nhdr);
+      if (note->n_namesz > (size_t) (pe - p))
+        break;
+      const char * name = (const char *) p;
+      p += (note->n_namesz + 3) & ~3u;
+      if (note->n_descsz > (size_t) (pe - p))
+        break;
+      if (note->n_type == NT_GNU_BUILD_ID && note->n_namesz == 4 && memcmp(name, "GNU", 4) == 0) {
+        *length = note->n_descsz < *length ? note->n_descsz : *length;
+        memcpy(id, p, *length);
+        return 0;
+      }
+      p += (note->n_descsz + 3) & ~3u;
+    }
+  }
+
+  return ENOENT;
+}
+
+/**
+ * looks up a section by name
+ *
+ * @param[in] self the image
+ * @param[in] name the name of the section
+ * @param[out] addr a pointer to hold the address the section is loaded at
+ * @param[out] size a pointer to hold the size of the section
+ *
+ * @return the operation error code (ENOENT if there is no such section)
+ */
+
+int bt_image_section(bt_image_t * self, const char * name, uint64_t * addr, size_t * size)
+{
+  const Elf64_Shdr * shdr;
+  size_t shstrsize;
+
+  if (!self || !name || !addr || !size)
+    return_error(EINVAL);
+
+  shdr = &self->shdrs[self->ehdr->e_shstrndx];
+  shstrsize = self->size - shdr->sh_offset < shdr->sh_size ? self->size - shdr->sh_offset : shdr->sh_size;
+
+  for (unsigned n = 0; n < self->ehdr->e_shnum; n++) {
+    shdr = &self->shdrs[n];
+    if (shdr->sh_name >= shstrsize
+        || strncmp(self->shstrtab + shdr->sh_name, name, shstrsize - shdr->sh_name) != 0)
+      continue;
+    *addr = shdr->sh_addr;
+    *size = shdr->sh_size;
+    return 0;
+  }
+
+  return ENOENT;
+}
+
+/**
+ * maps an address of the loaded object to the file
+ *
+ * @param[in] self the image
+ * @param[in] addr the address
+ * @param[in] size the number of bytes needed at addr
+ *
+ * @return a pointer into the image or NULL if the bytes are not in the file
+ */
+
+static
+const unsigned char * bt_image_at(bt_image_t * self, uint64_t addr, size_t size)
+{
+  const Elf64_Phdr * phdr;
+
+  for (unsigned n = 0; n < self->phnum; n++) {
+    phdr = &self->phdrs[n];
+    if (phdr->p_type != PT_LOAD || addr < phdr->p_vaddr
+        || addr - phdr->p_vaddr > phdr->p_filesz
+        || size > phdr->p_filesz - (addr - phdr->p_vaddr))
+      continue;
+    if (phdr->p_offset > self->size || addr - phdr->p_vaddr + size > self->size - phdr->p_offset)
+      return NULL;
+    return self->map + phdr->p_offset + (addr - phdr->p_vaddr);
+  }
+
+  return NULL;
+}
+
+/**
+ * looks up a string the loaded object would see at an address
+ *
+ * @param[in] self the image
+ * @param[in] addr the address
+ *
+ * @return a pointer into the image or NULL if there is no terminated string
+ */
+
+const char * bt_image_string(bt_image_t * self, uint64_t addr)
+{
+  const Elf64_Phdr * phdr;
+  const char * str;
+  size_t length;
+
+  if (!self)
+    return NULL;
+
+  for (unsigned n = 0; n < self->phnum; n++) {
+    phdr = &self->phdrs[n];
+    if (phdr->p_type != PT_LOAD || addr < phdr->p_vaddr || addr - phdr->p_vaddr >= phdr->p_filesz)
+      continue;
+
+    length = phdr->p_filesz - (addr - phdr->p_vaddr);
+    str = (const char *) bt_image_at(self, addr, length);
+    if (!str || !memchr(str, '\0', length))
+      return NULL;
+    return str;
+  }
+
+  return NULL;
+}
+
+/**
+ * returns the type of the relocation that adds the load address, which is
+ * all position independent data that points into the object itself needs
+ */
+
+static
+unsigned bt_image_relative_type(const bt_image_t * self)
+{
+  switch (self->ehdr->e_machine) {
+    case EM_X86_64:
+      return R_X86_64_RELATIVE;
+    case EM_AARCH64:
+      return R_AARCH64_RELATIVE;
+    case EM_PPC64:
+      return R_PPC64_RELATIVE;
+    case EM_RISCV:
+      return R_RISCV_RELATIVE;
+    case EM_S390:
+      return R_390_RELATIVE;
+    default:
+      return 0;
+  }
+}
+
+/**
+ * looks for the run of sorted relative relocations, so bt_image_read() can
+ * find the ones of a small range without going through all of them
+ *
+ * @param[in] self the image
+ */
+
+static
+void bt_image_index(bt_image_t * self)
+{
+  const Elf64_Shdr * shdr;
+  const Elf64_Rela * rela;
+  unsigned relative;
+  size_t count, run;
+
+  relative = bt_image_relative_type(self);
+
+  self->relative = NULL;
+  self->nrelative = 0;
+  self->relindex = 1;
+
+  for (unsigned n = 0; n < self->ehdr->e_shnum; n++) {
+    shdr = &self->shdrs[n];
+    if (shdr->sh_type != SHT_RELA || shdr->sh_entsize != sizeof(Elf64_Rela)
+        || shdr->sh_offset > self->size || shdr->sh_size > self->size - shdr->sh_offset)
+      continue;
+
+    rela = (const Elf64_Rela *) (self->map + shdr->sh_offset);
+    count = shdr->sh_size / sizeof(Elf64_Rela);
+
+    for (run = 0; run < count && ELF64_R_TYPE(rela[run].r_info) == relative; run++) {
+      if (run && rela[run].r_offset < rela[run - 1].r_offset)
+        break;
+    }
+    if (run && self->relative)
+      self->relindex = -1;
+    for (size_t r = run; r < count; r++) {
+      if (ELF64_R_TYPE(rela[r].r_info) == relative)
+        self->relindex = -1;
+    }
+    if (run && !self->relative) {
+      self->relative = rela;
+      self->nrelative = run;
+    }
+  }
+}
+
+/**
+ * copies data of the loaded object out of the image, as if the object was
+ * loaded at address 0, i.e. pointers into the object are addresses
+ *
+ * @param[in] self the image
+ * @param[in] addr the address of the data
+ * @param[out] buffer a buffer to hold the data
+ * @param[in] size the size of the data
+ *
+ * @return the operation error code
+ *
+ * only relative relocations are applied, a RELA relocation keeps its
+ * addend out of place, while REL and RELR ones leave the link time address
+ * in place, which is the right one for address 0 already
+ */
+
+int bt_image_read(bt_image_t * self, uint64_t addr, void * buffer, size_t size)
+{
+  const unsigned char * data;
+  const Elf64_Shdr * shdr;
+  const Elf64_Rela * rela;
+  unsigned relative;
+  size_t count;
+
+  if (!self || (size && !buffer))
+    return_error(EINVAL);
+
+  data = bt_image_at(self, addr, size);
+  if (!data)
+    return_error(ENOEXEC);
+
+  memcpy(buffer, data, size);
+
+  if (!self->relindex)
+    bt_image_index(self);
+
+  if (self->relindex > 0) {
+    size_t lo = 0, hi = self->nrelative;
+
+    rela = self->relative;
+    while (lo < hi) {
+      size_t mid = lo + (hi - lo) / 2;
+      if (rela[mid].r_offset < addr)
+        lo = mid + 1;
+      else
+        hi = mid;
+    }
+    for (; size >= sizeof(uint64_t) && lo < self->nrelative
+        && rela[lo].r_offset - addr <= size - sizeof(uint64_t); lo++)
+      memcpy((unsigned char *) buffer + (rela[lo].r_offset - addr), &rela[lo].r_addend, sizeof(uint64_t));
+
+    return 0;
+  }
+
+  relative = bt_image_relative_type(self);
+
+  for (unsigned n = 0; n < self->ehdr->e_shnum; n++) {
+    shdr = &self->shdrs[n];
+    if (shdr->sh_type != SHT_RELA || shdr->sh_entsize != sizeof(Elf64_Rela)
+        || shdr->sh_offset > self->size || shdr->sh_size > self->size - shdr->sh_offset)
+      continue;
+
+    rela = (const Elf64_Rela *) (self->map + shdr->sh_offset);
+    count = shdr->sh_size / sizeof(Elf64_Rela);
+    for (size_t r = 0; r < count; r++) {
+      if (size < sizeof(uint64_t) || rela[r].r_offset < addr
+          || rela[r].r_offset - addr > size - sizeof(uint64_t)
+          || ELF64_R_TYPE(rela[r].r_info) != relative)
+        continue;
+      memcpy((unsigned char *) buffer + (rela[r].r_offset - addr), &rela[r].r_addend, sizeof(uint64_t));
+    }
+  }
+
+  return 0;
+}
@@ -0,0 +1,498 @@
+/* @@SOURCE-HEADER@@ */
+
+#include "bt-private.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <poll.h>
+
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+
+/*
+ * the OpenMetrics exporter
+ *
+ * keeps the outcome of every test of the run and writes the exposition to
+ * a file when the run is over; with a port it is also served over HTTP on
+ * the loopback interface while the run is in progress
+ */
+
+struct bt_metrics_test {
+  char     * elf;
+  char     * suite;
+  char     * test;
+  int        result;
+  uint64_t   cpu;    /* us */
+  uint64_t   maxrss; /* kB */
+  uint64_t   wall;   /* ns */
+};
+
+struct bt_metrics {
+  char                   * path;
+  unsigned                 port;
+
+  pthread_mutex_t          lock;
+  int                      running;
+  unsigned                 results[BT_TEST_MAX];
+  struct bt_metrics_test * tests;
+  unsigned                 count;
+  unsigned                 size;
+
+  int                      listenfd;
+  int                      wakeup[2];
+  pthread_t                thread;
+};
+
+static
+const char * const bt_metrics_results[BT_TEST_MAX] = {
+  [BT_TEST_SUCCEEDED] = "succeeded",
+  [BT_TEST_FAILED] = "failed",
+  [BT_TEST_IGNORED] = "ignored",
+  [BT_TEST_CORRUPTED] = "corrupted",
+  [BT_TEST_REGRESSED] = "regressed",
+};
+
+/* label values escape backslash, double quote and line feed */
+static
+void bt_metrics_label(FILE * fd, const char * name, const char * value)
+{
+  fprintf(fd, "%s=\"", name);
+  for (const char * p = value; *p; p++) {
+    switch (*p) {
+      case '\\':
+        fputs("\\\\", fd); break;
+      case '"':
+        fputs("\\\"", fd); break;
+      case '\n':
+        fputs("\\n", fd); break;
+      default:
+        fputc(*p, fd); break;
+    }
+  }
+  fputc('"', fd);
+}
+
+static
+void bt_metrics_family(FILE * fd, const char * name, const char * unit, const char * help)
+{
+  fprintf(fd, "# TYPE %s gauge\n", name);
+  if (unit)
+    fprintf(fd, "# UNIT %s %s\n", name, unit);
+  fprintf(fd, "# HELP %s %s\n", name, help);
+}
+
+static
+void bt_metrics_test_labels(FILE * fd, const struct bt_metrics_test * test)
+{
+  fputc('{', fd);
+  bt_metrics_label(fd, "elf", test->elf);
+  fputc(',', fd);
+  bt_metrics_label(fd, "suite", test->suite);
+  fputc(',', fd);
+  bt_metrics_label(fd, "test", test->test);
+  fputc('}', fd);
+}
+
+/**
+ * writes the exposition of the current state, the lock has to be held
+ *
+ * @param[in] self the exporter
+ * @param[in] fd the stream to write to
+ */
+
+static
+void bt_metrics_render(struct bt_metrics * self, FILE * fd)
+{
+  const struct bt_metrics_test * cur, * end = self->tests + self->count;
+
+  bt_metrics_family(fd, "butcher_running", NULL, "Whether the run is in progress.");
+  fprintf(fd, "butcher_running %d\n", self->running);
+
+  bt_metrics_family(fd, "butcher_tests", NULL, "Tests run so far by result.");
+  for (int r = BT_TEST_SUCCEEDED; r < BT_TEST_MAX; r++)
+    fprintf(fd, "butcher_tests{result=\"%s\"} %u\n", bt_metrics_results[r], self->results[r]);
+
+  /* tests are run suite by suite, so the tests of a suite are adjacent */
+  bt_metrics_family(fd, "butcher_suite_tests", NULL, "Tests run so far by suite and result.");
+  for (cur = self->tests; cur < end;) {
+    const struct bt_metrics_test * first = cur;
+    unsigned results[BT_TEST_MAX] = {0};
+
+    for (; cur < end && strcmp(cur->suite, first->suite) == 0 && strcmp(cur->elf, first->elf) == 0; cur++)
+      results[cur->result]++;
+
+    for (int r = BT_TEST_SUCCEEDED; r < BT_TEST_MAX; r++) {
+      fputs("butcher_suite_tests{", fd);
+      bt_metrics_label(fd, "elf", first->elf);
+      fputc(',', fd);
+      bt_metrics_label(fd, "suite", first->suite);
+      fprintf(fd, ",result=\"%s\"} %u\n", bt_metrics_results[r], results[r]);
+    }
+  }
+
+  bt_metrics_family(fd, "butcher_test_cpu_seconds", "seconds", "User and system time of a test.");
+  for (cur = self->tests; cur < end; cur++) {
+    fputs("butcher_test_cpu_seconds", fd);
+    bt_metrics_test_labels(fd, cur);
+    fprintf(fd, " %llu.%06llu\n", (unsigned long long) cur->cpu / 1000000, (unsigned long long) cur->cpu % 1000000);
+  }
+
+  bt_metrics_family(fd, "butcher_test_wall_seconds", "seconds", "Wall clock time of a test.");
+  for (cur = self->tests; cur < end; cur++) {
+    fputs("butcher_test_wall_seconds", fd);
+    bt_metrics_test_labels(fd, cur);
+    fprintf(fd, " %llu.%09llu\n", (unsigned long long) cur->wall / 1000000000, (unsigned long long) cur->wall % 1000000000);
+  }
+
+  bt_metrics_family(fd, "butcher_test_maxrss_bytes", "bytes", "Maximum resident set size of a test.");
+  for (cur = self->tests; cur < end; cur++) {
+    fputs("butcher_test_maxrss_bytes", fd);
+    bt_metrics_test_labels(fd, cur);
+    fprintf(fd, " %llu\n", (unsigned long long) cur->maxrss * 1024);
+  }
+
+  fputs("# EOF\n", fd);
+}
+
+/*************************************************/
+/* the HTTP endpoint */
+
+static
+void bt_metrics_respond(struct bt_metrics * self, int fd)
+{
+  struct timeval timeout = {1, 0};
+  char request[1024], * body = NULL, header[256];
+  size_t length = 0;
+  ssize_t n;
+  FILE * stream;
+  int found;
+
+  /* a client that sends no request or reads no answer must not hold up
+   * the thread, which is joined at the end; what a send could not get out
+   * in time is dropped */
+  setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+  setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+  n = recv(fd, request, sizeof(request) - 1, 0);
+  if (n <= 0)
+    return;
+  request[n] = '\0';
+
+  found = strncmp(request, "GET /metrics ", 13) == 0 || strncmp(request, "GET / ", 6) == 0;
+
+  if (found) {
+    stream = open_memstream(&body, &length);
+    if (!stream)
+      return;
+    pthread_mutex_lock(&self->lock);
+    bt_metrics_render(self, stream);
+    pthread_mutex_unlock(&self->lock);
+    fclose(stream);
+  }
+
+  n = snprintf(header, sizeof(header),
+      "HTTP/1.0 %s\r\n"
+      "Content-Type: %s\r\n"
+      "Content-Length: %zu\r\n"
+      "Connection: close\r\n"
+      "\r\n",
+      found ? "200 OK" : "404 Not Found",
+      found ? "application/openmetrics-text; version=1.0.0; charset=utf-8" : "text/plain",
+      length);
+
+  if (send(fd, header, n, MSG_NOSIGNAL) == n && length)
+    send(fd, body, length, MSG_NOSIGNAL);
+
+  free(body);
+}
+
+static
+void * bt_metrics_serve(void * arg)
+{
+  struct bt_metrics * self = arg;
+  struct pollfd pfd[2];
+  int fd;
+
+  for (;;) {
+    pfd[0].fd = self->listenfd;
+    pfd[0].events = POLLIN;
+    pfd[1].fd = self->wakeup[0];
+    pfd[1].events = POLLIN;
+
+    if (poll(pfd, 2, -1) == -1) {
+      if (errno == EINTR)
+        continue;
+      break;
+    }
+    if (pfd[1].revents)
+      break;
+
+    fd = accept4(self->listenfd, NULL, NULL, SOCK_CLOEXEC);
+    if (fd == -1)
+      continue;
+
+    bt_metrics_respond(self, fd);
+    close(fd);
+  }
+
+  return NULL;
+}
+
+static
+int bt_metrics_listen(struct bt_metrics * self)
+{
+  struct sockaddr_in addr;
+  int one = 1, err;
+
+  self->listenfd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (self->listenfd == -1)
+    return_error(errno);
+
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(self->port);
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+  setsockopt(self->listenfd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+  if (bind(self->listenfd, (struct sockaddr *) &addr, sizeof(addr)) == -1
+      || listen(self->listenfd, 16) == -1) {
+    err = errno;
+    fprintf(stderr, "could not serve metrics on port %u: %s\n", self->port, strerror(err));
+    goto failure;
+  }
+
+  if (pipe2(self->wakeup, O_CLOEXEC) == -1) {
+    err = errno;
+    goto failure;
+  }
+
+  err = pthread_create(&self->thread, NULL, bt_metrics_serve, self);
+  if (err) {
+    close(self->wakeup[0]);
+    close(self->wakeup[1]);
+    goto failure;
+  }
+
+  return 0;
+
+failure:
+  close(self->listenfd);
+  self->listenfd = -1;
+  return_error(err);
+}
+
+/*************************************************/
+/* the reporter */
+
+static
+int bt_metrics_open(bt_reporter_t * self, const char * path)
+{
+  struct bt_metrics * data;
+
+  data = calloc(1, sizeof(struct bt_metrics));
+  if (!data)
+    return_error(ENOMEM);
+
+  data->path = strdup(path);
+  if (!data->path) {
+    free(data);
+    return_error(ENOMEM);
+  }
+
+  data->listenfd = -1;
+  pthread_mutex_init(&data->lock, NULL);
+
+  self->data = data;
+
+  return 0;
+}
+
+static
+int bt_metrics_run_start(bt_reporter_t * self)
+{
+  struct bt_metrics * data = self->data;
+
+  pthread_mutex_lock(&data->lock);
+  data->running = 1;
+  pthread_mutex_unlock(&data->lock);
+
+  if (data->port && data->listenfd == -1)
+    return bt_metrics_listen(data);
+
+  return 0;
+}
+
+static
+int bt_metrics_test_end(bt_reporter_t * self, const bt_event_t * event)
+{
+  struct bt_metrics * data = self->data;
+  struct bt_metrics_test test;
+  const char * base;
+  int err = 0;
+
+  if (event->result <= BT_TEST_NONE)
+    return 0;
+
+  base = strrchr(event->elf, '/') ? strrchr(event->elf, '/') + 1 : event->elf;
+
+  test.elf = strdup(base);
+  test.suite = strdup(event->suite);
+  test.test = strdup(event->test);
+  test.result = event->result;
+  test.cpu = (uint64_t) (event->ru->ru_utime.tv_sec + event->ru->ru_stime.tv_sec) * 1000000
+    + event->ru->ru_utime.tv_usec + event->ru->ru_stime.tv_usec;
+  test.maxrss = event->ru->ru_maxrss;
+  test.wall = event->wall;
+
+  pthread_mutex_lock(&data->lock);
+
+  if (!test.elf || !test.suite || !test.test) {
+    err = ENOMEM;
+    goto failure;
+  }
+
+  if (data->count == data->size) {
+    unsigned size = data->size ? data->size * 2 : 64;
+    void * tests = realloc(data->tests, size * sizeof(struct bt_metrics_test));
+    if (!tests) {
+      err = ENOMEM;
+      goto failure;
+    }
+    data->tests = tests;
+    data->size = size;
+  }
+
+  data->tests[data->count++] = test;
+  data->results[test.result]++;
+
+  pthread_mutex_unlock(&data->lock);
+
+  return 0;
+
+failure:
+  pthread_mutex_unlock(&data->lock);
+  free(test.elf);
+  free(test.suite);
+  free(test.test);
+  return_error(err);
+}
+
+static
+int bt_metrics_run_end(bt_reporter_t * self)
+{
+  struct bt_metrics * data = self->data;
+  char * tmp;
+  FILE * fd;
+  int err = 0;
+
+  pthread_mutex_lock(&data->lock);
+  data->running = 0;
+
+  if (strcmp(data->path, "-") == 0) {
+    bt_metrics_render(data, stdout);
+    fflush(stdout);
+    goto finish;
+  }
+
+  /* scrapers must never see a half written file */
+  if (asprintf(&tmp, "%s.tmp", data->path) == -1) {
+    err = ENOMEM;
+    goto finish;
+  }
+
+  fd = fopen(tmp, "w");
+  if (!fd) {
+    err = errno;
+  } else {
+    bt_metrics_render(data, fd);
+    if (fclose(fd) != 0)
+      err = EIO;
+    else if (rename(tmp, data->path) == -1)
+      err = errno;
+  }
+  if (err) {
+    fprintf(stderr, "could not write metrics to '%s'\n", data->path);
+    unlink(tmp);
+  }
+  free(tmp);
+
+finish:
+  pthread_mutex_unlock(&data->lock);
+  if (err)
+    return_error(err);
+  return 0;
+}
+
+static
+void bt_metrics_release(bt_reporter_t * self)
+{
+  struct bt_metrics * data = self->data;
+
+  if (!data)
+    return;
+
+  if (data->listenfd != -1) {
+    if (write(data->wakeup[1], "", 1) == 1)
+      pthread_join(data->thread, NULL);
+    close(data->wakeup[0]);
+    close(data->wakeup[1]);
+    close(data->listenfd);
+  }
+
+  for (unsigned n = 0; n < data->count; n++) {
+    free(data->tests[n].elf);
+    free(data->tests[n].suite);
+    free(data->tests[n].test);
+  }
+  free(data->tests);
+  free(data->path);
+  pthread_mutex_destroy(&data->lock);
+  free(data);
+}
+
+const bt_reporter_ops_t bt_metrics_ops = {
+  .name = "openmetrics",
+  .open = bt_metrics_open,
+  .run_start = bt_metrics_run_start,
+  .test_end = bt_metrics_test_end,
+  .run_end = bt_metrics_run_end,
+  .release = bt_metrics_release,
+};
+
+/**
+ * exports the results of the run in the OpenMetrics text format
+ *
+ * @param[in] self the butcher
+ * @param[in] path the file to write when the run is over, "-" for stdout
+ * @param[in] port if not 0, serve the metrics on http://127.0.0.1:<port>/
+ *            while the butcher is running
+ *
+ * @return the operation error code
+ */
+
+int bt_metrics(bt_t * self, const char * path, unsigned port)
+{
+  bt_reporter_t * reporter;
+  char * spec;
+  int err;
+
+  if (!self || !self->initialized || !path || port > 65535)
+    return_error(EINVAL);
+
+  if (asprintf(&spec, "openmetrics:%s", path) == -1)
+    return_error(ENOMEM);
+
+  err = bt_reporter_new(&reporter, spec);
+  free(spec);
+  if (err)
+    return_error(err);
+
+  ((struct bt_metrics *) reporter->data)->port = port;
+
+  return bt_reporter_add(self, reporter);
+}
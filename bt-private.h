@@ -4,9 +4,25 @@
 #define BTPRIVATE_H_
 
 #include "bt.h"
+#include <stdint.h>
+#include <string.h>
 #include <sys/resource.h>
 #include <sys/wait.h>
 #include <regex.h>
+#include <pthread.h>
+
+/* terminal colors of the reports */
+#define RED "\033[1;31m"
+#define GREEN "\033[1;32m"
+#define YELLOW "\033[1;33m"
+#define BLUE "\033[1;34m"
+#define PURPLE "\033[1;35m"
+#define CYAN "\033[1;36m"
+
+#define RED_BG "\033[2;41m"
+#define CYAN_BG "\033[2;46m"
+
+#define ENDCOL "\033[0m"
 
 enum {
   BT_PASS_SETUP = 0, /* enable array access */
@@ -21,14 +37,126 @@ enum {
   BT_TEST_FAILED,
   BT_TEST_IGNORED,
   BT_TEST_CORRUPTED,
+  /* a benchmark that passed but got slower than its baseline; last, so the
+   * results already stored in history databases keep their meaning */
+  BT_TEST_REGRESSED,
   BT_TEST_MAX
 };
 
+typedef struct bt_counters bt_counters_t;
+typedef struct bt_bench bt_bench_t;
+typedef struct bt_fit bt_fit_t;
 typedef struct bt_log_line bt_log_line_t;
 typedef struct bt_log bt_log_t;
+typedef struct bt_arena_chunk bt_arena_chunk_t;
+typedef struct bt_arena bt_arena_t;
+typedef struct bt_table_slot bt_table_slot_t;
+typedef struct bt_table bt_table_t;
+typedef struct bt_glob bt_glob_t;
+typedef struct bt_affixes bt_affixes_t;
+typedef struct bt_matcher bt_matcher_t;
+typedef struct bt_selector bt_selector_t;
 typedef struct bt_test bt_test_t;
 typedef struct bt_suite bt_suite_t;
 typedef struct bt_elf bt_elf_t;
+typedef struct bt_stream bt_stream_t;
+typedef struct bt_stream_fixture bt_stream_fixture_t;
+typedef struct bt_load_job bt_load_job_t;
+typedef struct bt_loader bt_loader_t;
+typedef struct bt_event bt_event_t;
+typedef struct bt_reporter bt_reporter_t;
+typedef struct bt_reporter_ops bt_reporter_ops_t;
+typedef struct bt_image bt_image_t;
+typedef struct bt_history bt_history_t;
+typedef struct bt_history_rec bt_history_rec_t;
+typedef struct bt_baseline bt_baseline_t;
+
+/*
+ * the events bexec counts with perf_event_open(2), the hardware ones come
+ * first; where the PMU is out of reach, as in most containers, only the
+ * software ones are counted
+ */
+enum {
+  BT_PERF_CYCLES = 0,
+  BT_PERF_INSTRUCTIONS,
+  BT_PERF_BRANCHES,
+  BT_PERF_BRANCH_MISSES,
+  BT_PERF_CACHE_REFERENCES,
+  BT_PERF_CACHE_MISSES,
+  BT_PERF_TASK_CLOCK,       /* in ns */
+  BT_PERF_PAGE_FAULTS,
+  BT_PERF_CONTEXT_SWITCHES,
+  BT_PERF_CPU_MIGRATIONS,
+  BT_PERF_MAX,
+};
+
+/*
+ * resource usage of a single pass as measured by bexec
+ */
+struct bt_counters {
+  uint64_t utime;  /* user time in us */
+  uint64_t stime;  /* system time in us */
+  uint64_t maxrss; /* max resident set size in kB (not a delta) */
+  uint64_t minflt;
+  uint64_t majflt;
+  uint64_t nvcsw;
+  uint64_t nivcsw;
+
+  uint32_t perf_mask; /* bit n set if perf[n] was counted */
+  uint32_t reserved;
+  uint64_t perf[BT_PERF_MAX];
+};
+
+/* what the samples of a benchmark count */
+enum {
+  BT_BENCH_NS = 0,
+  BT_BENCH_INSTRUCTIONS,  /* retired in user space, see BT_FLAG_INSTRUCTIONS */
+};
+
+/*
+ * the summary of the samples of a benchmark (see BT_BENCH()) as measured
+ * by bexec, the times are in ns or instructions per operation
+ */
+struct bt_bench {
+  uint64_t operations; /* per sample */
+  uint64_t n;          /* the input size, 0 for BT_BENCH() */
+  uint32_t nsamples;
+  uint32_t unit;       /* BT_BENCH_NS or BT_BENCH_INSTRUCTIONS */
+  double   median;
+  double   mad;        /* median absolute deviation */
+  double   mean;
+  double   stddev;
+  double   min;
+  double   max;
+  double   ci_low;     /* 95% confidence interval of the median */
+  double   ci_high;
+};
+
+#define BT_BENCH_SAMPLES_MAX 256
+
+/* the input sizes of a BT_BENCH_RANGE() grow at least twofold */
+#define BT_BENCH_SIZES_MAX 64
+
+typedef enum {
+  BT_O_1,
+  BT_O_LOGN,
+  BT_O_N,
+  BT_O_NLOGN,
+  BT_O_N2,
+  BT_O_MAX,
+} bt_complexity_t;
+
+extern const char * const bt_complexity_names[BT_O_MAX];
+
+/*
+ * the complexity that fits the medians of a BT_BENCH_RANGE() best, the
+ * time per operation is coefficient * f(n)
+ */
+struct bt_fit {
+  bt_complexity_t complexity;
+  double          coefficient; /* in ns */
+  double          rms;         /* relative to the mean of the medians */
+};
 
 /*
  * variable sized C9x structure holding a read-only message
@@ -48,52 +176,234 @@ struct bt_log {
 };
 
 /*
- * structure holding a test case, which consists of:
- *  - a test function
+ * a bump allocator handing out memory that lives as long as its butcher,
+ * everything is given back at once
+ */
+struct bt_arena_chunk {
+  struct bt_arena_chunk * next;
+  size_t                  size;
+  size_t                  used;
+  char                    data[] __attribute__ ((aligned (16)));
+};
+
+struct bt_arena {
+  bt_arena_chunk_t * chunks; /* the first one is being filled */
+};
+
+/*
+ * an open addressing table mapping names to values, a name is unique
+ * within its scope
+ */
+struct bt_table_slot {
+  const char * name;
+  unsigned     hash;
+  unsigned     scope;
+  unsigned     value; /* value + 1, 0 for a free slot */
+};
+
+struct bt_table {
+  bt_arena_t      * arena; /* where the slots come from */
+  bt_table_slot_t * slots;
+  unsigned          mask;  /* number of slots - 1 */
+  unsigned          count;
+};
+
+/*
+ * a regex that is nothing but literal segments joined by ".*", i.e. a glob
+ * with '*' as the only wildcard, which is matched without regexec()
+ */
+struct bt_glob {
+  struct bt_glob * next;
+  char             anchored_start;
+  char             anchored_end;
+  unsigned         nsegments;
+  char          ** segments;
+};
+
+/*
+ * globs bucketed by the literal they start (or end) with, a name is only
+ * matched against the globs of the prefixes (or suffixes) it has, which
+ * takes a lookup per distinct length of them
+ */
+struct bt_affixes {
+  bt_table_t   table;    /* the affixes, to an index into globs */
+  bt_glob_t ** globs;    /* [count] the globs of an affix, linked by next */
+  unsigned     count;
+  unsigned   * lengths;  /* [nlengths] the distinct lengths of the affixes */
+  unsigned     nlengths;
+};
+
+/*
+ * a set of patterns a name matches if it matches any of them, globs that
+ * are a whole name are looked up in a table, the ones with a literal start
+ * or end are bucketed by it and the other patterns are compiled into a
+ * single regex
+ */
+struct bt_matcher {
+  bt_table_t   exact;
+  bt_affixes_t prefixes;
+  bt_affixes_t suffixes;
+  char       * source;   /* "(re1)|(re2)|..." */
+  char         compiled;
+  regex_t      regex;
+};
+
+/*
+ * what to run: names have to match a positive pattern (if there are any)
+ * and no negative one, and have to be in the exact set (if there is one)
+ */
+struct bt_selector {
+  bt_matcher_t suites[2]; /* positive, negative */
+  bt_matcher_t tests[2];
+
+  /* open addressing set of "suite/test" and "elf/suite/test" names */
+  struct bt_selector_name {
+    uint64_t     key;
+    const char * name;    /* NULL for a free slot */
+  }          * names;
+  unsigned     mask;
+  unsigned     count;
+  unsigned     parts;     /* bit 2 and 3 for names of 2 and 3 parts, bit 0
+                             for a set that is empty on purpose */
+
+  /* --tags, positive and negative */
+  unsigned     sizes[2];  /* bit n for size class n */
+  uint32_t     tags[2];   /* BT_TAG_* */
+};
+
+/*
+ * what a test has left behind when it ran:
  *  - a log
- *  - an array of results
- *  - a name of the test case
+ *  - resource usage
+ *  - timings and counters of every pass
  */
 struct bt_test {
-  struct bt_test * next;
-  unsigned         id;
-  bt_fn_kind_t     kind;
-  char           * name;
-  char             results[BT_PASS_MAX];
   bt_log_t       * log;
+  char           * logfile;
   struct rusage    ru;
+  uint64_t         wall; /* ns from fork() to wait() */
+
+  /* per pass data received over the control channel */
+  uint64_t         elapsed[BT_PASS_MAX];
+  bt_counters_t    counters[BT_PASS_MAX];
+  char           * assertion;
+  char           * reason;
 
-  unsigned setupid;
-  unsigned teardownid;
+  /* benchmarks only, one summary per input size */
+  bt_bench_t     * bench;   /* [nbench] */
+  double        ** samples; /* [nbench][bench[i].nsamples] ns per operation */
+  unsigned         nbench;
+  bt_fit_t       * fit;     /* NULL unless there are several sizes */
 };
 
 /*
- * structure holding a test suite containing:
- *  - an optional setup function
- *  - an optional teardown function
- *  - a list of test cases
+ * a test suite is a range of the tests of an elf
  */
 struct bt_suite {
-  struct bt_suite * next;
-
-  bt_test_t ** htests;
-  unsigned     hsize;
-
-  char * name;
+  uint32_t name;  /* offset into the strings of the elf */
+  unsigned first;
+  unsigned count;
 };
 
 /*
- * structure holding a dl-opened shared object (which contains test suites)
- * containing a handle to received from dlopen() and a list of test suites
- * derived from test declarations
+ * structure holding a shared object (which contains test suites) mapped
+ * from disk, but not loaded, and the registry of its tests; the registry
+ * is a set of parallel arrays indexed by test, with the tests of a suite
+ * next to each other, so walking it is a linear scan and the data only
+ * needed for tests that ran stays out of the way; the registry is
+ * allocated from the arena of the butcher or used in place from a cached
+ * manifest and the names are offsets into the image of the object, which
+ * stays mapped as long as the elf
  */
 struct bt_elf {
   struct bt_elf * next;
   bt_t        * butcher;
+  bt_arena_t  * arena;    /* where the registry is allocated from */
   char        * name;
-  bt_suite_t ** hsuites;
-  unsigned      hsize;
-  void        * dlhandle;
+  bt_image_t  * image;
+
+  unsigned      fncount;  /* number of records in both bexec sections */
+  unsigned      nrecs;    /* records in bexec, the compact ones follow */
+  uint64_t      recaddr;  /* where the sections are loaded, 0 if absent */
+  uint64_t      compactaddr;
+  unsigned      slotbase; /* first slot of the elf on the result board */
+
+  bt_suite_t  * suites;   /* [nsuites] in order of declaration */
+  unsigned      nsuites;
+  unsigned      ntests;
+  unsigned    * ids;      /* [ntests] record of the test function */
+  unsigned char * kinds;  /* [ntests] bt_fn_kind_t */
+  uint32_t    * tags;     /* [ntests] size class and BT_TAG_* */
+  unsigned    * setupids; /* [ntests] record of the setup or BT_NO_ID */
+  unsigned    * teardownids;
+  uint32_t    * names;    /* [ntests] offsets into strings */
+  char       (* results)[BT_PASS_MAX];
+  bt_test_t   * tests;    /* [ntests] */
+
+  const char  * strings;  /* the image, names are where the records point */
+  bt_table_t    index;    /* suite names in scope BT_NO_ID, test names in
+                             the scope of the suite index */
+
+  void        * manifest; /* the cached registry, see bt_cache() */
+  size_t        manifest_size;
+
+  bt_stream_t * stream;   /* set if the records are streamed, see below */
+};
+
+/*
+ * an elf that is streamed (see BT_FLAG_STREAM) never gets a registry, the
+ * records are read through a small window while the tests are run and the
+ * registry of the elf only ever holds the test at hand
+ *
+ * the fixtures of a test are declared right before it, so they are looked
+ * up in the records before the test; the few that are not have been put
+ * into a side index when the elf was scanned
+ */
+
+#define BT_STREAM_WINDOW 1024
+#define BT_STREAM_LOOKBEHIND 8
+
+struct bt_stream_fixture {
+  uint64_t      key;      /* FNV-1a of "<suite>\0<test>" */
+  unsigned      id;       /* the record of the fixture */
+};
+
+struct bt_stream {
+  bt_fn_t       window[BT_STREAM_WINDOW];
+  unsigned      first;    /* record the window starts at */
+  unsigned      count;    /* records in the window */
+  unsigned      next;     /* record to look for the next test at */
+
+  bt_stream_fixture_t * fixtures; /* [nfixtures] sorted by key */
+  unsigned      nfixtures;
+  unsigned      ntests;
+
+  unsigned      results[BT_TEST_MAX]; /* worst results of the tests run */
+  bt_arena_t    scratch;  /* what is received while a test runs */
+};
+
+/*
+ * shared objects being loaded in the background (see bt_loadv()), every
+ * job has an arena of its own, which is handed over to the butcher with
+ * the elf, jobs are handed over in order
+ */
+struct bt_load_job {
+  const char * name;
+  bt_elf_t   * elf;
+  bt_arena_t   arena;
+  int          err;
+  int          done;
+};
+
+struct bt_loader {
+  pthread_mutex_t   lock;
+  pthread_cond_t    cond;
+  bt_load_job_t   * jobs;
+  unsigned          njobs;
+  unsigned          next;   /* next job to start */
+  unsigned          taken;  /* jobs handed over so far */
+  pthread_t       * threads;
+  unsigned          nthreads;
 };
 
 /*
@@ -102,10 +412,15 @@ struct bt_elf {
  */
 struct bt {
   bt_elf_t * elfs;
+  bt_loader_t * loader;
   char color;
   char verbose;
   char messages;
   char envdump;
+  char stream;
+  char instructions;
+  char stepping; /* instructions are counted by single stepping */
+  char perf;
   char initialized;
 
   FILE * fd;
@@ -114,14 +429,415 @@ struct bt {
   char ** debugger;
   unsigned int debugger_nargs;
 
-  regex_t sregex, tregex;
+  char * logdir;
+  char * cachedir;
+  int timeout;  /* s, -1 for the one of the size class, 0 for none */
+  int cpu;      /* the tests are pinned to, -1 for none */
+
+  bt_reporter_t * reporters;
+
+  bt_baseline_t * baseline;    /* NULL unless benchmarks are compared */
+  double          threshold;   /* the slowdown tolerated, 0.05 for 5% */
+  unsigned        regressions;
+
+  char               * boardpath;
+  int                  boardfd;
+  struct bt_board    * board;
+  size_t               boardsize;
+
+  bt_selector_t selector;
+
+  bt_arena_t arena;
 };
 
+/*
+ * FNV-1a, the hash behind the keys of tests, the name sets of the selector
+ * and the names of manifests; start with BT_FNV_BASIS and chain the parts
+ */
+
+#define BT_FNV_BASIS 0xcbf29ce484222325ull
+#define BT_FNV_PRIME 0x100000001b3ull
+
+static inline
+uint64_t bt_fnv1a(uint64_t h, const void * data, size_t length)
+{
+  for (const unsigned char * p = data; length--; p++) {
+    h ^= *p;
+    h *= BT_FNV_PRIME;
+  }
+
+  return h;
+}
+
+/*
+ * size classes and tags of tests, see BT_TEST_TAGGED()
+ */
+
+#define BT_SIZE_CLASSES 3
+#define BT_TAG_COUNT 4
+
+extern const char * const bt_size_names[BT_SIZE_CLASSES];
+extern const char * const bt_tag_names[BT_TAG_COUNT];
+
+static inline
+unsigned bt_size_class(uint32_t tags)
+{
+  unsigned size = (tags & BT_SIZE_MASK) >> BT_SIZE_SHIFT;
+
+  return size < BT_SIZE_CLASSES ? size : BT_SIZE_CLASSES - 1;
+}
+
 #define BT_NO_ID ((unsigned) -1)
+#define BT_NO_NAME ((uint32_t) -1) /* a record without a suite */
+
+static inline
+const char * bt_bench_unit(const bt_bench_t * bench)
+{
+  return bench->unit == BT_BENCH_INSTRUCTIONS ? "insn/op" : "ns/op";
+}
+
+static inline
+const char * bt_elf_suite_name(const bt_elf_t * elf, unsigned suite)
+{
+  return elf->suites[suite].name == BT_NO_NAME ? "(nil)" : elf->strings + elf->suites[suite].name;
+}
+
+static inline
+const char * bt_elf_test_name(const bt_elf_t * elf, unsigned test)
+{
+  return elf->strings + elf->names[test];
+}
+
+/**
+ * returns the worst result of all passes
+ */
+
+static inline
+int bt_worst_result(const char * results)
+{
+  int result = BT_TEST_NONE;
+
+  for (int i = 0; i < BT_PASS_MAX; i++) {
+    if (results[i] > result)
+      result = results[i];
+  }
+
+  return result;
+}
+
+/*
+ * everything a reporter gets to know about a test, the pointers are valid
+ * only during the call
+ */
+struct bt_event {
+  const char          * elf;
+  const char          * suite;
+  const char          * test;
+  int                   result;   /* worst result (see bt_worst_result()) */
+  const char          * results;  /* [BT_PASS_MAX] */
+  const uint64_t      * elapsed;  /* [BT_PASS_MAX] in ns */
+  const bt_counters_t * counters; /* [BT_PASS_MAX] */
+  const struct rusage * ru;
+  uint64_t              wall;
+  const char          * assertion;
+  const char          * reason;
+  const bt_log_t      * log;      /* NULL if there is no log */
+  const char          * logfile;  /* the output of the test, if not in log */
+  const bt_bench_t    * bench;    /* [nbench], NULL if the test is no benchmark */
+  double * const      * samples;  /* [nbench][bench[i].nsamples] */
+  unsigned              nbench;
+  const bt_fit_t      * fit;      /* NULL unless there are several sizes */
+};
+
+/*
+ * a reporter gets notified as the run progresses, so results can be
+ * consumed while tests are still running; any callback may be NULL
+ */
+struct bt_reporter_ops {
+  const char * name;
+  /* a backend with its own storage opens it here instead of a stream */
+  int (* open)(bt_reporter_t * self, const char * path);
+  int (* run_start)(bt_reporter_t * self);
+  int (* test_start)(bt_reporter_t * self, const bt_event_t * event);
+  int (* test_end)(bt_reporter_t * self, const bt_event_t * event);
+  int (* run_end)(bt_reporter_t * self);
+  void (* release)(bt_reporter_t * self);
+};
+
+struct bt_reporter {
+  struct bt_reporter      * next;
+  const bt_reporter_ops_t * ops;
+  FILE                    * fd;
+  void                    * data;
 
-struct result_rec {
-  char magic[5];
-  char results[BT_PASS_MAX];
-  char done;
+  /* filled in by the dispatcher, count includes the tests that did not run */
+  unsigned                  count;
+  unsigned                  results[BT_TEST_MAX];
+  unsigned                  skipped; /* selected, but without a result */
 };
+
+void * bt_arena_alloc(bt_arena_t * arena, size_t size);
+char * bt_arena_strdup(bt_arena_t * arena, const char * str);
+char * bt_arena_printf(bt_arena_t * arena, const char * format, ...) __attribute__ ((format (printf, 2, 3)));
+void bt_arena_merge(bt_arena_t * arena, bt_arena_t * other);
+void bt_arena_release(bt_arena_t * arena);
+
+int bt_log_delete(bt_log_t ** log);
+
+int bt_table_init(bt_table_t * table, bt_arena_t * arena, unsigned count);
+unsigned bt_table_get(const bt_table_t * table, unsigned scope, const char * name);
+unsigned bt_table_getn(const bt_table_t * table, unsigned scope, const char * name, size_t length);
+int bt_table_add(bt_table_t * table, unsigned scope, const char * name, unsigned value);
+
+int bt_elf_sections(bt_elf_t * elf);
+int bt_elf_read(bt_elf_t * elf, unsigned first, bt_fn_t * fns, unsigned count);
+
+int bt_loader_take(bt_t * self, bt_elf_t ** elf);
+int bt_chopper(bt_t * self, bt_elf_t * elf, unsigned s, unsigned t);
+
+void bt_stats_summary(double * samples, unsigned count, bt_bench_t * bench);
+double bt_stats_median(const double * sorted, unsigned count);
+int bt_stats_fit(const bt_bench_t * bench, unsigned count, bt_fit_t * fit);
+double bt_stats_mann_whitney(const double * a, unsigned na, const double * b, unsigned nb);
+double bt_stats_difference(const double * a, unsigned na, const double * b, unsigned nb);
+
+int bt_cache_load(bt_elf_t * elf);
+int bt_cache_store(bt_elf_t * elf);
+
+int bt_stream_open(bt_elf_t * elf);
+int bt_stream_rewind(bt_elf_t * elf);
+int bt_stream_next(bt_elf_t * elf);
+void bt_stream_close(bt_elf_t * elf);
+
+int bt_selector_compile(bt_selector_t * selector);
+int bt_selector_suite(const bt_selector_t * selector, const char * suite);
+int bt_selector_test(const bt_selector_t * selector, const char * elf, const char * suite, const char * test);
+int bt_selector_tags(const bt_selector_t * selector, uint32_t tags);
+void bt_selector_clear(bt_selector_t * selector);
+
+uint64_t bt_test_key(const char * elf, const char * suite, const char * test);
+int bt_test_key_parse(const char * name, uint64_t * key);
+
+int bt_reporter_new(bt_reporter_t ** reporter, const char * spec);
+int bt_reporter_delete(bt_reporter_t ** reporter);
+int bt_reporter_add(bt_t * butcher, bt_reporter_t * reporter);
+
+int bt_reporters_run_start(bt_t * butcher);
+int bt_reporters_test_start(bt_t * butcher, const bt_event_t * event);
+int bt_reporters_test_end(bt_t * butcher, const bt_event_t * event);
+int bt_reporters_run_end(bt_t * butcher);
+
+/*
+ * images of shared objects on disk
+ */
+
+#define BT_BUILD_ID_MAX 20
+
+int bt_image_open(bt_image_t ** image, const char * path);
+int bt_image_close(bt_image_t ** image);
+int bt_image_probe(const char * path);
+int bt_image_build_id(bt_image_t * image, unsigned char * id, size_t * length);
+const void * bt_image_data(bt_image_t * image, size_t * size);
+const struct stat * bt_image_stat(bt_image_t * image);
+int bt_image_section(bt_image_t * image, const char * name, uint64_t * addr, size_t * size);
+int bt_image_read(bt_image_t * image, uint64_t addr, void * buffer, size_t size);
+const char * bt_image_string(bt_image_t * image, uint64_t addr);
+
+/*
+ * the history database, one record per test and run
+ */
+struct bt_history_rec {
+  uint64_t      key;
+  uint32_t      prev;    /* index + 1 of the previous record of the test */
+  uint32_t      run;
+  uint64_t      time;    /* start of the run, ns since the epoch */
+  uint64_t      wall;    /* ns */
+  uint64_t      utime;   /* us */
+  uint64_t      stime;   /* us */
+  uint64_t      maxrss;  /* kB */
+  uint64_t      minflt;
+  uint64_t      majflt;
+  uint64_t      nvcsw;
+  uint64_t      nivcsw;
+  uint64_t      inblock;
+  uint64_t      oublock;
+  int8_t        result;
+  int8_t        results[BT_PASS_MAX];
+  uint8_t       build_id_length;
+  uint8_t       reserved[3];
+  unsigned char build_id[BT_BUILD_ID_MAX];
+};
+
+int bt_history_open(bt_history_t ** history, const char * path, int writable);
+int bt_history_close(bt_history_t ** history);
+uint32_t bt_history_run(bt_history_t * history);
+int bt_history_append(bt_history_t * history, uint64_t key, const bt_history_rec_t * rec);
+unsigned bt_history_lookup(bt_history_t * history, uint64_t key, const bt_history_rec_t ** recs, unsigned max);
+
+extern const bt_reporter_ops_t bt_history_ops;
+
+/*
+ * the benchmark baseline
+ */
+
+int bt_baseline_load(bt_baseline_t ** baseline, const char * path);
+void bt_baseline_release(bt_baseline_t ** baseline);
+int bt_baseline_check(const bt_baseline_t * baseline, uint64_t key, const bt_test_t * test,
+    double threshold, int * regressed, char * message, size_t size);
+
+extern const bt_reporter_ops_t bt_baseline_ops;
+
+/*
+ * the log archive
+ */
+
+extern const bt_reporter_ops_t bt_archive_ops;
+
+/*
+ * the OpenMetrics exporter
+ */
+
+extern const bt_reporter_ops_t bt_metrics_ops;
+
+/*
+ * the control protocol spoken between bexec and the butcher
+ *
+ * bexec sends one message per packet over a SOCK_SEQPACKET socket, so the
+ * kernel keeps the framing; every packet starts with a header announcing
+ * the version of the protocol and the length of the payload following it
+ */
+
+#define BT_PROTO_VERSION 2
+#define BT_MSG_MAX 4096
+
+enum {
+  BT_MSG_HELLO = 1, /* no payload, sent first */
+  BT_MSG_PHASE,     /* struct bt_msg_phase */
+  BT_MSG_COUNTERS,  /* struct bt_msg_counters */
+  BT_MSG_ASSERT,    /* struct bt_msg_where + file + expression */
+  BT_MSG_IGNORE,    /* struct bt_msg_where + file + reason */
+  BT_MSG_DONE,      /* no payload, sent last */
+  BT_MSG_BENCH,     /* struct bt_msg_bench + double[nsamples], one per size */
+};
+
+struct bt_msg_hdr {
+  uint16_t version;
+  uint16_t type;
+  uint32_t length;
+};
+
+struct bt_msg_phase {
+  uint32_t pass;
+  int32_t  result;
+  uint64_t start; /* CLOCK_MONOTONIC in ns */
+  uint64_t end;
+};
+
+struct bt_msg_counters {
+  uint32_t      pass;
+  uint32_t      reserved;
+  bt_counters_t counters;
+};
+
+struct bt_msg_bench {
+  uint32_t   pass;
+  uint32_t   reserved;
+  bt_bench_t bench;
+};
+
+/* the strings follow the structure, their lengths include a '\0' */
+struct bt_msg_where {
+  uint32_t pass;
+  uint32_t line;
+  uint16_t file_length;
+  uint16_t text_length;
+  uint32_t reserved;
+};
+/*
+ * the result board
+ *
+ * a MAP_SHARED table with one fixed size slot per test function of every
+ * loaded elf (i.e. slot = elf->slotbase + bt_fn id), the butcher schedules
+ * a test by filling in the slot, bexec publishes its progress in it while it
+ * runs; external tools can map the file passed to --board and watch the run
+ *
+ * the board grows while shared objects are still being loaded, nslots is
+ * only raised once the file is large enough, so readers have to map it
+ * again when nslots does not fit their mapping anymore
+ *
+ * every slot is guarded by a sequence counter, which is odd while the slot
+ * is written, readers copy the slot and retry if the counter was odd or has
+ * changed meanwhile (see bt_board_slot_read()); a bexec killed in the
+ * middle of a write leaves the counter odd for good, so readers give up
+ * after BT_BOARD_READ_TRIES tries and take the slot as torn
+ */
+
+#define BT_BOARD_MAGIC 0x64726f62 /* "bord" */
+#define BT_BOARD_VERSION 2
+#define BT_BOARD_NAME_MAX 128
+#define BT_BOARD_READ_TRIES 100000
+
+enum {
+  BT_SLOT_EMPTY = 0,
+  BT_SLOT_SCHEDULED,
+  BT_SLOT_RUNNING,
+  BT_SLOT_DONE,
+};
+
+struct bt_board_slot {
+  uint32_t      seq;
+  uint32_t      state;
+  uint32_t      pid;
+  uint32_t      pass;        /* the pass running right now */
+  uint32_t      elf;         /* index of the elf in load order */
+  uint32_t      function;    /* bt_fn id of the test */
+  int8_t        results[BT_PASS_MAX];
+  int8_t        reserved[8 - BT_PASS_MAX];
+  uint64_t      start[BT_PASS_MAX];
+  uint64_t      end[BT_PASS_MAX];
+  bt_counters_t counters[BT_PASS_MAX];
+  char          name[BT_BOARD_NAME_MAX]; /* "<suite>.<test>" */
+};
+
+struct bt_board {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t slot_size;
+  uint32_t nslots;
+  uint32_t scheduled;
+  uint32_t finished;
+  uint64_t started; /* CLOCK_REALTIME in ns */
+  struct bt_board_slot slots[];
+};
+
+static inline
+void bt_board_slot_begin(struct bt_board_slot * slot)
+{
+  __atomic_fetch_add(&slot->seq, 1, __ATOMIC_ACQ_REL);
+}
+
+static inline
+void bt_board_slot_end(struct bt_board_slot * slot)
+{
+  __atomic_fetch_add(&slot->seq, 1, __ATOMIC_RELEASE);
+}
+
+static inline
+int bt_board_slot_read(const struct bt_board_slot * slot, struct bt_board_slot * copy)
+{
+  uint32_t seq;
+
+  for (unsigned tries = 0; tries < BT_BOARD_READ_TRIES; tries++) {
+    seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+    if (seq & 1)
+      continue;
+    memcpy(copy, (const void *) slot, sizeof(*copy));
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    if (__atomic_load_n(&slot->seq, __ATOMIC_RELAXED) == seq)
+      return 0;
+  }
+
+  return EAGAIN;
+}
+
 #endif /* BTPRIVATE_H_ */
@@ -0,0 +1,754 @@
+/* @@SOURCE-HEADER@@ */
+
+#include "bt-private.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+/*************************************************/
+
+/**
+ * computes the key of a test, which is a FNV-1a hash of
+ * "<basename of elf>/<suite>/<test>"
+ */
+
+uint64_t bt_test_key(const char * elf, const char * suite, const char * test)
+{
+  const char * base = strrchr(elf, '/') ? strrchr(elf, '/') + 1 : elf;
+  uint64_t h;
+
+  h = bt_fnv1a(BT_FNV_BASIS, base, strlen(base));
+  h = bt_fnv1a(h, "/", 1);
+  h = bt_fnv1a(h, suite, strlen(suite));
+  h = bt_fnv1a(h, "/", 1);
+  h = bt_fnv1a(h, test, strlen(test));
+
+  return h;
+}
+
+/**
+ * computes the key of a test named as "<elf>/<suite>/<test>"
+ *
+ * @param[in] name the name of the test
+ * @param[out] key the key of the test
+ *
+ * @return the operation error code
+ */
+
+int bt_test_key_parse(const char * name, uint64_t * key)
+{
+  char * copy, * suite, * test;
+
+  copy = strdup(name);
+  if (!copy)
+    return_error(ENOMEM);
+
+  suite = strchr(copy, '/');
+  test = suite ? strchr(suite + 1, '/') : NULL;
+  if (!test) {
+    free(copy);
+    return_error(EINVAL);
+  }
+  *suite++ = '\0';
+  *test++ = '\0';
+
+  *key = bt_test_key(copy, suite, test);
+  free(copy);
+
+  return 0;
+}
+
+static
+const char * bt_result_name(int result)
+{
+  switch (result) {
+    case BT_TEST_SUCCEEDED:
+      return "succeeded";
+    case BT_TEST_FAILED:
+      return "failed";
+    case BT_TEST_IGNORED:
+      return "ignored";
+    case BT_TEST_CORRUPTED:
+      return "corrupted";
+    case BT_TEST_REGRESSED:
+      return "regressed";
+    default:
+      return "none";
+  }
+}
+
+static const char * const bt_perf_names[BT_PERF_MAX] = {
+  "cycles", "instructions", "branches", "branch_misses", "cache_references",
+  "cache_misses", "task_clock_ns", "page_faults", "context_switches",
+  "cpu_migrations",
+};
+
+static
+const char * bt_pass_name(int pass)
+{
+  switch (pass) {
+    case BT_PASS_SETUP:
+      return "setup";
+    case BT_PASS_TEST:
+      return "test";
+    case BT_PASS_TEARDOWN:
+      return "teardown";
+    default:
+      return "unknown";
+  }
+}
+
+/**
+ * writes a string escaped for use inside XML attributes and text
+ *
+ * @param[in] fd the stream to write to
+ * @param[in] str the string to escape
+ */
+
+static
+void bt_xml_puts(FILE * fd, const char * str)
+{
+  for (const unsigned char * p = (const unsigned char *) str; p && *p; p++) {
+    switch (*p) {
+      case '<':
+        fputs("&lt;", fd); break;
+      case '>':
+        fputs("&gt;", fd); break;
+      case '&':
+        fputs("&amp;", fd); break;
+      case '"':
+        fputs("&quot;", fd); break;
+      case '\'':
+        fputs("&apos;", fd); break;
+      default:
+        /* XML 1.0 does not allow most control characters at all */
+        if (*p < 0x20 && *p != '\t' && *p != '\n' && *p != '\r')
+          fputc('?', fd);
+        else
+          fputc(*p, fd);
+        break;
+    }
+  }
+}
+
+/**
+ * writes a string as JSON string literal (including the quotes)
+ *
+ * @param[in] fd the stream to write to
+ * @param[in] str the string to escape or NULL for null
+ */
+
+static
+void bt_json_puts(FILE * fd, const char * str)
+{
+  if (!str) {
+    fputs("null", fd);
+    return;
+  }
+
+  fputc('"', fd);
+  for (const unsigned char * p = (const unsigned char *) str; *p; p++) {
+    switch (*p) {
+      case '"':
+        fputs("\\\"", fd); break;
+      case '\\':
+        fputs("\\\\", fd); break;
+      case '\n':
+        fputs("\\n", fd); break;
+      case '\r':
+        fputs("\\r", fd); break;
+      case '\t':
+        fputs("\\t", fd); break;
+      default:
+        if (*p < 0x20)
+          fprintf(fd, "\\u%04x", *p);
+        else
+          fputc(*p, fd);
+        break;
+    }
+  }
+  fputc('"', fd);
+}
+
+/*************************************************/
+/* JUnit XML */
+
+struct bt_junit {
+  char * elf;
+  char * suite;
+};
+
+static
+int bt_junit_run_start(bt_reporter_t * self)
+{
+  self->data = calloc(1, sizeof(struct bt_junit));
+  if (!self->data)
+    return_error(ENOMEM);
+
+  fprintf(self->fd, "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n<testsuites>\n");
+
+  return 0;
+}
+
+static
+void bt_junit_close_suite(bt_reporter_t * self)
+{
+  struct bt_junit * junit = self->data;
+
+  if (junit->suite)
+    fprintf(self->fd, "  </testsuite>\n");
+
+  free(junit->elf);
+  free(junit->suite);
+  junit->elf = NULL;
+  junit->suite = NULL;
+}
+
+static
+int bt_junit_test_end(bt_reporter_t * self, const bt_event_t * event)
+{
+  struct bt_junit * junit = self->data;
+
+  /* tests of a suite are run in a row, so the suite can be streamed too */
+  if (!junit->suite || strcmp(junit->suite, event->suite) != 0 || strcmp(junit->elf, event->elf) != 0) {
+    bt_junit_close_suite(self);
+
+    junit->elf = strdup(event->elf);
+    junit->suite = strdup(event->suite);
+    if (!junit->elf || !junit->suite)
+      return_error(ENOMEM);
+
+    fprintf(self->fd, "  <testsuite name=\"");
+    bt_xml_puts(self->fd, event->suite);
+    fprintf(self->fd, "\" package=\"");
+    bt_xml_puts(self->fd, event->elf);
+    fprintf(self->fd, "\">\n");
+  }
+
+  fprintf(self->fd, "    <testcase classname=\"");
+  bt_xml_puts(self->fd, event->suite);
+  fprintf(self->fd, "\" name=\"");
+  bt_xml_puts(self->fd, event->test);
+  fprintf(self->fd, "\" time=\"%.6f\">\n", event->wall / 1e9);
+
+  switch (event->result) {
+    case BT_TEST_FAILED:
+      fprintf(self->fd, "      <failure message=\"");
+      bt_xml_puts(self->fd, event->assertion ? event->assertion : "failed");
+      fprintf(self->fd, "\"/>\n");
+      break;
+    case BT_TEST_IGNORED:
+      fprintf(self->fd, "      <skipped message=\"");
+      bt_xml_puts(self->fd, event->reason ? event->reason : "ignored");
+      fprintf(self->fd, "\"/>\n");
+      break;
+    case BT_TEST_CORRUPTED:
+      fprintf(self->fd, "      <error message=\"corrupted\"/>\n");
+      break;
+    case BT_TEST_REGRESSED:
+      fprintf(self->fd, "      <failure message=\"regressed\"/>\n");
+      break;
+    case BT_TEST_NONE:
+      fprintf(self->fd, "      <skipped message=\"not run\"/>\n");
+      break;
+    default:
+      break;
+  }
+
+  if (event->log && event->log->lines) {
+    fprintf(self->fd, "      <system-out>");
+    for (bt_log_line_t * line = event->log->lines; line; line = line->next) {
+      bt_xml_puts(self->fd, line->contents);
+      fputc('\n', self->fd);
+    }
+    fprintf(self->fd, "</system-out>\n");
+  }
+
+  fprintf(self->fd, "    </testcase>\n");
+
+  return 0;
+}
+
+static
+int bt_junit_run_end(bt_reporter_t * self)
+{
+  bt_junit_close_suite(self);
+  fprintf(self->fd, "</testsuites>\n");
+
+  return 0;
+}
+
+static
+void bt_junit_release(bt_reporter_t * self)
+{
+  if (self->data) {
+    bt_junit_close_suite(self);
+    free(self->data);
+  }
+}
+
+static const bt_reporter_ops_t bt_junit_ops = {
+  .name = "junit",
+  .run_start = bt_junit_run_start,
+  .test_end = bt_junit_test_end,
+  .run_end = bt_junit_run_end,
+  .release = bt_junit_release,
+};
+
+/*************************************************/
+/* JSON lines */
+
+/**
+ * writes the members of the summary of a benchmark
+ *
+ * @param[in] fd the stream to write to
+ * @param[in] bench the summary
+ * @param[in] samples the samples it summarizes
+ */
+
+static
+void bt_json_bench(FILE * fd, const bt_bench_t * bench, const double * samples)
+{
+  /* the keys say ns, the unit tells whether they are instructions */
+  fprintf(fd, "\"unit\":\"%s\",", bench->unit == BT_BENCH_INSTRUCTIONS ? "insn" : "ns");
+  fprintf(fd,
+      "\"operations\":%llu,\"median_ns\":%.17g,\"mad_ns\":%.17g,\"mean_ns\":%.17g,"
+      "\"stddev_ns\":%.17g,\"min_ns\":%.17g,\"max_ns\":%.17g,\"ci_low_ns\":%.17g,\"ci_high_ns\":%.17g,"
+      "\"samples_ns\":[",
+      (unsigned long long) bench->operations, bench->median, bench->mad,
+      bench->mean, bench->stddev, bench->min, bench->max,
+      bench->ci_low, bench->ci_high);
+  for (unsigned n = 0; n < bench->nsamples; n++)
+    fprintf(fd, "%s%.17g", n ? "," : "", samples[n]);
+  fprintf(fd, "]");
+}
+
+static
+int bt_json_run_start(bt_reporter_t * self)
+{
+  fprintf(self->fd, "{\"event\":\"run_start\",\"pid\":%d}\n", (int) getpid());
+
+  return 0;
+}
+
+static
+int bt_json_test_start(bt_reporter_t * self, const bt_event_t * event)
+{
+  fprintf(self->fd, "{\"event\":\"test_start\",\"elf\":");
+  bt_json_puts(self->fd, event->elf);
+  fprintf(self->fd, ",\"suite\":");
+  bt_json_puts(self->fd, event->suite);
+  fprintf(self->fd, ",\"test\":");
+  bt_json_puts(self->fd, event->test);
+  fprintf(self->fd, "}\n");
+
+  return 0;
+}
+
+static
+int bt_json_test_end(bt_reporter_t * self, const bt_event_t * event)
+{
+  int flag = 0;
+
+  fprintf(self->fd, "{\"event\":\"test_end\",\"elf\":");
+  bt_json_puts(self->fd, event->elf);
+  fprintf(self->fd, ",\"suite\":");
+  bt_json_puts(self->fd, event->suite);
+  fprintf(self->fd, ",\"test\":");
+  bt_json_puts(self->fd, event->test);
+  fprintf(self->fd, ",\"result\":\"%s\",\"wall_ns\":%llu",
+      bt_result_name(event->result), (unsigned long long) event->wall);
+
+  fprintf(self->fd, ",\"passes\":{");
+  for (int i = 0; i < BT_PASS_MAX; i++) {
+    if (event->results[i] <= BT_TEST_NONE)
+      continue;
+    fprintf(self->fd,
+        "%s\"%s\":{\"result\":\"%s\",\"ns\":%llu,\"utime_us\":%llu,\"stime_us\":%llu,"
+        "\"maxrss_kb\":%llu,\"minflt\":%llu,\"majflt\":%llu,\"nvcsw\":%llu,\"nivcsw\":%llu",
+        flag++ ? "," : "", bt_pass_name(i), bt_result_name(event->results[i]),
+        (unsigned long long) event->elapsed[i],
+        (unsigned long long) event->counters[i].utime,
+        (unsigned long long) event->counters[i].stime,
+        (unsigned long long) event->counters[i].maxrss,
+        (unsigned long long) event->counters[i].minflt,
+        (unsigned long long) event->counters[i].majflt,
+        (unsigned long long) event->counters[i].nvcsw,
+        (unsigned long long) event->counters[i].nivcsw);
+    /* only the events that were counted */
+    if (event->counters[i].perf_mask) {
+      int comma = 0;
+
+      fprintf(self->fd, ",\"perf\":{");
+      for (int e = 0; e < BT_PERF_MAX; e++) {
+        if (event->counters[i].perf_mask & (1u << e))
+          fprintf(self->fd, "%s\"%s\":%llu", comma++ ? "," : "", bt_perf_names[e],
+              (unsigned long long) event->counters[i].perf[e]);
+      }
+      fprintf(self->fd, "}");
+    }
+    fprintf(self->fd, "}");
+  }
+  fprintf(self->fd, "}");
+
+  fprintf(self->fd, ",\"utime_us\":%llu,\"stime_us\":%llu,\"maxrss_kb\":%ld",
+      (unsigned long long) event->ru->ru_utime.tv_sec * 1000000 + event->ru->ru_utime.tv_usec,
+      (unsigned long long) event->ru->ru_stime.tv_sec * 1000000 + event->ru->ru_stime.tv_usec,
+      event->ru->ru_maxrss);
+
+  if (event->fit) {
+    fprintf(self->fd, ",\"bench\":{\"complexity\":\"%s\",\"coefficient_ns\":%.17g,\"rms\":%.17g,\"sizes\":[",
+        bt_complexity_names[event->fit->complexity], event->fit->coefficient, event->fit->rms);
+    for (unsigned k = 0; k < event->nbench; k++) {
+      fprintf(self->fd, "%s{\"n\":%llu,", k ? "," : "", (unsigned long long) event->bench[k].n);
+      bt_json_bench(self->fd, &event->bench[k], event->samples[k]);
+      fprintf(self->fd, "}");
+    }
+    fprintf(self->fd, "]}");
+  } else if (event->bench) {
+    fprintf(self->fd, ",\"bench\":{");
+    bt_json_bench(self->fd, event->bench, event->samples[0]);
+    fprintf(self->fd, "}");
+  }
+
+  fprintf(self->fd, ",\"assertion\":");
+  bt_json_puts(self->fd, event->assertion);
+  fprintf(self->fd, ",\"reason\":");
+  bt_json_puts(self->fd, event->reason);
+
+  if (event->log) {
+    flag = 0;
+    fprintf(self->fd, ",\"log\":[");
+    for (bt_log_line_t * line = event->log->lines; line; line = line->next) {
+      if (flag++)
+        fputc(',', self->fd);
+      bt_json_puts(self->fd, line->contents);
+    }
+    fprintf(self->fd, "]");
+  }
+
+  fprintf(self->fd, "}\n");
+
+  /* let consumers tail the file */
+  fflush(self->fd);
+
+  return 0;
+}
+
+static
+int bt_json_run_end(bt_reporter_t * self)
+{
+  fprintf(self->fd,
+      "{\"event\":\"run_end\",\"count\":%u,\"succeeded\":%u,\"failed\":%u,\"ignored\":%u,\"corrupted\":%u,"
+      "\"regressed\":%u,\"skipped\":%u}\n",
+      self->count,
+      self->results[BT_TEST_SUCCEEDED],
+      self->results[BT_TEST_FAILED],
+      self->results[BT_TEST_IGNORED],
+      self->results[BT_TEST_CORRUPTED],
+      self->results[BT_TEST_REGRESSED],
+      self->skipped);
+
+  return 0;
+}
+
+static const bt_reporter_ops_t bt_json_ops = {
+  .name = "json",
+  .run_start = bt_json_run_start,
+  .test_start = bt_json_test_start,
+  .test_end = bt_json_test_end,
+  .run_end = bt_json_run_end,
+};
+
+/*************************************************/
+/* TAP */
+
+static
+int bt_tap_run_start(bt_reporter_t * self)
+{
+  fprintf(self->fd, "TAP version 13\n");
+
+  return 0;
+}
+
+static
+int bt_tap_test_end(bt_reporter_t * self, const bt_event_t * event)
+{
+  /* the dispatcher has already counted this test */
+  unsigned n = self->count;
+
+  switch (event->result) {
+    case BT_TEST_SUCCEEDED:
+      fprintf(self->fd, "ok %u - %s.%s\n", n, event->suite, event->test);
+      break;
+    case BT_TEST_IGNORED:
+      fprintf(self->fd, "ok %u - %s.%s # SKIP %s\n", n, event->suite, event->test,
+          event->reason ? event->reason : "ignored");
+      break;
+    case BT_TEST_NONE:
+      fprintf(self->fd, "ok %u - %s.%s # SKIP not run\n", n, event->suite, event->test);
+      break;
+    default:
+      fprintf(self->fd, "not ok %u - %s.%s\n", n, event->suite, event->test);
+      fprintf(self->fd, "  ---\n  result: %s\n", bt_result_name(event->result));
+      if (event->assertion) {
+        fprintf(self->fd, "  assertion: ");
+        bt_json_puts(self->fd, event->assertion);
+        fprintf(self->fd, "\n");
+      }
+      fprintf(self->fd, "  ...\n");
+      if (event->log) {
+        for (bt_log_line_t * line = event->log->lines; line; line = line->next)
+          fprintf(self->fd, "# %s\n", line->contents);
+      }
+      break;
+  }
+
+  fflush(self->fd);
+
+  return 0;
+}
+
+static
+int bt_tap_run_end(bt_reporter_t * self)
+{
+  /* the plan may come last, we do not know it in advance */
+  fprintf(self->fd, "1..%u\n", self->count);
+
+  return 0;
+}
+
+static const bt_reporter_ops_t bt_tap_ops = {
+  .name = "tap",
+  .run_start = bt_tap_run_start,
+  .test_end = bt_tap_test_end,
+  .run_end = bt_tap_run_end,
+};
+
+/*************************************************/
+
+static const bt_reporter_ops_t * bt_reporter_backends[] = {
+  &bt_junit_ops,
+  &bt_json_ops,
+  &bt_tap_ops,
+  &bt_history_ops,
+  &bt_archive_ops,
+  &bt_metrics_ops,
+  &bt_baseline_ops,
+  NULL
+};
+
+/**
+ * creates a reporter from a specification
+ *
+ * @param[out] reporter a pointer to a pointer to hold the reporter
+ * @param[in] spec "<backend>:<file>", where file "-" is stdout
+ *
+ * @return the operation error code
+ */
+
+int bt_reporter_new(bt_reporter_t ** reporter, const char * spec)
+{
+  bt_reporter_t * self;
+  const char * path;
+  size_t len;
+  int fd;
+
+  if (!reporter || !spec)
+    return_error(EINVAL);
+
+  path = strchr(spec, ':');
+  if (!path || !path[1])
+    return_error(EINVAL);
+  len = path - spec;
+  path++;
+
+  self = malloc(sizeof(bt_reporter_t));
+  if (!self)
+    return_error(ENOMEM);
+
+  memset(self, 0, sizeof(bt_reporter_t));
+
+  for (unsigned i = 0; bt_reporter_backends[i]; i++) {
+    if (strlen(bt_reporter_backends[i]->name) == len
+        && strncmp(bt_reporter_backends[i]->name, spec, len) == 0)
+      self->ops = bt_reporter_backends[i];
+  }
+  if (!self->ops) {
+    fprintf(stderr, "unknown reporter '%.*s'\n", (int) len, spec);
+    free(self);
+    return_error(EINVAL);
+  }
+
+  if (self->ops->open) {
+    int err = self->ops->open(self, path);
+    if (err) {
+      fprintf(stderr, "could not open '%s' for reporter '%s'\n", path, self->ops->name);
+      free(self);
+      return_error(err);
+    }
+  } else if (strcmp(path, "-") == 0) {
+    fd = dup(STDOUT_FILENO);
+    self->fd = fd == -1 ? NULL : fdopen(fd, "w");
+  } else {
+    self->fd = fopen(path, "w");
+  }
+  if (!self->ops->open && !self->fd) {
+    fprintf(stderr, "could not open '%s' for reporter '%s'\n", path, self->ops->name);
+    free(self);
+    return_error(EIO);
+  }
+
+  *reporter = self;
+
+  return 0;
+}
+
+/**
+ * deletes a reporter closing its output
+ *
+ * @param[in] reporter a pointer to a pointer holding the reporter
+ *
+ * @return the operation error code
+ */
+
+int bt_reporter_delete(bt_reporter_t ** reporter)
+{
+  bt_reporter_t * self;
+
+  if (!reporter || !*reporter)
+    return_error(EINVAL);
+
+  self = *reporter;
+
+  if (self->ops->release)
+    self->ops->release(self);
+
+  if (self->fd)
+    fclose(self->fd);
+
+  free(self);
+
+  return 0;
+}
+
+/**
+ * appends a reporter to the ones of the butcher
+ *
+ * @param[in] self a pointer to the butcher
+ * @param[in] reporter the reporter, owned by the butcher from now on
+ *
+ * @return the operation error code
+ */
+
+int bt_reporter_add(bt_t * self, bt_reporter_t * reporter)
+{
+  bt_reporter_t ** p;
+
+  if (!self || !reporter)
+    return_error(EINVAL);
+
+  for (p = &self->reporters; *p; p = &(*p)->next) ;
+  *p = reporter;
+
+  return 0;
+}
+
+/**
+ * adds a reporter to the butcher, several reporters can be active at once
+ *
+ * @param[in] self a pointer to the butcher
+ * @param[in] spec "<backend>:<file>" with backend being junit, json, tap,
+ *            history, archive, openmetrics or baseline
+ *
+ * @return the operation error code
+ */
+
+int bt_reporter(bt_t * self, const char * spec)
+{
+  bt_reporter_t * reporter;
+  int err;
+
+  if (!self || !self->initialized || !spec)
+    return_error(EINVAL);
+
+  err = bt_reporter_new(&reporter, spec);
+  if (err)
+    return_error(err);
+
+  return bt_reporter_add(self, reporter);
+}
+
+int bt_reporters_run_start(bt_t * self)
+{
+  int err;
+
+  for (bt_reporter_t * cur = self->reporters; cur; cur = cur->next) {
+    cur->count = 0;
+    cur->skipped = 0;
+    memset(cur->results, 0, sizeof(cur->results));
+    if (cur->ops->run_start) {
+      err = cur->ops->run_start(cur);
+      if (err)
+        return_error(err);
+    }
+  }
+
+  return 0;
+}
+
+int bt_reporters_test_start(bt_t * self, const bt_event_t * event)
+{
+  int err;
+
+  for (bt_reporter_t * cur = self->reporters; cur; cur = cur->next) {
+    if (cur->ops->test_start) {
+      err = cur->ops->test_start(cur, event);
+      if (err)
+        return_error(err);
+    }
+  }
+
+  return 0;
+}
+
+int bt_reporters_test_end(bt_t * self, const bt_event_t * event)
+{
+  int err;
+
+  for (bt_reporter_t * cur = self->reporters; cur; cur = cur->next) {
+    /* a test that was selected but never ran is skipped, not left out,
+     * so the numbering of TAP and the totals stay right */
+    cur->count++;
+    if (event->result > BT_TEST_NONE)
+      cur->results[event->result]++;
+    else
+      cur->skipped++;
+    if (cur->ops->test_end) {
+      err = cur->ops->test_end(cur, event);
+      if (err)
+        return_error(err);
+    }
+  }
+
+  return 0;
+}
+
+int bt_reporters_run_end(bt_t * self)
+{
+  int err;
+
+  for (bt_reporter_t * cur = self->reporters; cur; cur = cur->next) {
+    if (cur->ops->run_end) {
+      err = cur->ops->run_end(cur);
+      if (err)
+        return_error(err);
+    }
+    if (cur->fd)
+      fflush(cur->fd);
+  }
+
+  return 0;
+}
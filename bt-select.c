@@ -0,0 +1,742 @@
+/* @@SOURCE-HEADER@@ */
+
+#include "bt-private.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+/*
+ * test selection
+ *
+ * -s and -t take POSIX extended regexes and are repeatable, a pattern that
+ * starts with '!' excludes what it matches; deciding on a test takes a few
+ * lookups and at most four regexec() calls however many patterns there are:
+ *  - whole names ("^foo$") are looked up in a table
+ *  - most other patterns are globs in disguise ("^foo", "bar$",
+ *    "^foo.*bar"), the ones with a literal start or end are bucketed by it,
+ *    so a name is only compared against the globs of the prefixes and
+ *    suffixes it has, one lookup per distinct length of them
+ *  - the others, "foo" among them, are joined into one regex per kind and
+ *    sign; only matching that regex gets slower with every pattern in it
+ *  - exact names from --select-file go into a hash set
+ *  - --tags are bitmasks the flags of a test are checked against
+ */
+
+const char * const bt_size_names[BT_SIZE_CLASSES] = {"small", "medium", "large"};
+const char * const bt_tag_names[BT_TAG_COUNT] = {"slow", "io", "net", "flaky"};
+
+/**
+ * takes a regex apart into the segments of a glob
+ *
+ * @param[in] arena where the glob is allocated from
+ * @param[in] regex the regex
+ * @param[out] glob a pointer to a pointer to hold the glob
+ *
+ * @return the operation error code (ENOENT if the regex is not a glob)
+ */
+
+static
+int bt_glob_parse(bt_arena_t * arena, const char * regex, bt_glob_t ** glob)
+{
+  bt_glob_t * self;
+  size_t length = strlen(regex);
+  const char * p, * end;
+  char * buffer, * q;
+  unsigned n;
+
+  /* check the regex and count the segments first */
+  p = regex;
+  end = regex + length;
+  if (p < end && *p == '^')
+    p++;
+  if (end > p && end[-1] == '$' && (end - 1 == p || end[-2] != '\\'))
+    end--;
+
+  n = 1;
+  while (p < end) {
+    if (*p == '\\') {
+      if (p + 1 == end || !strchr(".[]()*+?{}|^$\\", p[1]))
+        return ENOENT;
+      p += 2;
+    } else if (*p == '.' && p + 1 < end && p[1] == '*') {
+      n++;
+      p += 2;
+    } else if (strchr(".[]()*+?{}|^$", *p)) {
+      return ENOENT;
+    } else {
+      p++;
+    }
+  }
+
+  self = bt_arena_alloc(arena, sizeof(bt_glob_t) + sizeof(char *) * n + length + n);
+  if (!self)
+    return_error(ENOMEM);
+
+  self->next = NULL;
+  self->segments = (char **) (self + 1);
+  buffer = (char *) (self->segments + n);
+
+  p = regex;
+  end = regex + length;
+  self->anchored_start = p < end && *p == '^';
+  if (self->anchored_start)
+    p++;
+  self->anchored_end = end > p && end[-1] == '$' && (end - 1 == p || end[-2] != '\\');
+  if (self->anchored_end)
+    end--;
+
+  self->nsegments = 1;
+  self->segments[0] = q = buffer;
+  while (p < end) {
+    if (*p == '\\') {
+      *q++ = p[1];
+      p += 2;
+    } else if (*p == '.') {
+      *q++ = '\0';
+      self->segments[self->nsegments++] = q;
+      p += 2;
+    } else {
+      *q++ = *p++;
+    }
+  }
+  *q = '\0';
+
+  *glob = self;
+
+  return 0;
+}
+
+/**
+ * matches a name against a glob, which like the regex it comes from does
+ * not need to match the whole name unless it is anchored
+ *
+ * @param[in] self the glob
+ * @param[in] name the name
+ *
+ * @return 1 if the name matches
+ */
+
+static
+int bt_glob_match(const bt_glob_t * self, const char * name)
+{
+  const char * p = name, * limit = name + strlen(name), * q;
+  unsigned first = 0, last = self->nsegments;
+  size_t length;
+
+  if (self->anchored_start) {
+    length = strlen(self->segments[0]);
+    if (strncmp(p, self->segments[0], length) != 0)
+      return 0;
+    p += length;
+    first++;
+  }
+
+  if (self->anchored_end && first < last) {
+    length = strlen(self->segments[last - 1]);
+    if ((size_t) (limit - p) < length || memcmp(limit - length, self->segments[last - 1], length) != 0)
+      return 0;
+    limit -= length;
+    last--;
+  } else if (self->anchored_end && p != limit) {
+    return 0;
+  }
+
+  /* the leftmost match of every segment leaves the most room for the rest */
+  for (unsigned n = first; n < last; n++) {
+    length = strlen(self->segments[n]);
+    q = strstr(p, self->segments[n]);
+    if (!q || q + length > limit)
+      return 0;
+    p = q + length;
+  }
+
+  return 1;
+}
+
+/**
+ * adds a glob to the bucket of its prefix or suffix
+ *
+ * @param[in] self the prefixes or the suffixes of a matcher
+ * @param[in] arena where the buckets are allocated from
+ * @param[in] affix the prefix or suffix, a segment of glob
+ * @param[in] glob the glob
+ *
+ * @return the operation error code
+ */
+
+static
+int bt_affixes_add(bt_affixes_t * self, bt_arena_t * arena, const char * affix, bt_glob_t * glob)
+{
+  unsigned length = strlen(affix), n, k;
+  int err;
+
+  if (!self->table.slots) {
+    err = bt_table_init(&self->table, arena, 16);
+    if (err)
+      return_error(err);
+  }
+
+  n = bt_table_get(&self->table, 0, affix);
+  if (n != BT_NO_ID) {
+    glob->next = self->globs[n];
+    self->globs[n] = glob;
+    return 0;
+  }
+
+  /* both arrays double at powers of two, the old ones stay in the arena */
+  if ((self->count & (self->count - 1)) == 0) {
+    bt_glob_t ** globs = bt_arena_alloc(arena, sizeof(bt_glob_t *) * (self->count ? self->count * 2 : 1));
+    if (!globs)
+      return_error(ENOMEM);
+    if (self->count)
+      memcpy(globs, self->globs, sizeof(bt_glob_t *) * self->count);
+    self->globs = globs;
+  }
+
+  n = self->count++;
+  glob->next = NULL;
+  self->globs[n] = glob;
+
+  err = bt_table_add(&self->table, 0, affix, n);
+  if (err)
+    return_error(err);
+
+  for (k = 0; k < self->nlengths && self->lengths[k] != length; k++) ;
+  if (k < self->nlengths)
+    return 0;
+
+  if ((self->nlengths & (self->nlengths - 1)) == 0) {
+    unsigned * lengths = bt_arena_alloc(arena, sizeof(unsigned) * (self->nlengths ? self->nlengths * 2 : 1));
+    if (!lengths)
+      return_error(ENOMEM);
+    if (self->nlengths)
+      memcpy(lengths, self->lengths, sizeof(unsigned) * self->nlengths);
+    self->lengths = lengths;
+  }
+  self->lengths[self->nlengths++] = length;
+
+  return 0;
+}
+
+/**
+ * checks whether a name matches a glob of the buckets of its prefixes or
+ * suffixes
+ *
+ * @param[in] self the prefixes or the suffixes of a matcher
+ * @param[in] name the name
+ * @param[in] length the length of name
+ * @param[in] suffix whether self holds suffixes
+ *
+ * @return 1 if the name matches
+ */
+
+static
+int bt_affixes_match(const bt_affixes_t * self, const char * name, size_t length, int suffix)
+{
+  for (unsigned k = 0; k < self->nlengths; k++) {
+    size_t affix = self->lengths[k];
+    unsigned n;
+
+    if (affix > length)
+      continue;
+
+    n = bt_table_getn(&self->table, 0, suffix ? name + length - affix : name, affix);
+    if (n == BT_NO_ID)
+      continue;
+
+    for (const bt_glob_t * glob = self->globs[n]; glob; glob = glob->next) {
+      if (bt_glob_match(glob, name))
+        return 1;
+    }
+  }
+
+  return 0;
+}
+
+/**
+ * adds a pattern to a matcher
+ *
+ * @param[in] self the matcher
+ * @param[in] arena where globs are allocated from
+ * @param[in] pattern a regex
+ *
+ * @return the operation error code (EINVAL for a broken regex)
+ */
+
+static
+int bt_matcher_add(bt_matcher_t * self, bt_arena_t * arena, const char * pattern)
+{
+  bt_glob_t * glob;
+  regex_t regex;
+  size_t length;
+  char * source;
+  int err;
+
+  err = bt_glob_parse(arena, pattern, &glob);
+  if (!err && glob->anchored_start && glob->anchored_end && glob->nsegments == 1) {
+    if (!self->exact.slots) {
+      err = bt_table_init(&self->exact, arena, 16);
+      if (err)
+        return_error(err);
+    }
+    if (bt_table_get(&self->exact, 0, glob->segments[0]) != BT_NO_ID)
+      return 0;
+    return bt_table_add(&self->exact, 0, glob->segments[0], 0);
+  }
+  if (err && err != ENOENT)
+    return_error(err);
+
+  /* a glob with neither a literal start nor end would have to be tried on
+   * every name, the regex is no worse for it */
+  if (!err && glob->anchored_start && glob->segments[0][0])
+    return bt_affixes_add(&self->prefixes, arena, glob->segments[0], glob);
+  if (!err && glob->anchored_end && glob->segments[glob->nsegments - 1][0])
+    return bt_affixes_add(&self->suffixes, arena, glob->segments[glob->nsegments - 1], glob);
+
+  /* complain about a broken regex now, not when all of them are joined */
+  if (regcomp(&regex, pattern, REG_EXTENDED | REG_NOSUB)) {
+    fprintf(stderr, "invalid regex '%s'\n", pattern);
+    return_error(EINVAL);
+  }
+  regfree(&regex);
+
+  length = self->source ? strlen(self->source) : 0;
+  source = realloc(self->source, length + strlen(pattern) + 4);
+  if (!source)
+    return_error(ENOMEM);
+
+  sprintf(source + length, "%s(%s)", length ? "|" : "", pattern);
+  self->source = source;
+
+  return 0;
+}
+
+/**
+ * checks whether a name matches any pattern of a matcher
+ *
+ * @param[in] self the matcher
+ * @param[in] name the name
+ *
+ * @return 1 if the name matches
+ */
+
+static
+int bt_matcher_match(const bt_matcher_t * self, const char * name)
+{
+  size_t length = strlen(name);
+
+  if (self->exact.count && bt_table_get(&self->exact, 0, name) != BT_NO_ID)
+    return 1;
+
+  if (bt_affixes_match(&self->prefixes, name, length, 0)
+      || bt_affixes_match(&self->suffixes, name, length, 1))
+    return 1;
+
+  if (self->compiled)
+    return !regexec(&self->regex, name, 0, NULL, 0);
+
+  return 0;
+}
+
+static inline
+int bt_matcher_empty(const bt_matcher_t * self)
+{
+  return !self->exact.count && !self->prefixes.count && !self->suffixes.count && !self->source;
+}
+
+/**
+ * finds the slot of a name in the exact set
+ *
+ * @param[in] self the selector
+ * @param[in] key the hash of the name
+ * @param[in] parts the parts of the name
+ * @param[in] nparts the number of parts
+ *
+ * @return the slot holding the name or the free slot where it belongs
+ */
+
+static
+struct bt_selector_name * bt_selector_probe(const bt_selector_t * self, uint64_t key,
+    const char ** parts, unsigned nparts)
+{
+  struct bt_selector_name * slot;
+  const char * p;
+  size_t length;
+
+  for (unsigned i = key & self->mask;; i = (i + 1) & self->mask) {
+    slot = &self->names[i];
+    if (!slot->name)
+      return slot;
+    if (slot->key != key)
+      continue;
+
+    p = slot->name;
+    for (unsigned n = 0; p && n < nparts; n++) {
+      length = strlen(parts[n]);
+      if (strncmp(p, parts[n], length) != 0)
+        p = NULL;
+      else if (n + 1 < nparts)
+        p = p[length] == '/' ? p + length + 1 : NULL;
+      else if (p[length] != '\0')
+        p = NULL;
+    }
+    if (p)
+      return slot;
+  }
+}
+
+/**
+ * adds a name to the exact set
+ *
+ * @param[in] self the selector
+ * @param[in] name the name, as "<suite>/<test>" or "<elf>/<suite>/<test>",
+ * has to outlive the selector
+ *
+ * @return the operation error code
+ */
+
+static
+int bt_selector_add_name(bt_selector_t * self, const char * name)
+{
+  struct bt_selector_name * slot;
+  const char * parts[1] = {name};
+  const char * p;
+  unsigned nparts = 1;
+  uint64_t key;
+
+  for (p = name; (p = strchr(p, '/')); p++)
+    nparts++;
+  if (nparts != 2 && nparts != 3)
+    return_error(EINVAL);
+
+  if ((self->count + 1) * 2 > (self->names ? self->mask + 1 : 0)) {
+    unsigned nslots = self->names ? (self->mask + 1) * 2 : 64;
+    struct bt_selector_name * names, * old = self->names;
+    unsigned oldslots = self->names ? self->mask + 1 : 0;
+
+    names = calloc(nslots, sizeof(struct bt_selector_name));
+    if (!names)
+      return_error(ENOMEM);
+
+    self->names = names;
+    self->mask = nslots - 1;
+    for (unsigned n = 0; n < oldslots; n++) {
+      if (old[n].name)
+        *bt_selector_probe(self, old[n].key, &old[n].name, 1) = old[n];
+    }
+    free(old);
+  }
+
+  key = bt_fnv1a(BT_FNV_BASIS, name, strlen(name));
+  slot = bt_selector_probe(self, key, parts, 1);
+  if (slot->name)
+    return 0;
+
+  slot->key = key;
+  slot->name = name;
+  self->count++;
+  self->parts |= 1u << nparts;
+
+  return 0;
+}
+
+/**
+ * joins the regexes of the selector, has to be called after the last
+ * pattern was added and before the selector is used
+ *
+ * @param[in] self the selector
+ *
+ * @return the operation error code
+ */
+
+int bt_selector_compile(bt_selector_t * self)
+{
+  bt_matcher_t * matchers[4] = {
+    &self->suites[0], &self->suites[1], &self->tests[0], &self->tests[1],
+  };
+
+  if (!self)
+    return_error(EINVAL);
+
+  for (int i = 0; i < 4; i++) {
+    if (matchers[i]->compiled || !matchers[i]->source)
+      continue;
+    if (regcomp(&matchers[i]->regex, matchers[i]->source, REG_EXTENDED | REG_NOSUB))
+      return_error(EINVAL);
+    matchers[i]->compiled = 1;
+  }
+
+  return 0;
+}
+
+/**
+ * decides whether the tests of a suite are worth looking at
+ *
+ * @param[in] self the selector
+ * @param[in] suite the name of the suite
+ *
+ * @return 1 if the suite is selected
+ */
+
+int bt_selector_suite(const bt_selector_t * self, const char * suite)
+{
+  if (!bt_matcher_empty(&self->suites[0]) && !bt_matcher_match(&self->suites[0], suite))
+    return 0;
+
+  return !bt_matcher_match(&self->suites[1], suite);
+}
+
+/**
+ * decides whether a test of a selected suite runs
+ *
+ * @param[in] self the selector
+ * @param[in] elf the path of the shared object
+ * @param[in] suite the name of the suite
+ * @param[in] test the name of the test
+ *
+ * @return 1 if the test is selected
+ */
+
+int bt_selector_test(const bt_selector_t * self, const char * elf, const char * suite, const char * test)
+{
+  const char * parts[3];
+  uint64_t key;
+
+  if (!bt_matcher_empty(&self->tests[0]) && !bt_matcher_match(&self->tests[0], test))
+    return 0;
+
+  if (bt_matcher_match(&self->tests[1], test))
+    return 0;
+
+  if (!self->parts) /* no --select-file */
+    return 1;
+
+  parts[0] = strrchr(elf, '/') ? strrchr(elf, '/') + 1 : elf;
+  parts[1] = suite;
+  parts[2] = test;
+
+  if (self->parts & (1u << 2)) {
+    key = bt_fnv1a(BT_FNV_BASIS, suite, strlen(suite));
+    key = bt_fnv1a(key, "/", 1);
+    key = bt_fnv1a(key, test, strlen(test));
+    if (bt_selector_probe(self, key, parts + 1, 2)->name)
+      return 1;
+  }
+
+  if (self->parts & (1u << 3)) {
+    key = bt_test_key(elf, suite, test);
+    if (bt_selector_probe(self, key, parts, 3)->name)
+      return 1;
+  }
+
+  return 0;
+}
+
+/**
+ * decides whether a test runs by its size class and tags
+ *
+ * @param[in] self the selector
+ * @param[in] tags the size class and tags of the test
+ *
+ * @return 1 if the test is selected
+ */
+
+int bt_selector_tags(const bt_selector_t * self, uint32_t tags)
+{
+  unsigned size = 1u << bt_size_class(tags);
+
+  if ((self->sizes[0] && !(self->sizes[0] & size)) || (self->sizes[1] & size))
+    return 0;
+
+  if (self->tags[0] && !(self->tags[0] & tags))
+    return 0;
+
+  return !(self->tags[1] & tags);
+}
+
+/**
+ * releases what the selector holds outside of the arena
+ *
+ * @param[in] self the selector
+ */
+
+void bt_selector_clear(bt_selector_t * self)
+{
+  bt_matcher_t * matchers[4] = {
+    &self->suites[0], &self->suites[1], &self->tests[0], &self->tests[1],
+  };
+
+  for (int i = 0; i < 4; i++) {
+    if (matchers[i]->compiled)
+      regfree(&matchers[i]->regex);
+    free(matchers[i]->source);
+  }
+  free(self->names);
+
+  memset(self, 0, sizeof(bt_selector_t));
+}
+
+/**
+ * restricts the suites to run
+ *
+ * @param[in] self a pointer the butcher
+ * @param[in] pattern a regex the name of a suite has to match, or must not
+ * match if it starts with '!'
+ *
+ * @return the operation error code
+ */
+
+int bt_match_suite(bt_t * self, const char * pattern)
+{
+  if (!self || !pattern)
+    return_error(EINVAL);
+
+  if (pattern[0] == '!')
+    return bt_matcher_add(&self->selector.suites[1], &self->arena, pattern + 1);
+
+  return bt_matcher_add(&self->selector.suites[0], &self->arena, pattern);
+}
+
+/**
+ * restricts the tests to run
+ *
+ * @param[in] self a pointer the butcher
+ * @param[in] pattern a regex the name of a test has to match, or must not
+ * match if it starts with '!'
+ *
+ * @return the operation error code
+ */
+
+int bt_match_test(bt_t * self, const char * pattern)
+{
+  if (!self || !pattern)
+    return_error(EINVAL);
+
+  if (pattern[0] == '!')
+    return bt_matcher_add(&self->selector.tests[1], &self->arena, pattern + 1);
+
+  return bt_matcher_add(&self->selector.tests[0], &self->arena, pattern);
+}
+
+/**
+ * runs only the tests named in a file, one per line as "<suite>/<test>" or
+ * "<shared-object>/<suite>/<test>" (the names --history-stats and
+ * --show-log take), empty lines and lines starting with '#' are skipped
+ *
+ * @param[in] self a pointer the butcher
+ * @param[in] path the file or "-" for stdin
+ *
+ * @return the operation error code
+ */
+
+int bt_select_file(bt_t * self, const char * path)
+{
+  FILE * file;
+  char * line = NULL, * name;
+  size_t size = 0;
+  ssize_t length;
+  unsigned lineno = 0;
+  int err = 0;
+
+  if (!self || !path)
+    return_error(EINVAL);
+
+  file = strcmp(path, "-") == 0 ? stdin : fopen(path, "r");
+  if (!file) {
+    fprintf(stderr, "could not open selection '%s'\n", path);
+    return_error(errno);
+  }
+
+  while ((length = getline(&line, &size, file)) != -1) {
+    lineno++;
+    while (length > 0 && strchr(" \t\r\n", line[length - 1]))
+      line[--length] = '\0';
+    if (length == 0 || line[0] == '#')
+      continue;
+
+    name = bt_arena_strdup(&self->arena, line);
+    if (!name) {
+      err = ENOMEM;
+      break;
+    }
+
+    err = bt_selector_add_name(&self->selector, name);
+    if (err == EINVAL)
+      fprintf(stderr, "%s:%u: expected <suite>/<test> or <shared-object>/<suite>/<test>\n", path, lineno);
+    if (err)
+      break;
+  }
+
+  free(line);
+  if (file != stdin)
+    fclose(file);
+
+  if (err)
+    return_error(err);
+
+  /* an empty selection selects nothing, not everything */
+  if (!self->selector.count)
+    self->selector.parts |= 1;
+
+  return 0;
+}
+
+/**
+ * restricts the tests to run by size class and tags
+ *
+ * @param[in] self a pointer the butcher
+ * @param[in] tags a comma separated list of size classes and tags, a test
+ *  runs if it is of one of the size classes and has one of the tags listed,
+ *  unless it is of a size class or has a tag listed with a leading '!'
+ *
+ * @return the operation error code
+ */
+
+int bt_select_tags(bt_t * self, const char * tags)
+{
+  const char * p, * e;
+  size_t length;
+  int neg;
+
+  if (!self || !tags)
+    return_error(EINVAL);
+
+  for (p = tags; *p; p = *e ? e + 1 : e) {
+    unsigned n;
+
+    e = strchr(p, ',');
+    if (!e)
+      e = p + strlen(p);
+
+    neg = *p == '!';
+    if (neg)
+      p++;
+    length = e - p;
+    if (!length)
+      continue;
+
+    for (n = 0; n < BT_SIZE_CLASSES; n++) {
+      if (strlen(bt_size_names[n]) == length && strncmp(bt_size_names[n], p, length) == 0)
+        break;
+    }
+    if (n < BT_SIZE_CLASSES) {
+      self->selector.sizes[neg] |= 1u << n;
+      continue;
+    }
+
+    for (n = 0; n < BT_TAG_COUNT; n++) {
+      if (strlen(bt_tag_names[n]) == length && strncmp(bt_tag_names[n], p, length) == 0)
+        break;
+    }
+    if (n < BT_TAG_COUNT) {
+      self->selector.tags[neg] |= 1u << (BT_TAG_SHIFT + n);
+      continue;
+    }
+
+    fprintf(stderr, "unknown size class or tag '%.*s'\n", (int) length, p);
+    return_error(EINVAL);
+  }
+
+  return 0;
+}
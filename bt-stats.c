@@ -0,0 +1,245 @@
+/* @@SOURCE-HEADER@@ */
+
+#include "bt-private.h"
+
+#include <errno.h>
+#include <math.h>
+#include <stdlib.h>
+
+/*
+ * statistics of benchmark samples
+ *
+ * timings are skewed by the odd interruption, so the summary leans on
+ * order statistics: the median and the median absolute deviation instead
+ * of the mean and the standard deviation, which are there for reference;
+ * the confidence interval of the median is distribution free, it is taken
+ * from the ranks a binomial(n, 1/2) puts 95% of its mass between
+ *
+ * the medians of a benchmark over a range of input sizes are fitted to
+ * c * f(n) for every f by least squares, the f with the smallest root mean
+ * square of the residuals wins; the residuals are scaled by the mean of the
+ * medians, so the error reads as a fraction of the time
+ *
+ * whether a benchmark got slower is up to the Mann-Whitney U test, which
+ * asks no more of the samples than that they can be ranked
+ */
+
+const char * const bt_complexity_names[BT_O_MAX] = {
+  "O(1)", "O(log n)", "O(n)", "O(n log n)", "O(n^2)",
+};
+
+static
+double bt_stats_complexity(bt_complexity_t complexity, double n)
+{
+  switch (complexity) {
+    case BT_O_1:
+      return 1;
+    case BT_O_LOGN:
+      return log2(n);
+    case BT_O_N:
+      return n;
+    case BT_O_NLOGN:
+      return n * log2(n);
+    case BT_O_N2:
+      return n * n;
+    default:
+      return 0;
+  }
+}
+
+static
+int bt_stats_cmp(const void * a, const void * b)
+{
+  double x = *(const double *) a, y = *(const double *) b;
+
+  return x < y ? -1 : x > y;
+}
+
+/**
+ * returns the median of sorted samples
+ *
+ * @param[in] sorted the samples in ascending order
+ * @param[in] count the number of samples
+ *
+ * @return the median, 0 if there are no samples
+ */
+
+double bt_stats_median(const double * sorted, unsigned count)
+{
+  if (!count)
+    return 0;
+
+  if (count % 2)
+    return sorted[count / 2];
+
+  return (sorted[count / 2 - 1] + sorted[count / 2]) / 2;
+}
+
+/**
+ * summarizes the samples of a benchmark
+ *
+ * @param[in,out] samples the samples, sorted on return
+ * @param[in] count the number of samples
+ * @param[out] bench the summary, everything but operations is filled in
+ */
+
+void bt_stats_summary(double * samples, unsigned count, bt_bench_t * bench)
+{
+  double * deviations;
+  double sum = 0, squares = 0, half;
+  long low, high;
+
+  bench->nsamples = count;
+  bench->median = bench->mad = bench->mean = bench->stddev = 0;
+  bench->min = bench->max = bench->ci_low = bench->ci_high = 0;
+
+  if (!count)
+    return;
+
+  qsort(samples, count, sizeof(double), bt_stats_cmp);
+
+  bench->min = samples[0];
+  bench->max = samples[count - 1];
+  bench->median = bt_stats_median(samples, count);
+
+  for (unsigned n = 0; n < count; n++)
+    sum += samples[n];
+  bench->mean = sum / count;
+
+  for (unsigned n = 0; n < count; n++)
+    squares += (samples[n] - bench->mean) * (samples[n] - bench->mean);
+  bench->stddev = count > 1 ? sqrt(squares / (count - 1)) : 0;
+
+  deviations = malloc(sizeof(double) * count);
+  if (deviations) {
+    for (unsigned n = 0; n < count; n++)
+      deviations[n] = fabs(samples[n] - bench->median);
+    qsort(deviations, count, sizeof(double), bt_stats_cmp);
+    bench->mad = bt_stats_median(deviations, count);
+    free(deviations);
+  }
+
+  /* the normal approximation of the binomial, ranks are 0 based; with
+   * fewer than 6 samples that is all of them */
+  half = 1.96 * sqrt(count) / 2;
+  low = (long) floor(count / 2.0 - half);
+  high = (long) ceil(count / 2.0 + half) - 1;
+  if (low < 0)
+    low = 0;
+  if (high > (long) count - 1)
+    high = count - 1;
+
+  bench->ci_low = samples[low];
+  bench->ci_high = samples[high];
+}
+
+/**
+ * fits the medians of a benchmark over its input sizes to a complexity
+ *
+ * @param[in] bench the summaries, one per input size
+ * @param[in] count the number of summaries, at least 2
+ * @param[out] fit the complexity that fits best
+ *
+ * @return the operation error code
+ */
+
+int bt_stats_fit(const bt_bench_t * bench, unsigned count, bt_fit_t * fit)
+{
+  double mean = 0;
+
+  if (count < 2)
+    return_error(EINVAL);
+
+  for (unsigned k = 0; k < count; k++)
+    mean += bench[k].median;
+  mean /= count;
+
+  fit->complexity = BT_O_MAX;
+  fit->coefficient = 0;
+  fit->rms = INFINITY;
+
+  for (int o = BT_O_1; o < BT_O_MAX; o++) {
+    double tf = 0, ff = 0, squares = 0, c, rms;
+
+    for (unsigned k = 0; k < count; k++) {
+      double f = bt_stats_complexity(o, bench[k].n);
+      tf += bench[k].median * f;
+      ff += f * f;
+    }
+    if (ff == 0)
+      continue;
+    c = tf / ff;
+
+    for (unsigned k = 0; k < count; k++) {
+      double r = bench[k].median - c * bt_stats_complexity(o, bench[k].n);
+      squares += r * r;
+    }
+    rms = sqrt(squares / count) / (mean > 0 ? mean : 1);
+
+    /* the simpler complexity wins a tie */
+    if (rms < fit->rms) {
+      fit->complexity = o;
+      fit->coefficient = c;
+      fit->rms = rms;
+    }
+  }
+
+  return 0;
+}
+
+/**
+ * tests whether the samples of b tend to be larger than the ones of a, the
+ * one sided Mann-Whitney U test in the normal approximation; ties are
+ * counted half and left out of the variance, which errs on the side of
+ * calling a difference noise
+ *
+ * @param[in] a the samples before
+ * @param[in] na the number of samples before
+ * @param[in] b the samples after
+ * @param[in] nb the number of samples after
+ *
+ * @return the p-value, 1 if there is nothing to compare
+ */
+
+double bt_stats_mann_whitney(const double * a, unsigned na, const double * b, unsigned nb)
+{
+  double u = 0, mean, sigma;
+
+  if (!na || !nb)
+    return 1;
+
+  for (unsigned i = 0; i < na; i++) {
+    for (unsigned j = 0; j < nb; j++) {
+      if (b[j] > a[i])
+        u += 1;
+      else if (b[j] == a[i])
+        u += 0.5;
+    }
+  }
+
+  mean = (double) na * nb / 2;
+  sigma = sqrt((double) na * nb * (na + nb + 1) / 12);
+
+  /* with the continuity correction */
+  return erfc((u - mean - 0.5) / sigma / sqrt(2)) / 2;
+}
+
+/**
+ * tests whether the samples of a and b differ either way, the two sided
+ * Mann-Whitney U test
+ *
+ * @param[in] a the samples of one side
+ * @param[in] na the number of samples of a
+ * @param[in] b the samples of the other side
+ * @param[in] nb the number of samples of b
+ *
+ * @return the p-value, 1 if there is nothing to compare
+ */
+
+double bt_stats_difference(const double * a, unsigned na, const double * b, unsigned nb)
+{
+  double up = bt_stats_mann_whitney(a, na, b, nb), down = bt_stats_mann_whitney(b, nb, a, na);
+  double p = 2 * (up < down ? up : down);
+
+  return p < 1 ? p : 1;
+}
@@ -0,0 +1,393 @@
+/* @@SOURCE-HEADER@@ */
+
+#include "bt-private.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+/*
+ * streamed elfs
+ *
+ * generated test libraries can declare millions of tests, the registry of
+ * such an elf alone takes a lot of memory and building it takes a while,
+ * so a streamed elf is run in the order its records are in, one test at a
+ * time (see BT_FLAG_STREAM); what it costs does not depend on the number
+ * of tests, except for the fixtures that are not right before their test
+ */
+
+static inline
+int bt_stream_is_test(const bt_fn_t * fn)
+{
+  unsigned kind = fn->flags & BT_FN_KIND_MASK;
+
+  return kind == BT_FN_KIND_PTEST || kind == BT_FN_KIND_FTEST || kind == BT_FN_KIND_BENCH;
+}
+
+static inline
+int bt_stream_is_fixture(const bt_fn_t * fn)
+{
+  unsigned kind = fn->flags & BT_FN_KIND_MASK;
+
+  return kind == BT_FN_KIND_SETUP || kind == BT_FN_KIND_TEARDOWN;
+}
+
+static inline
+const char * bt_stream_suite(const bt_fn_t * fn)
+{
+  return fn->extra ? fn->extra : "(nil)";
+}
+
+/**
+ * tells whether two records are about the same test
+ */
+
+static inline
+int bt_stream_same(const bt_fn_t * a, const bt_fn_t * b)
+{
+  return strcmp(a->name, b->name) == 0 && strcmp(bt_stream_suite(a), bt_stream_suite(b)) == 0;
+}
+
+/**
+ * computes the key of a test in the side index
+ *
+ * @param[in] fn a record of the test
+ *
+ * @return the key
+ */
+
+static
+uint64_t bt_stream_key(const bt_fn_t * fn)
+{
+  const char * suite = bt_stream_suite(fn);
+  uint64_t h;
+
+  /* with the terminator of the suite */
+  h = bt_fnv1a(BT_FNV_BASIS, suite, strlen(suite) + 1);
+  h = bt_fnv1a(h, fn->name, strlen(fn->name));
+
+  return h;
+}
+
+static
+int bt_stream_fixture_cmp(const void * a, const void * b)
+{
+  const bt_stream_fixture_t * fa = a, * fb = b;
+
+  if (fa->key != fb->key)
+    return fa->key < fb->key ? -1 : 1;
+  return fa->id < fb->id ? -1 : fa->id > fb->id;
+}
+
+/**
+ * returns a record of a streamed elf, the window is moved if the record is
+ * not in it, so that the records before it can still be looked at
+ *
+ * @param[in] elf the elf
+ * @param[in] id the record
+ * @param[out] fn a pointer to a pointer to hold the record, which is good
+ *  until the window moves
+ *
+ * @return the operation error code
+ */
+
+static
+int bt_stream_fetch(bt_elf_t * elf, unsigned id, const bt_fn_t ** fn)
+{
+  bt_stream_t * self = elf->stream;
+  int err;
+
+  if (id < self->first || id - self->first >= self->count) {
+    self->first = id > BT_STREAM_LOOKBEHIND ? id - BT_STREAM_LOOKBEHIND : 0;
+    self->count = elf->fncount - self->first < BT_STREAM_WINDOW ? elf->fncount - self->first : BT_STREAM_WINDOW;
+
+    err = bt_elf_read(elf, self->first, self->window, self->count);
+    if (err) {
+      self->count = 0;
+      return_error(err);
+    }
+  }
+
+  *fn = &self->window[id - self->first];
+
+  return 0;
+}
+
+/**
+ * scans the records of an elf to be streamed and puts the fixtures that
+ * are not found by looking behind their test into the side index
+ *
+ * @param[in] elf the elf, which has not been loaded yet
+ *
+ * @return the operation error code
+ */
+
+int bt_stream_open(bt_elf_t * elf)
+{
+  bt_stream_t * self;
+  bt_fn_t fn;
+  const bt_fn_t * cur;
+  unsigned size = 0;
+  int err;
+
+  if (!elf || elf->stream)
+    return_error(EINVAL);
+
+  self = bt_arena_alloc(elf->arena, sizeof(bt_stream_t));
+  if (!self)
+    return_error(ENOMEM);
+
+  memset(self, 0, sizeof(bt_stream_t));
+
+  elf->stream = self;
+
+  err = bt_elf_sections(elf);
+  if (err)
+    goto failure;
+
+  /* the registry of the test at hand */
+  elf->suites = bt_arena_alloc(elf->arena, sizeof(bt_suite_t));
+  elf->ids = bt_arena_alloc(elf->arena, sizeof(unsigned));
+  elf->kinds = bt_arena_alloc(elf->arena, 1);
+  elf->tags = bt_arena_alloc(elf->arena, sizeof(uint32_t));
+  elf->setupids = bt_arena_alloc(elf->arena, sizeof(unsigned));
+  elf->teardownids = bt_arena_alloc(elf->arena, sizeof(unsigned));
+  elf->names = bt_arena_alloc(elf->arena, sizeof(uint32_t));
+  elf->results = bt_arena_alloc(elf->arena, sizeof(*elf->results));
+  elf->tests = bt_arena_alloc(elf->arena, sizeof(bt_test_t));
+  if (!elf->suites || !elf->ids || !elf->kinds || !elf->tags || !elf->setupids || !elf->teardownids
+      || !elf->names || !elf->results || !elf->tests) {
+    err = ENOMEM;
+    goto failure;
+  }
+
+  memset(elf->tests, 0, sizeof(bt_test_t));
+
+  for (unsigned id = 0; id < elf->fncount; id++) {
+    err = bt_stream_fetch(elf, id, &cur);
+    if (err)
+      goto failure;
+    if (!bt_stream_is_fixture(cur))
+      continue;
+
+    fn = *cur;
+
+    unsigned ahead = 1;
+    for (; ahead <= BT_STREAM_LOOKBEHIND && id + ahead < elf->fncount; ahead++) {
+      err = bt_stream_fetch(elf, id + ahead, &cur);
+      if (err)
+        goto failure;
+      if (bt_stream_is_test(cur) && bt_stream_same(cur, &fn))
+        break;
+    }
+    if (ahead <= BT_STREAM_LOOKBEHIND && id + ahead < elf->fncount)
+      continue;
+
+    if (self->nfixtures == size) {
+      bt_stream_fixture_t * fixtures = realloc(self->fixtures, sizeof(bt_stream_fixture_t) * (size ? size * 2 : 16));
+      if (!fixtures) {
+        err = ENOMEM;
+        goto failure;
+      }
+      self->fixtures = fixtures;
+      size = size ? size * 2 : 16;
+    }
+
+    self->fixtures[self->nfixtures].key = bt_stream_key(&fn);
+    self->fixtures[self->nfixtures].id = id;
+    self->nfixtures++;
+  }
+
+  qsort(self->fixtures, self->nfixtures, sizeof(bt_stream_fixture_t), bt_stream_fixture_cmp);
+
+  return 0;
+
+failure:
+  bt_stream_close(elf);
+  return_error(err);
+}
+
+/**
+ * starts over with the first test of a streamed elf
+ *
+ * @param[in] elf the elf
+ *
+ * @return the operation error code
+ */
+
+int bt_stream_rewind(bt_elf_t * elf)
+{
+  if (!elf || !elf->stream)
+    return_error(EINVAL);
+
+  elf->stream->next = 0;
+  memset(elf->stream->results, 0, sizeof(elf->stream->results));
+
+  return 0;
+}
+
+/**
+ * assigns a fixture to the test at hand, a test has one setup and one
+ * teardown at most, like in a loaded elf (see bt_elf_assign_fixture)
+ *
+ * @param[in] elf the elf
+ * @param[in] fixture the record of the fixture
+ * @param[in] id the id of the fixture
+ *
+ * @return the operation error code
+ */
+
+static
+int bt_stream_assign(bt_elf_t * elf, const bt_fn_t * fixture, unsigned id)
+{
+  bt_fn_kind_t kind = fixture->flags & BT_FN_KIND_MASK;
+  unsigned * ids = kind == BT_FN_KIND_SETUP ? elf->setupids : elf->teardownids;
+
+  if (ids[0] != BT_NO_ID && ids[0] != id) {
+    fprintf(stderr, "attempted to redefine %s function for test %s\n",
+        kind == BT_FN_KIND_SETUP ? "setup" : "teardown", fixture->name);
+    return_error(EINVAL);
+  }
+  ids[0] = id;
+
+  return 0;
+}
+
+/**
+ * looks up the fixtures of the test at hand in the side index
+ *
+ * @param[in] elf the elf
+ * @param[in] fn the record of the test
+ *
+ * @return the operation error code
+ */
+
+static
+int bt_stream_lookup(bt_elf_t * elf, const bt_fn_t * fn)
+{
+  bt_stream_t * self = elf->stream;
+  uint64_t key = bt_stream_key(fn);
+  unsigned lo = 0, hi = self->nfixtures;
+  bt_fn_t fixture;
+  int err;
+
+  while (lo < hi) {
+    unsigned mid = lo + (hi - lo) / 2;
+    if (self->fixtures[mid].key < key)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+
+  /* the window is left alone, the test still lives there */
+  for (; lo < self->nfixtures && self->fixtures[lo].key == key; lo++) {
+    err = bt_elf_read(elf, self->fixtures[lo].id, &fixture, 1);
+    if (err)
+      return_error(err);
+    if (!bt_stream_same(&fixture, fn))
+      continue;
+    err = bt_stream_assign(elf, &fixture, self->fixtures[lo].id);
+    if (err)
+      return_error(err);
+  }
+
+  return 0;
+}
+
+/**
+ * moves a streamed elf on to its next test, which is the only one in the
+ * registry of the elf afterwards; whatever was kept about the previous
+ * test is gone
+ *
+ * @param[in] elf the elf
+ *
+ * @return the operation error code (ENOENT if there are no more tests,
+ *  EINVAL if the test has two setups or two teardowns)
+ */
+
+int bt_stream_next(bt_elf_t * elf)
+{
+  bt_stream_t * self;
+  const bt_fn_t * cur;
+  bt_fn_t fn;
+  unsigned id;
+  int err;
+
+  if (!elf || !elf->stream)
+    return_error(EINVAL);
+
+  self = elf->stream;
+
+  if (elf->ntests && elf->tests[0].log)
+    bt_log_delete(&elf->tests[0].log);
+  memset(elf->tests, 0, sizeof(bt_test_t));
+  bt_arena_release(&self->scratch);
+  elf->nsuites = elf->ntests = 0;
+
+  for (id = self->next; id < elf->fncount; id++) {
+    err = bt_stream_fetch(elf, id, &cur);
+    if (err)
+      return_error(err);
+    if (bt_stream_is_test(cur))
+      break;
+  }
+  if (id == elf->fncount) {
+    self->next = id;
+    return ENOENT;
+  }
+
+  fn = *cur;
+
+  elf->ids[0] = id;
+  elf->kinds[0] = fn.flags & BT_FN_KIND_MASK;
+  elf->tags[0] = fn.flags & ~BT_FN_KIND_MASK;
+  elf->names[0] = fn.name - elf->strings;
+  elf->setupids[0] = BT_NO_ID;
+  elf->teardownids[0] = BT_NO_ID;
+  memset(elf->results[0], BT_TEST_NONE, BT_PASS_MAX);
+
+  elf->suites[0].name = fn.extra ? (uint32_t) (fn.extra - elf->strings) : BT_NO_NAME;
+  elf->suites[0].first = 0;
+  elf->suites[0].count = 1;
+
+  /* the records before the test are still in the window, the fixtures
+   * there and in the side index must not clash */
+  for (unsigned behind = 1; behind <= BT_STREAM_LOOKBEHIND && behind <= id; behind++) {
+    err = bt_stream_fetch(elf, id - behind, &cur);
+    if (err)
+      return_error(err);
+    if (!bt_stream_is_fixture(cur) || !bt_stream_same(cur, &fn))
+      continue;
+    err = bt_stream_assign(elf, cur, id - behind);
+    if (err)
+      return_error(err);
+  }
+
+  if (self->nfixtures) {
+    err = bt_stream_lookup(elf, &fn);
+    if (err)
+      return_error(err);
+  }
+
+  elf->nsuites = elf->ntests = 1;
+  self->next = id + 1;
+
+  return 0;
+}
+
+/**
+ * drops what a streamed elf has besides its arena
+ *
+ * @param[in] elf the elf
+ */
+
+void bt_stream_close(bt_elf_t * elf)
+{
+  if (!elf || !elf->stream)
+    return;
+
+  free(elf->stream->fixtures);
+  elf->stream->fixtures = NULL;
+  elf->stream->nfixtures = 0;
+  bt_arena_release(&elf->stream->scratch);
+}
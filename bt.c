@@ -2,6 +2,9 @@
 
 #include "bt-private.h"
 
+#include <limits.h>
+#include <signal.h>
+#include <stddef.h>
 #include <stdio.h>
 #include <unistd.h>
 #include <string.h>
@@ -9,24 +12,18 @@
 #include <stdlib.h>
 
 #include <fcntl.h>
-#include <dlfcn.h>
+#include <sched.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <time.h>
 
-/*************************************************/
-
-#define RED "\033[1;31m"
-#define GREEN "\033[1;32m"
-#define YELLOW "\033[1;33m"
-#define BLUE "\033[1;34m"
-#define PURPLE "\033[1;35m"
-#define CYAN "\033[1;36m"
+#include <linux/perf_event.h>
 
-#define RED_BG "\033[2;41m"
-#define CYAN_BG "\033[2;46m"
-
-#define ENDCOL "\033[0m"
+/*************************************************/
 
 #define _hash_rot(x, k) \
   (((x) << (k)) | ((x) >> (32 - (k))))
@@ -96,10 +93,286 @@ unsigned hash(const void * key, size_t length, unsigned initval)
 
 #define BT_HASH_SALT 777
 
-/* this ias a stup to we can load test using it */
-void bt_backtrace()
+/*************************************************/
+
+#define BT_ARENA_CHUNK (64 * 1024)
+#define BT_ARENA_ALIGN 16
+
+/**
+ * allocates memory from an arena, the memory is not initialized and
+ * can only be given back with the whole arena
+ *
+ * @param[in] self the arena
+ * @param[in] size the number of bytes to allocate
+ *
+ * @return a pointer to the memory or NULL
+ */
+
+void * bt_arena_alloc(bt_arena_t * self, size_t size)
+{
+  bt_arena_chunk_t * chunk = self->chunks;
+  void * ptr;
+
+  size = (size + BT_ARENA_ALIGN - 1) & ~(size_t) (BT_ARENA_ALIGN - 1);
+
+  if (!chunk || chunk->size - chunk->used < size) {
+    size_t chunksize = size > BT_ARENA_CHUNK / 4 ? size : BT_ARENA_CHUNK;
+
+    chunk = malloc(sizeof(bt_arena_chunk_t) + chunksize);
+    if (!chunk)
+      return NULL;
+
+    chunk->size = chunksize;
+    chunk->used = 0;
+
+    /* a large block gets a chunk of its own, which must not replace
+     * the one that is being filled */
+    if (chunksize == size && self->chunks) {
+      chunk->next = self->chunks->next;
+      self->chunks->next = chunk;
+    } else {
+      chunk->next = self->chunks;
+      self->chunks = chunk;
+    }
+  }
+
+  ptr = chunk->data + chunk->used;
+  chunk->used += size;
+
+  return ptr;
+}
+
+/**
+ * copies a string into an arena
+ *
+ * @param[in] self the arena
+ * @param[in] str the string
+ *
+ * @return the copy or NULL
+ */
+
+char * bt_arena_strdup(bt_arena_t * self, const char * str)
+{
+  size_t length = strlen(str) + 1;
+  char * copy;
+
+  copy = bt_arena_alloc(self, length);
+  if (copy)
+    memcpy(copy, str, length);
+
+  return copy;
+}
+
+/**
+ * formats a string into an arena
+ *
+ * @param[in] self the arena
+ * @param[in] format a printf() format
+ *
+ * @return the string or NULL
+ */
+
+char * bt_arena_printf(bt_arena_t * self, const char * format, ...)
+{
+  va_list args;
+  char * str;
+  int length;
+
+  va_start(args, format);
+  length = vsnprintf(NULL, 0, format, args);
+  va_end(args);
+  if (length < 0)
+    return NULL;
+
+  str = bt_arena_alloc(self, length + 1);
+  if (!str)
+    return NULL;
+
+  va_start(args, format);
+  vsnprintf(str, length + 1, format, args);
+  va_end(args);
+
+  return str;
+}
+
+/**
+ * moves everything allocated from an arena to another one, which gives it
+ * back when it is released itself
+ *
+ * @param[in] self the arena to take over
+ * @param[in] other the arena to empty
+ */
+
+void bt_arena_merge(bt_arena_t * self, bt_arena_t * other)
+{
+  bt_arena_chunk_t * last;
+
+  if (!other->chunks)
+    return;
+
+  /* the chunk being filled stays in front */
+  for (last = other->chunks; last->next; last = last->next) ;
+  if (self->chunks) {
+    last->next = self->chunks->next;
+    self->chunks->next = other->chunks;
+  } else {
+    self->chunks = other->chunks;
+  }
+
+  other->chunks = NULL;
+}
+
+/**
+ * gives back everything allocated from an arena
+ *
+ * @param[in] self the arena
+ */
+
+void bt_arena_release(bt_arena_t * self)
+{
+  bt_arena_chunk_t * cur, * tmp;
+
+  cur = self->chunks;
+  while (cur) {
+    tmp = cur->next;
+    free(cur);
+    cur = tmp;
+  }
+
+  self->chunks = NULL;
+}
+
+/*************************************************/
+
+/**
+ * prepares an empty table with room for a number of names
+ *
+ * @param[in] self the table
+ * @param[in] arena where the slots are allocated from
+ * @param[in] count the number of names expected
+ *
+ * @return the operation error code
+ */
+
+int bt_table_init(bt_table_t * self, bt_arena_t * arena, unsigned count)
+{
+  unsigned nslots = 16;
+
+  while (nslots < count * 2)
+    nslots *= 2;
+
+  self->arena = arena;
+  self->slots = bt_arena_alloc(arena, sizeof(bt_table_slot_t) * nslots);
+  if (!self->slots)
+    return_error(ENOMEM);
+
+  memset(self->slots, 0, sizeof(bt_table_slot_t) * nslots);
+  self->mask = nslots - 1;
+  self->count = 0;
+
+  return 0;
+}
+
+static
+bt_table_slot_t * bt_table_probe(const bt_table_t * self, unsigned scope, const char * name, size_t length,
+    unsigned h)
+{
+  bt_table_slot_t * slot;
+
+  for (unsigned i = h & self->mask;; i = (i + 1) & self->mask) {
+    slot = &self->slots[i];
+    if (!slot->value || (slot->hash == h && slot->scope == scope
+          && strncmp(slot->name, name, length) == 0 && slot->name[length] == '\0'))
+      return slot;
+  }
+}
+
+/**
+ * looks up a name in a table
+ *
+ * @param[in] self the table
+ * @param[in] scope the scope of the name
+ * @param[in] name the name
+ *
+ * @return the value of the name or BT_NO_ID
+ */
+
+unsigned bt_table_get(const bt_table_t * self, unsigned scope, const char * name)
+{
+  return bt_table_getn(self, scope, name, strlen(name));
+}
+
+/**
+ * looks up the first characters of a string in a table
+ *
+ * @param[in] self the table
+ * @param[in] scope the scope of the name
+ * @param[in] name the string
+ * @param[in] length the length of the name within the string
+ *
+ * @return the value of the name or BT_NO_ID
+ */
+
+unsigned bt_table_getn(const bt_table_t * self, unsigned scope, const char * name, size_t length)
+{
+  bt_table_slot_t * slot;
+
+  if (!self->count)
+    return BT_NO_ID;
+
+  slot = bt_table_probe(self, scope, name, length, hash(name, length, BT_HASH_SALT + scope));
+
+  return slot->value ? slot->value - 1 : BT_NO_ID;
+}
+
+/**
+ * adds a name to a table (see bt_table_init()), the table is doubled
+ * when it is half full
+ *
+ * @param[in] self the table
+ * @param[in] scope the scope of the name, names are unique within a scope
+ * @param[in] name the name, has to outlive the table
+ * @param[in] value the value of the name
+ *
+ * @return the operation error code (EINVAL if the name is taken)
+ */
+
+int bt_table_add(bt_table_t * self, unsigned scope, const char * name, unsigned value)
 {
+  bt_table_slot_t * slot;
+  unsigned h;
+
+  if ((self->count + 1) * 2 > self->mask + 1) {
+    unsigned nslots = (self->mask + 1) * 2;
+    bt_table_slot_t * slots, * old = self->slots;
+    unsigned oldslots = self->mask + 1;
+
+    /* the old slots stay in the arena, so size the table upfront */
+    slots = bt_arena_alloc(self->arena, sizeof(bt_table_slot_t) * nslots);
+    if (!slots)
+      return_error(ENOMEM);
+
+    memset(slots, 0, sizeof(bt_table_slot_t) * nslots);
+    self->slots = slots;
+    self->mask = nslots - 1;
+    for (unsigned n = 0; n < oldslots; n++) {
+      if (old[n].value)
+        *bt_table_probe(self, old[n].scope, old[n].name, strlen(old[n].name), old[n].hash) = old[n];
+    }
+  }
+
+  h = hash(name, strlen(name), BT_HASH_SALT + scope);
+  slot = bt_table_probe(self, scope, name, strlen(name), h);
+  if (slot->value)
+    return_error(EINVAL);
+
+  slot->name = name;
+  slot->hash = h;
+  slot->scope = scope;
+  slot->value = value + 1;
+  self->count++;
 
+  return 0;
 }
 
 /**
@@ -251,6 +524,37 @@ int bt_log_msgcpy(bt_log_t * self, const char * msg, ssize_t len)
   return 0;
 }
 
+/**
+ * splits a buffer into lines and appends them to the log
+ *
+ * @param[in] self a pointer holding the log
+ * @param[in] buffer the buffer to split (line breaks are '\n', '\r' or '\0')
+ * @param[in] length the size of buffer
+ *
+ * @return the operation error code
+ */
+
+int bt_log_parse(bt_log_t * self, const char * buffer, size_t length)
+{
+  size_t i, n;
+  char c;
+  int err;
+
+  if (!self || (length && !buffer))
+    return_error(EINVAL);
+
+  i = 0;
+  while (i < length) {
+    for (n = i; n < length && (c = buffer[n]) != '\n' && c != '\r' && c != '\0'; n++) ;
+    err = bt_log_msgcpy(self, buffer + i, n - i);
+    if (err)
+      return_error(err);
+    i = n + 1;
+  }
+
+  return 0;
+}
+
 /**
  * deletes a log
  *
@@ -282,538 +586,425 @@ int bt_log_delete(bt_log_t ** log)
 }
 
 /**
- * deletes a test not touching anything else
+ * deletes an elf descriptor, i.e. unmaps the shared object and drops the
+ * logs of its tests; the registry itself belongs to the arena of the
+ * butcher
  *
- * @param[in] test a pointer to a pointer holding the test
+ * @param[in] elf a pointer to a pointer holding the elf
  *
  * @return the operation error code
  */
 
-int bt_test_delete(bt_test_t ** test)
+int bt_elf_delete(bt_elf_t ** elf)
 {
-  bt_test_t * self;
+  bt_elf_t * self;
 
-  if (!test || !*test)
+  if (!elf || !*elf)
     return_error(EINVAL);
 
-  self = *test;
+  self = *elf;
+
+  if (self->tests) {
+    for (unsigned t = 0; t < self->ntests; t++) {
+      if (self->tests[t].log)
+        bt_log_delete(&self->tests[t].log);
+    }
+  }
 
-  free(self->name);
-  if (self->log)
-    bt_log_delete(&self->log);
+  if (self->manifest)
+    munmap(self->manifest, self->manifest_size);
 
-  free(self);
+  bt_stream_close(self);
+
+  if (self->image)
+    bt_image_close(&self->image);
+
+  *elf = NULL;
 
   return 0;
 }
 
-
 /**
- * creates a new test for a given suite which is is intended to run function
- * indicated by dlname
+ * creates a new descriptor for a shared object
  *
- * @param[out] test a pointer to a pointer to hold the test
- * @param[in] id function if of the test
- * @param[in] kind kind of function to call
- * @param[in] name name of the test
+ * @param[out] elf a pointer to a pointer to hold the elf
+ * @param[in] butcher the butcher the elf belongs to
+ * @param[in] arena where the elf and its registry are allocated from
+ * @param[in] elfname filename of the shared object to map
  *
  * @return the operation error code
  */
 
-static
-int bt_test_new(bt_test_t ** test, unsigned id, bt_fn_kind_t kind, const char * name)
+int bt_elf_new(bt_elf_t ** elf, bt_t * butcher, bt_arena_t * arena, const char * elfname)
 {
-  bt_test_t * self;
+  bt_elf_t * self;
+  size_t size;
   int err;
 
-
-  if (!test)
+  if (!elf || !butcher || !arena || !elfname)
     return_error(EINVAL);
 
-  self = malloc(sizeof(bt_test_t));
+  self = bt_arena_alloc(arena, sizeof(bt_elf_t));
   if (!self)
     return_error(ENOMEM);
 
-  memset(self, 0, sizeof(bt_test_t));
+  memset(self, 0, sizeof(bt_elf_t));
 
   self->next = NULL;
-  memset(self->results, BT_TEST_NONE, BT_PASS_MAX);
-  self->log = NULL;
 
-  self->id = id;
-  self->kind = kind;
+  self->butcher = butcher;
+  self->arena = arena;
 
-  self->name = strdup(name);
+  self->name = bt_arena_strdup(arena, elfname);
   if (!self->name) {
     err = ENOMEM;
     goto failure;
   }
 
-  self->setupid = BT_NO_ID;
-  self->teardownid = BT_NO_ID;
+  /* the object is only ever loaded by bexec, the butcher just reads it,
+   * so neither relocations nor constructors run here */
+  err = bt_image_open(&self->image, self->name);
+  if (err) {
+    fprintf(self->butcher->fd, "could not open shared object '%s': %s\n", elfname,
+        err == ENOEXEC ? "not an ELF64 object" : strerror(err));
+    err = ENFILE;
+    goto failure;
+  }
+
+  self->strings = bt_image_data(self->image, &size);
+  if (size >= BT_NO_NAME) {
+    fprintf(self->butcher->fd, "shared object '%s' is too large\n", elfname);
+    err = EFBIG;
+    goto failure;
+  }
 
-  *test = self;
+  *elf = self;
 
   return 0;
 
-failure:
-  bt_test_delete(&self);
-  return_error(err);
+failure: {
+    bt_elf_delete(&self);
+    return_error(err);
+  }
 }
 
 /**
- * recursively deletes a test suite (i.e. the suite and its tests, logs, results)
+ * assigns a fixture function to an already registered test
  *
- * @param[in] suite a pointer to a pointer holding the suite
+ * @param[in] self an elf to search for suite and test
+ * @param[in] id the id of the fixture function
+ * @param[in] fn a function specifier
  *
  * @return the operation error code
+ *
+ * i.e. self[fn->extra][fn->name].setupid = id
  */
 
-int bt_suite_delete(bt_suite_t ** suite)
+static
+int bt_elf_assign_fixture(bt_elf_t * self, unsigned id, const bt_fn_t * fn)
 {
-  bt_suite_t * self;
-  bt_test_t * cur, * tmp;
-  unsigned n;
-
-  if (!suite || !*suite)
-    return_error(EINVAL);
-
-  self = *suite;
-
-  for (n = 0; n <self->hsize; n++) {
-    cur = self->htests[n];
-    while (cur) {
-      tmp = cur->next;
-      bt_test_delete(&cur);
-      cur = tmp;
-    }
+  bt_fn_kind_t kind = fn->flags & BT_FN_KIND_MASK;
+  unsigned s, t, * ids;
+
+  s = bt_table_get(&self->index, BT_NO_ID, fn->extra ? fn->extra : "(nil)");
+  if (s == BT_NO_ID)
+    return EINVAL;
+
+  t = bt_table_get(&self->index, s, fn->name);
+  if (t == BT_NO_ID)
+    return EINVAL;
+
+  ids = kind == BT_FN_KIND_SETUP ? self->setupids : self->teardownids;
+  if (ids[t] != BT_NO_ID) {
+    fprintf(stderr, "attempted to redefine %s function for test %s\n",
+        kind == BT_FN_KIND_SETUP ? "setup" : "teardown", fn->name);
+    return EINVAL;
   }
-  free(self->htests);
-
-  free(self->name);
-
-  free(self);
+  ids[t] = id;
 
   return 0;
 }
 
 /**
- * creates an empty suite
+ * looks up the record sections in the image of an elf
  *
- * @param[out] suite a pointer to a pointer to hold the suite
- * @param[in] name an unique name for the suite
+ * @param[in] self the elf
  *
  * @return the operation error code
  */
 
-static
-int bt_suite_new(bt_suite_t ** suite, const char * name)
+int bt_elf_sections(bt_elf_t * self)
 {
-  bt_suite_t * self;
-  int err;
-
-  if (!suite)
-    return_error(EINVAL);
-
-  self = malloc(sizeof(bt_suite_t));
-  if (!self)
-    return_error(ENOMEM);
+  uint64_t addr, caddr;
+  size_t size, csize;
+  int err, cerr;
 
-  memset(self, 0, sizeof(bt_suite_t));
-
-  self->name = strdup(name);
-  if (!self->name) {
-    err = ENOMEM;
-    goto failure;
+  err = bt_image_section(self->image, "bexec", &addr, &size);
+  cerr = bt_image_section(self->image, "bexec_compact", &caddr, &csize);
+  if (err && cerr) {
+    fprintf(stderr, "shared object does not export a test section\n");
+    return_error(ENFILE);
   }
+  if (err)
+    addr = size = 0;
+  if (cerr)
+    caddr = csize = 0;
 
-  self->htests = malloc(sizeof(bt_test_t *) * 128);
-  if (!self->htests) {
-    err = ENOMEM;
-    goto failure;
+  if (size % sizeof(bt_fn_t) || csize % sizeof(bt_rec_t)
+      || size / sizeof(bt_fn_t) + csize / sizeof(bt_rec_t) >= BT_NO_ID) {
+    fprintf(stderr, "shared object does not export a valid test section\n");
+    return_error(ENFILE);
   }
-  memset(self->htests, 0, sizeof(bt_test_t *) * 128);
-  self->hsize = 128;
 
-  *suite = self;
+  self->recaddr = addr;
+  self->compactaddr = caddr;
+  self->nrecs = size / sizeof(bt_fn_t);
+  self->fncount = self->nrecs + csize / sizeof(bt_rec_t);
 
   return 0;
-
-failure:
-  bt_suite_delete(&self);
-  return_error(err);
 }
 
 /**
- * adds a teat to a suite using test->name as key
+ * reads records from the image of an elf, as far as the butcher is
+ * concerned: names point into the image and functions are left as
+ * addresses, compact records are turned into the same
  *
- * @param[in] self the suite to add the test to
- * @param[in] suite the test to add
+ * @param[in] self the elf
+ * @param[in] first the first record to read
+ * @param[out] fns a buffer to hold the records
+ * @param[in] count the number of records to read
  *
  * @return the operation error code
  */
 
-int bt_suite_add_test(bt_suite_t * self, bt_test_t * test)
+int bt_elf_read(bt_elf_t * self, unsigned first, bt_fn_t * fns, unsigned count)
 {
-  unsigned h, idx;
-
-  h = hash(test->name, strlen(test->name), BT_HASH_SALT);
-  idx = h % self->hsize;
-  test->next = self->htests[idx];
-  self->htests[idx] = test;
-
-  return 0;
-}
+  unsigned n = 0;
+  int err;
 
+  if (first < self->nrecs) {
+    n = self->nrecs - first < count ? self->nrecs - first : count;
+    err = bt_image_read(self->image, self->recaddr + (uint64_t) first * sizeof(bt_fn_t), fns, n * sizeof(bt_fn_t));
+    if (err) {
+      fprintf(stderr, "shared object does not export a valid test section\n");
+      return_error(ENFILE);
+    }
+  }
 
-/**
- * gets a suite form the elf hashmap
- *
- * @param[in] elf a pointer to an elf
- * @param[in] name name of the suite to get
- *
- * @return the suite of NULL
- */
+  /* nothing to relocate in there, the offsets are added here instead */
+  for (unsigned c = n; c < count; c++) {
+    uint64_t addr = self->compactaddr + (uint64_t) (first + c - self->nrecs) * sizeof(bt_rec_t);
+    bt_rec_t rec;
 
-bt_test_t * bt_suite_get_test(bt_suite_t * self, const char * name)
-{
-  unsigned h, idx;
-  bt_test_t * test;
+    err = bt_image_read(self->image, addr, &rec, sizeof(rec));
+    if (err) {
+      fprintf(stderr, "shared object does not export a valid test section\n");
+      return_error(ENFILE);
+    }
 
-  h = hash(name, strlen(name), BT_HASH_SALT);
-  idx = h % self->hsize;
-  test = self->htests[idx];
-  while (test) {
-    if (strcmp(test->name, name) == 0)
-      return test;
+    fns[c].name = (const char *) (uintptr_t) (addr + offsetof(bt_rec_t, name) + rec.name);
+    fns[c].extra = rec.extra ? (const char *) (uintptr_t) (addr + offsetof(bt_rec_t, extra) + rec.extra) : NULL;
+    fns[c].flags = rec.flags;
+    fns[c].function = (bt_test_function_t *) (uintptr_t) (addr + offsetof(bt_rec_t, function) + rec.function);
+  }
 
-    test = test->next;
+  /* a record without a suite is fine (see BT_NO_NAME), one pointing
+   * nowhere is not */
+  for (n = 0; n < count; n++) {
+    int extra = fns[n].extra != NULL;
+
+    fns[n].name = bt_image_string(self->image, (uintptr_t) fns[n].name);
+    if (extra)
+      fns[n].extra = bt_image_string(self->image, (uintptr_t) fns[n].extra);
+    if (!fns[n].name || (extra && !fns[n].extra)) {
+      fprintf(stderr, "record %u of the test section has no valid name\n", first + n);
+      return_error(ENFILE);
+    }
   }
 
-  return NULL;
+  return 0;
 }
 
 /**
- * recursively deletes an elf descriptor (i.e. elf, test suites, tests, logs, results)
+ * reads all records of the bexec section from the image of an elf
  *
- * @param[in] elf a pointer to a pointer holding the elf
+ * @param[in] self the elf
+ * @param[out] records a pointer to a pointer to hold the records
+ * @param[out] count a pointer to hold the number of records
  *
  * @return the operation error code
  */
 
-int bt_elf_delete(bt_elf_t ** elf)
+static
+int bt_elf_records(bt_elf_t * self, bt_fn_t ** records, unsigned * count)
 {
-  bt_elf_t * self;
-  bt_suite_t * cur, * tmp;
-  unsigned n;
-
-  if (!elf || !*elf)
-    return_error(EINVAL);
+  bt_fn_t * fns;
+  int err;
 
-  self = *elf;
+  err = bt_elf_sections(self);
+  if (err)
+    return_error(err);
 
-  for (n = 0; n <self->hsize; n++) {
-    cur = self->hsuites[n];
-    while (cur) {
-      tmp = cur->next;
-      bt_suite_delete(&cur);
-      cur = tmp;
-    }
-  }
-  free(self->hsuites);
+  *count = self->fncount;
 
-  if (self->dlhandle)
-    dlclose(self->dlhandle);
+  fns = malloc(*count ? *count * sizeof(bt_fn_t) : 1);
+  if (!fns)
+    return_error(ENOMEM);
 
-  free(self->name);
+  err = bt_elf_read(self, 0, fns, *count);
+  if (err) {
+    free(fns);
+    return_error(err);
+  }
 
-  free(self);
+  *records = fns;
 
   return 0;
 }
 
 /**
- * creates a new descriptor for a shared object
+ * iterates the shared object and builds the registry of its tests, which
+ * are grouped by suite, both in order of declaration
  *
- * @param[out] elf a pointer to a pointer to hold the elf
- * @param[in] elfname filename of the shared object to pass to open() and dlopen()
+ * @param[in] self  a pointer to an elf descriptor
  *
  * @return the operation error code
  */
 
-int bt_elf_new(bt_elf_t ** elf, bt_t * butcher, const char * elfname)
+int bt_elf_load2(bt_elf_t * self)
 {
-  bt_elf_t * self;
-  int err;
+  bt_fn_t * bsect = NULL;
+  const bt_fn_t * bsect_end;
+  const bt_fn_t * fn;
+  bt_arena_t * arena;
+  unsigned fnid, s, t, * suiteof = NULL, * fill = NULL;
+  int err = 0;
 
-  if (!elf || !butcher || !elfname)
+  if (!self)
     return_error(EINVAL);
 
-  self = malloc(sizeof(bt_elf_t));
-  if (!self)
-    return_error(ENOMEM);
+  arena = self->arena;
 
-  memset(self, 0, sizeof(bt_elf_t));
-
-  self->next = NULL;
+  err = bt_elf_records(self, &bsect, &self->fncount);
+  if (err)
+    goto failure;
 
-  self->butcher = butcher;
+  bsect_end = bsect + self->fncount;
 
-  self->name = strdup(elfname);
-  if (!self->name) {
-    err = ENOMEM;
+  /* every record names at most one suite and one test */
+  err = bt_table_init(&self->index, arena, self->fncount * 2);
+  if (err)
     goto failure;
-  }
 
-  self->hsuites = malloc(sizeof(bt_suite_t *) * 128);
-  if (!self->hsuites) {
+  suiteof = malloc(sizeof(unsigned) * (self->fncount ? self->fncount : 1));
+  if (!suiteof) {
     err = ENOMEM;
     goto failure;
   }
-  memset(self->hsuites, 0, sizeof(bt_suite_t *) * 128);
-  self->hsize = 128;
-
-  self->dlhandle = dlopen(self->name, RTLD_NOW);
-  if (!self->dlhandle) {
-    fprintf(self->butcher->fd, "could not open shared object '%s': %s\n", elfname, dlerror());
-    err = ENFILE;
-    goto failure;
-  }
-
-  *elf = self;
-
-  return 0;
-
-failure: {
-    bt_elf_delete(&self);
-    return_error(err);
-  }
-}
-
-/**
- * gets a suite form the elf hashmap
- *
- * @param[in] elf a pointer to an elf
- * @param[in] name name of the suite to get
- *
- * @return the suite of NULL
- */
-
-bt_suite_t * bt_elf_get_suite(bt_elf_t * self, const char * name)
-{
-  unsigned h, idx;
-  bt_suite_t * suite;
-
-  h = hash(name, strlen(name), BT_HASH_SALT);
-  idx = h % self->hsize;
-  suite = self->hsuites[idx];
-  while (suite) {
-    if (strcmp(suite->name, name) == 0)
-      return suite;
-
-    suite = suite->next;
-  }
-
-  return NULL;
-}
-
-/**
- * adds a suite to an elf using suite->name as key
- *
- * @param[in] self the elf to add the suite to
- * @param[in] suite the suite to add
- *
- * @return the operation error code
- */
-
-int bt_elf_add_suite(bt_elf_t * self, bt_suite_t * suite)
-{
-  unsigned h, idx;
-
-  h = hash(suite->name, strlen(suite->name), BT_HASH_SALT);
-  idx = h % self->hsize;
-  bt_suite_t ** p = &self->hsuites[idx];
-  bt_suite_t * cur = *p;
-  while (cur) {
-    if (strcmp(cur->name, suite->name) == 0)
-      return_error(EINVAL);
-    p = &cur->next;
-    cur = *p;
-  }
-
-  suite->next = *p;
-  *p = suite;
 
-  return 0;
-}
-
-
-/**
- * assigns a setup function to an already registered test
- *
- * @param[in] self an elf to search for suite and test
- * @param[in] fn a function specifier
- *
- * @return the operation error code
- *
- * i.e. self[fn->extra][fn->name].setupid = id
- */
+  /* first pass: find the suites and count their tests */
+  fnid = 0;
+  for (fn = bsect; fn < bsect_end; fn++, fnid++) {
+    const char * sname;
 
-int bt_elf_assign_setup(bt_elf_t * self, unsigned id, const bt_fn_t * fn)
-{
-  bt_suite_t * suite;
-  bt_test_t * test;
-
-  suite = bt_elf_get_suite(self, fn->extra);
-  if (suite) {
-    test = bt_suite_get_test(suite, fn->name);
-    if (test) {
-      if (test->setupid == BT_NO_ID) {
-        test->setupid = id;
-        return 0;
-      }
-      fprintf(stderr, "attempted to redefine setup function for test %s\n", fn->name);
+    switch ((bt_fn_kind_t) (fn->flags & BT_FN_KIND_MASK)) {
+      case BT_FN_KIND_PTEST:
+      case BT_FN_KIND_FTEST:
+      case BT_FN_KIND_BENCH:
+        break;
+      default:
+        continue;
     }
-  }
-
-  return EINVAL;
-}
-
-/**
- * assigns a teardown function to an already registered test
- *
- * @param[in] self an elf to search for suite and test
- * @param[in] fn a function specifier
- *
- * @return the operation error code
- *
- * i.e. self[fn->extra][fn->name].teardownid = id
- */
 
-int bt_elf_assign_teardown(bt_elf_t * self, unsigned id, const bt_fn_t * fn)
-{
-  bt_suite_t * suite;
-  bt_test_t * test;
-
-  suite = bt_elf_get_suite(self, fn->extra);
-  if (suite) {
-    test = bt_suite_get_test(suite, fn->name);
-    if (test) {
-      if (test->teardownid == BT_NO_ID) {
-        test->teardownid = id;
-        return 0;
+    sname = fn->extra ? fn->extra : "(nil)";
+    s = bt_table_get(&self->index, BT_NO_ID, sname);
+    if (s == BT_NO_ID) {
+      if ((self->nsuites & (self->nsuites - 1)) == 0) {
+        bt_suite_t * suites = bt_arena_alloc(arena, sizeof(bt_suite_t) * (self->nsuites ? self->nsuites * 2 : 1));
+        if (!suites) {
+          err = ENOMEM;
+          goto failure;
+        }
+        if (self->nsuites)
+          memcpy(suites, self->suites, sizeof(bt_suite_t) * self->nsuites);
+        self->suites = suites;
       }
-      fprintf(stderr, "attempted to redefine teardown function for test %s\n", fn->name);
-    }
-  }
-
-  return EINVAL;
-}
-
-/**
- * registers a test in an elf creating suites as needed
- *
- * @param[in] self an elf to register the test
- * @param[in] id a function in
- * @param[in] kind kind the the function
- * @param[in] fn function descriptor
- *
- * @return the operation error code
- */
 
-int bt_elf_register_test(bt_elf_t * self, unsigned id, bt_fn_kind_t kind, const bt_fn_t * fn)
-{
-  const char * sname;
-  bt_suite_t * suite;
-  bt_test_t * test;
-  int err;
+      s = self->nsuites++;
+      self->suites[s].name = fn->extra ? (uint32_t) (sname - self->strings) : BT_NO_NAME;
+      self->suites[s].first = 0;
+      self->suites[s].count = 0;
 
-  sname = fn->extra ? fn->extra : "(nil)";
-  suite = bt_elf_get_suite(self, sname);
-  if (!suite) {
-    err = bt_suite_new(&suite, sname);
-    if (err)
-      goto failure;
+      err = bt_table_add(&self->index, BT_NO_ID, sname, s);
+      if (err)
+        goto failure;
+    }
 
-    err = bt_elf_add_suite(self, suite);
-    if (err)
-      goto failure;
+    self->suites[s].count++;
+    self->ntests++;
+    suiteof[fnid] = s;
   }
 
-  err = bt_test_new(&test, id, kind, fn->name);
-  if (err)
-    goto failure;
-
-  err = bt_suite_add_test(suite, test);
-  if (err)
-    goto failure;
-
- return 0;
-failure:
-    return_error(err);
-}
-
-/**
- * iterates the shared object and creates empty test suites from definitions
- *
- * @param[in] self  a pointer to an elf descriptor
- *
- * @return the operation error code
- */
-
-int bt_elf_load2(bt_elf_t * self)
-{
-  const bt_fn_t * bsect;
-  const bt_fn_t * bsect_end;
-  const bt_fn_t * fn;
-  unsigned fnid;
-  int err = 0;
-
-  if (!self)
-    return_error(EINVAL);
-
-  bsect = dlsym(self->dlhandle, "__start_bexec");
-  if (!bsect) {
-    fprintf(stderr, "shared object does not export a test section\n");
-    err = ENFILE;
-    goto failure;
+  t = 0;
+  for (s = 0; s < self->nsuites; s++) {
+    self->suites[s].first = t;
+    t += self->suites[s].count;
   }
-  bsect_end = dlsym(self->dlhandle, "__stop_bexec");
-  if (!bsect_end) {
-    fprintf(stderr, "shared object does not export a valid test section\n");
-    err = ENFILE;
+
+  self->ids = bt_arena_alloc(arena, sizeof(unsigned) * (self->ntests + 1));
+  self->kinds = bt_arena_alloc(arena, self->ntests + 1);
+  self->tags = bt_arena_alloc(arena, sizeof(uint32_t) * (self->ntests + 1));
+  self->setupids = bt_arena_alloc(arena, sizeof(unsigned) * (self->ntests + 1));
+  self->teardownids = bt_arena_alloc(arena, sizeof(unsigned) * (self->ntests + 1));
+  self->names = bt_arena_alloc(arena, sizeof(uint32_t) * (self->ntests + 1));
+  self->results = bt_arena_alloc(arena, sizeof(*self->results) * (self->ntests + 1));
+  self->tests = bt_arena_alloc(arena, sizeof(bt_test_t) * (self->ntests + 1));
+  fill = calloc(self->nsuites + 1, sizeof(unsigned));
+  if (!self->ids || !self->kinds || !self->tags || !self->setupids || !self->teardownids
+      || !self->names || !self->results || !self->tests || !fill) {
+    err = ENOMEM;
     goto failure;
   }
 
-  /*unsigned long * p;
-  for (p = bsect; p < bsect_end; p++) {
-    fprintf(stderr, "### 0x%016x\n", *p);
-  }*/
+  memset(self->tests, 0, sizeof(bt_test_t) * (self->ntests + 1));
 
+  /* second pass: place the tests in the range of their suite */
   fnid = 0;
   for (fn = bsect; fn < bsect_end; fn++, fnid++) {
-    switch ((bt_fn_kind_t) (fn->flags & 0xf)) {
+    switch ((bt_fn_kind_t) (fn->flags & BT_FN_KIND_MASK)) {
       case BT_FN_KIND_PTEST:
-        err = bt_elf_register_test(self, fnid, BT_FN_KIND_PTEST, fn);
-        break;
       case BT_FN_KIND_FTEST:
-        err = bt_elf_register_test(self, fnid, BT_FN_KIND_FTEST, fn);
+      case BT_FN_KIND_BENCH:
         break;
       default:
         continue;
     }
-    if (err)
+
+    s = suiteof[fnid];
+    t = self->suites[s].first + fill[s]++;
+
+    self->ids[t] = fnid;
+    self->kinds[t] = fn->flags & BT_FN_KIND_MASK;
+    self->tags[t] = fn->flags & ~BT_FN_KIND_MASK;
+    self->setupids[t] = BT_NO_ID;
+    self->teardownids[t] = BT_NO_ID;
+    self->names[t] = fn->name - self->strings;
+    memset(self->results[t], BT_TEST_NONE, BT_PASS_MAX);
+
+    err = bt_table_add(&self->index, s, fn->name, t);
+    if (err) {
+      fprintf(stderr, "test %s is defined twice in suite %s\n", fn->name, bt_elf_suite_name(self, s));
       goto failure;
+    }
   }
 
+  /* third pass: attach the fixtures */
   fnid = 0;
   for (fn = bsect; fn < bsect_end; fn++, fnid++) {
-    switch ((bt_fn_kind_t) (fn->flags & 0xf)) {
+    switch ((bt_fn_kind_t) (fn->flags & BT_FN_KIND_MASK)) {
       case BT_FN_KIND_SETUP:
-        err = bt_elf_assign_setup(self, fnid, fn);
-        break;
       case BT_FN_KIND_TEARDOWN:
-        err = bt_elf_assign_teardown(self, fnid, fn);
+        err = bt_elf_assign_fixture(self, fnid, fn);
         break;
       default:
         continue;
@@ -822,10 +1013,17 @@ int bt_elf_load2(bt_elf_t * self)
       goto failure;
   }
 
+  free(bsect);
+  free(suiteof);
+  free(fill);
+
   return 0;
 
 failure:
-    return_error(err);
+  free(bsect);
+  free(suiteof);
+  free(fill);
+  return_error(err);
 }
 
 /**
@@ -850,6 +1048,9 @@ int bt_new(bt_t ** butcher)
   memset(self, 0, sizeof(bt_t));
 
   self->elfs = NULL;
+  self->boardfd = -1;
+  self->timeout = -1;
+  self->cpu = -1;
 
   *butcher = self;
 
@@ -879,27 +1080,54 @@ int bt_init(bt_t * self, const char * name, FILE * fd, const char * smatch, cons
   if (!self->bexec)
     return_error(ENOMEM);
 
-
+  /* grab all suites and tests by default, see bt_match_suite() and
+   * bt_match_test() for more patterns */
   if (smatch) {
-    if (regcomp(&self->sregex, smatch, REG_EXTENDED | REG_NOSUB))
-      return_error(EINVAL);
-  } else { /* grab all suites by default */
-    if (regcomp(&self->sregex, ".*", REG_EXTENDED | REG_NOSUB))
-      return_error(EINVAL);
+    int err = bt_match_suite(self, smatch);
+    if (err)
+      return_error(err);
   }
 
   if (tmatch) {
-    if (regcomp(&self->tregex, tmatch, REG_EXTENDED | REG_NOSUB))
-      return_error(EINVAL);
-  } else { /* grab all tests by default */
-    if (regcomp(&self->tregex, ".*", REG_EXTENDED | REG_NOSUB))
-      return_error(EINVAL);
+    int err = bt_match_test(self, tmatch);
+    if (err)
+      return_error(err);
   }
 
   self->initialized = 1;
   return 0;
 }
 
+/**
+ * tells whether bexec will count instructions on the PMU or fall back to
+ * single stepping, by opening the same counter it does
+ *
+ * @return whether there is a counter for the instructions
+ */
+
+static
+int bt_insn_pmu(void)
+{
+  struct perf_event_attr attr;
+  int fd;
+
+  memset(&attr, 0, sizeof(attr));
+  attr.size = sizeof(attr);
+  attr.type = PERF_TYPE_HARDWARE;
+  attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+  attr.disabled = 1;
+  attr.pinned = 1;
+  attr.exclude_kernel = 1;
+  attr.exclude_hv = 1;
+
+  fd = syscall(SYS_perf_event_open, &attr, 0, -1, -1, PERF_FLAG_FD_CLOEXEC);
+  if (fd == -1)
+    return 0;
+  close(fd);
+
+  return 1;
+}
+
 /**
  * initializes the butcher
  *
@@ -934,6 +1162,21 @@ int bt_tune(bt_t * self, unsigned int flags)
   else
     self->envdump = 0;
 
+  if (flags & BT_FLAG_STREAM)
+    self->stream = 1;
+  else
+    self->stream = 0;
+
+  if (flags & BT_FLAG_INSTRUCTIONS)
+    self->instructions = 1;
+  else
+    self->instructions = 0;
+  self->stepping = self->instructions && !bt_insn_pmu();
+
+  if (flags & BT_FLAG_PERF)
+    self->perf = 1;
+  else
+    self->perf = 0;
 
   return 0;
 }
@@ -992,121 +1235,867 @@ failure:
 }
 
 /**
- * loads a couple of shared objects
+ * makes the butcher keep the raw output of every test in a file inside
+ * a directory instead of collecting it in memory
  *
- * @param[in] self a pointer the butcher
- * @param[in] paramc the number of filenames in the array
- * @param[in] paramv the array of filenames of shared objects
+ * @param[in] self a pointer to the butcher
+ * @param[in] path the directory to store the log files in
  *
  * @return the operation error code
  */
 
-int bt_loadv(bt_t * self, int paramc, char * paramv[])
+int bt_logdir(bt_t * self, const char * path)
 {
-  int err;
+  struct stat st;
 
-  if (!self || !self->initialized || (paramc && !paramv))
+  if (!self || !self->initialized || !path)
     return_error(EINVAL);
 
-  for (int i = 0; i < paramc; i++) {
-    err = bt_load(self, paramv[i]);
-    if (err)
-      return_error(err);
+  if (stat(path, &st) == -1) {
+    if (errno != ENOENT || mkdir(path, 0755) == -1) {
+      fprintf(self->fd, "could not create log directory '%s'\n", path);
+      return_error(errno);
+    }
+  } else if (!S_ISDIR(st.st_mode)) {
+    fprintf(self->fd, "'%s' is not a directory\n", path);
+    return_error(ENOTDIR);
   }
+
+  free(self->logdir);
+  self->logdir = strdup(path);
+  if (!self->logdir)
+    return_error(ENOMEM);
+
   return 0;
 }
 
+/* seconds a test of a size class may run by default */
+static const unsigned bt_size_timeouts[BT_SIZE_CLASSES] = {60, 300, 900};
+
 /**
- * loads a shared object
+ * gives every test the same time to run instead of the time its size class
+ * allows (see bt_size_timeouts), which does not apply under a debugger
+ * or while instructions are counted by single stepping
  *
- * @param[in] self a pointer the butcher
- * @param[in] elfname filename of the shared objects
+ * @param[in] self a pointer to the butcher
+ * @param[in] seconds the time, 0 for no limit
  *
  * @return the operation error code
  */
 
-int bt_load(bt_t * self, const char * elfname)
+int bt_timeout(bt_t * self, unsigned seconds)
 {
-  int err;
-  bt_elf_t * btelf = NULL;
+  if (!self || !self->initialized || seconds > INT_MAX)
+    return_error(EINVAL);
 
-  err = bt_elf_new(&btelf, self, elfname);
-  if (err) /* allocation error? */
-    goto failure;
+  self->timeout = seconds;
 
-  err = bt_elf_load2(btelf);
-  if (err)
-    goto failure;
+  return 0;
+}
+
+/**
+ * makes the butcher publish the progress of the run on a result board
+ * stored in a file, so other processes can map it (see struct bt_board)
+ *
+ * @param[in] self a pointer to the butcher
+ * @param[in] path the file to create the board in
+ *
+ * @return the operation error code
+ */
 
-  btelf->next = self->elfs;
-  self->elfs = btelf;
+int bt_board(bt_t * self, const char * path)
+{
+  if (!self || !self->initialized || !path)
+    return_error(EINVAL);
+
+  free(self->boardpath);
+  self->boardpath = strdup(path);
+  if (!self->boardpath)
+    return_error(ENOMEM);
 
   return 0;
-failure:
-  if (btelf)
-    bt_elf_delete(&btelf);
-  return_error(err);
 }
 
 /**
- * lists what the butcher was able to load
+ * unmaps the result board
  *
- * @param[in] self a pointer the butcher
+ * @param[in] self a pointer to the butcher
+ */
+
+static
+void bt_board_close(bt_t * self)
+{
+  if (self->board)
+    munmap(self->board, self->boardsize);
+  if (self->boardfd != -1)
+    close(self->boardfd);
+
+  self->board = NULL;
+  self->boardfd = -1;
+}
+
+/**
+ * adds the slots of an elf to the result board, which is grown as needed
+ *
+ * @param[in] self a pointer to the butcher
+ * @param[in] elf the elf
+ * @param[in] index the index of the elf in load order
  *
  * @return the operation error code
  */
 
-int bt_list(bt_t * self)
+static
+int bt_board_add(bt_t * self, bt_elf_t * elf, unsigned index)
 {
-  bt_elf_t * elf_cur;
-  bt_suite_t * suite_cur;
-  bt_test_t * test_cur;
-  unsigned n, m;
+  unsigned nslots = self->board->nslots, count;
+  size_t size;
+  void * map;
+
+  /* a streamed elf runs one test at a time in a single slot */
+  count = elf->stream ? 1 : elf->fncount;
+
+  size = sizeof(struct bt_board) + (nslots + count) * sizeof(struct bt_board_slot);
+  if (size > self->boardsize) {
+    if (ftruncate(self->boardfd, size) == -1)
+      return_error(errno);
+    map = mremap(self->board, self->boardsize, size, MREMAP_MAYMOVE);
+    if (map == MAP_FAILED)
+      return_error(errno);
+    self->board = map;
+    self->boardsize = size;
+  }
 
-  if (!self || !self->initialized)
-    return_error(EINVAL);
+  elf->slotbase = nslots;
+  for (unsigned n = 0; n < count; n++) {
+    self->board->slots[nslots + n].elf = index;
+    self->board->slots[nslots + n].function = n;
+    memset(self->board->slots[nslots + n].results, BT_TEST_NONE, BT_PASS_MAX);
+  }
 
-  fprintf(self->fd, "%slisting loaded objects%s...\n\n",
-      self->color ? GREEN : "", self->color ? ENDCOL : "");
+  /* the slots are there before anybody is told about them */
+  __atomic_store_n(&self->board->nslots, nslots + count, __ATOMIC_RELEASE);
 
-  elf_cur = self->elfs;
-  while (elf_cur) {
-    fprintf(self->fd, "[%self%s, name='%s%s%s']\n",
-        self->color ? YELLOW : "", self->color ? ENDCOL : "",
-        self->color ? RED : "", elf_cur->name, self->color ? ENDCOL : "");
+  return 0;
+}
+
+/**
+ * creates the result board with a slot for every function of every loaded
+ * elf, the board lives in the file given to bt_board() or in an anonymous
+ * memory file otherwise; elfs that are loaded later are added with
+ * bt_board_add()
+ *
+ * @param[in] self a pointer to the butcher
+ *
+ * @return the operation error code
+ */
+
+static
+int bt_board_open(bt_t * self)
+{
+  struct timespec ts;
+  bt_elf_t * elf;
+  unsigned nslots, nelfs;
+  size_t size;
+  void * map;
+  int fd, err;
+
+  nslots = 0;
+  for (elf = self->elfs; elf; elf = elf->next)
+    nslots += elf->stream ? 1 : elf->fncount;
+
+  size = sizeof(struct bt_board) + nslots * sizeof(struct bt_board_slot);
+
+  if (self->boardpath)
+    fd = open(self->boardpath, O_RDWR | O_CREAT | O_TRUNC, 0644);
+  else
+    fd = memfd_create("butcher-board", 0);
+  if (fd == -1) {
+    fprintf(self->fd, "could not create result board\n");
+    return_error(errno);
+  }
+
+  if (ftruncate(fd, size) == -1) {
+    err = errno;
+    goto failure;
+  }
+
+  map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (map == MAP_FAILED) {
+    err = errno;
+    goto failure;
+  }
+
+  self->board = map;
+  self->boardsize = size;
+  self->boardfd = fd;
+
+  clock_gettime(CLOCK_REALTIME, &ts);
+
+  self->board->version = BT_BOARD_VERSION;
+  self->board->slot_size = sizeof(struct bt_board_slot);
+  self->board->nslots = 0;
+  self->board->started = (uint64_t) ts.tv_sec * 1000000000ull + ts.tv_nsec;
+
+  nelfs = 0;
+  for (elf = self->elfs; elf; elf = elf->next, nelfs++) {
+    err = bt_board_add(self, elf, nelfs);
+    if (err) {
+      bt_board_close(self);
+      return_error(err);
+    }
+  }
+
+  /* publish the header last, monitors check the magic */
+  __atomic_store_n(&self->board->magic, BT_BOARD_MAGIC, __ATOMIC_RELEASE);
+
+  return 0;
+
+failure:
+  close(fd);
+  return_error(err);
+}
+
+/**
+ * reads a shared object into a new elf
+ *
+ * @param[in] self a pointer the butcher
+ * @param[in] arena where the elf is allocated from
+ * @param[in] elfname filename of the shared object
+ * @param[out] elf a pointer to a pointer to hold the elf
+ *
+ * @return the operation error code
+ */
+
+static
+int bt_load_elf(bt_t * self, bt_arena_t * arena, const char * elfname, bt_elf_t ** elf)
+{
+  bt_elf_t * btelf = NULL;
+  int err;
+
+  err = bt_elf_new(&btelf, self, arena, elfname);
+  if (err) /* allocation error? */
+    goto failure;
+
+  /* a streamed elf has no registry to cache */
+  if (self->stream) {
+    err = bt_stream_open(btelf);
+    if (err)
+      goto failure;
+  } else if ((err = self->cachedir ? bt_cache_load(btelf) : ENOENT) == ENOENT) {
+    err = bt_elf_load2(btelf);
+    if (err)
+      goto failure;
+
+    /* not being able to cache is no reason to stop */
+    if (self->cachedir)
+      bt_cache_store(btelf);
+  } else if (err) {
+    goto failure;
+  }
+
+  *elf = btelf;
+
+  return 0;
+failure:
+  if (btelf)
+    bt_elf_delete(&btelf);
+  return_error(err);
+}
+
+/**
+ * appends an elf to the butcher, the order of the elfs is the order of
+ * the command line
+ */
+
+static
+void bt_append_elf(bt_t * self, bt_elf_t * elf)
+{
+  bt_elf_t ** p;
+
+  for (p = &self->elfs; *p; p = &(*p)->next) ;
+  *p = elf;
+}
+
+/**
+ * the loop of a loader thread, which takes the next job until there are
+ * none left
+ *
+ * @param[in] arg a pointer to the butcher
+ *
+ * @return NULL
+ */
+
+static
+void * bt_loader_thread(void * arg)
+{
+  bt_t * self = arg;
+  bt_loader_t * loader = self->loader;
+  bt_load_job_t * job;
+
+  pthread_mutex_lock(&loader->lock);
+  while (loader->next < loader->njobs) {
+    job = &loader->jobs[loader->next++];
+    pthread_mutex_unlock(&loader->lock);
+
+    job->err = bt_load_elf(self, &job->arena, job->name, &job->elf);
+
+    pthread_mutex_lock(&loader->lock);
+    job->done = 1;
+    pthread_cond_broadcast(&loader->cond);
+  }
+  pthread_mutex_unlock(&loader->lock);
+
+  return NULL;
+}
+
+/**
+ * hands the next shared object loaded in the background over to the
+ * butcher, waiting for it if needed
+ *
+ * @param[in] self a pointer the butcher
+ * @param[out] elf a pointer to hold the elf, NULL if there is none left
+ *
+ * @return the operation error code (of loading the object)
+ */
+
+int bt_loader_take(bt_t * self, bt_elf_t ** elf)
+{
+  bt_loader_t * loader = self->loader;
+  bt_load_job_t * job;
+
+  *elf = NULL;
+
+  if (!loader || loader->taken == loader->njobs)
+    return 0;
+
+  job = &loader->jobs[loader->taken++];
+
+  pthread_mutex_lock(&loader->lock);
+  while (!job->done)
+    pthread_cond_wait(&loader->cond, &loader->lock);
+  pthread_mutex_unlock(&loader->lock);
+
+  /* allocations of the butcher only ever happen on this thread */
+  bt_arena_merge(&self->arena, &job->arena);
+
+  if (job->err) {
+    fprintf(self->fd, "could not load shared object '%s'\n", job->name);
+    return_error(job->err);
+  }
+
+  job->elf->arena = &self->arena;
+  bt_append_elf(self, job->elf);
+  *elf = job->elf;
+
+  return 0;
+}
+
+/**
+ * takes all shared objects loaded in the background and stops the loader
+ *
+ * @param[in] self a pointer the butcher
+ *
+ * @return the operation error code (of the first object that failed)
+ */
+
+static
+int bt_loader_finish(bt_t * self)
+{
+  bt_loader_t * loader = self->loader;
+  bt_elf_t * elf;
+  int err = 0, e;
+
+  if (!loader)
+    return 0;
+
+  while (loader->taken < loader->njobs) {
+    e = bt_loader_take(self, &elf);
+    if (e && !err)
+      err = e;
+  }
+
+  for (unsigned n = 0; n < loader->nthreads; n++)
+    pthread_join(loader->threads[n], NULL);
+
+  pthread_mutex_destroy(&loader->lock);
+  pthread_cond_destroy(&loader->cond);
+  free(loader->threads);
+  free(loader->jobs);
+  free(loader);
+  self->loader = NULL;
+
+  if (err)
+    return_error(err);
+
+  return 0;
+}
+
+#define BT_LOADER_THREADS_MIN 4
+#define BT_LOADER_THREADS_MAX 32
+
+/**
+ * loads a couple of shared objects
+ *
+ * @param[in] self a pointer the butcher
+ * @param[in] paramc the number of filenames in the array
+ * @param[in] paramv the array of filenames of shared objects
+ *
+ * @return the operation error code
+ *
+ * more than one object is loaded on a pool of threads in the background,
+ * bt_list() and bt_chop() take the objects in order as soon as they are
+ * ready, so the first tests run while later objects are still loading;
+ * errors of loading an object are returned when the object is taken
+ */
+
+int bt_loadv(bt_t * self, int paramc, char * paramv[])
+{
+  bt_loader_t * loader;
+  long nthreads;
+  int err;
+
+  if (!self || !self->initialized || (paramc && !paramv))
+    return_error(EINVAL);
+
+  if (paramc < 2 || self->loader) {
+    for (int i = 0; i < paramc; i++) {
+      err = bt_load(self, paramv[i]);
+      if (err)
+        return_error(err);
+    }
+    return 0;
+  }
+
+  nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+  /* loading is mostly waiting for the file system */
+  if (nthreads < BT_LOADER_THREADS_MIN)
+    nthreads = BT_LOADER_THREADS_MIN;
+  if (nthreads > BT_LOADER_THREADS_MAX)
+    nthreads = BT_LOADER_THREADS_MAX;
+  if (nthreads > paramc)
+    nthreads = paramc;
+
+  loader = malloc(sizeof(bt_loader_t));
+  if (!loader)
+    return_error(ENOMEM);
+
+  memset(loader, 0, sizeof(bt_loader_t));
+
+  loader->jobs = calloc(paramc, sizeof(bt_load_job_t));
+  loader->threads = malloc(sizeof(pthread_t) * nthreads);
+  if (!loader->jobs || !loader->threads) {
+    free(loader->jobs);
+    free(loader->threads);
+    free(loader);
+    return_error(ENOMEM);
+  }
+
+  pthread_mutex_init(&loader->lock, NULL);
+  pthread_cond_init(&loader->cond, NULL);
+  loader->njobs = paramc;
+  for (int i = 0; i < paramc; i++)
+    loader->jobs[i].name = paramv[i];
+
+  self->loader = loader;
+
+  for (loader->nthreads = 0; loader->nthreads < nthreads; loader->nthreads++) {
+    /* whatever has been started takes care of the rest */
+    if (pthread_create(&loader->threads[loader->nthreads], NULL, bt_loader_thread, self))
+      break;
+  }
+
+  if (!loader->nthreads) {
+    pthread_mutex_destroy(&loader->lock);
+    pthread_cond_destroy(&loader->cond);
+    free(loader->threads);
+    free(loader->jobs);
+    free(loader);
+    self->loader = NULL;
+
+    for (int i = 0; i < paramc; i++) {
+      err = bt_load(self, paramv[i]);
+      if (err)
+        return_error(err);
+    }
+  }
+
+  return 0;
+}
+
+/**
+ * loads a shared object
+ *
+ * @param[in] self a pointer the butcher
+ * @param[in] elfname filename of the shared objects
+ *
+ * @return the operation error code
+ */
+
+int bt_load(bt_t * self, const char * elfname)
+{
+  bt_elf_t * btelf;
+  int err;
+
+  /* the objects of bt_loadv() come first */
+  err = bt_loader_finish(self);
+  if (err)
+    return_error(err);
+
+  err = bt_load_elf(self, &self->arena, elfname, &btelf);
+  if (err)
+    return_error(err);
+
+  bt_append_elf(self, btelf);
+
+  return 0;
+}
+
+/**
+ * lists a single test
+ *
+ * @param[in] self a pointer the butcher
+ * @param[in] elf the shared object where test is defined
+ * @param[in] t the index of the test
+ */
+
+static
+void bt_list_test(bt_t * self, bt_elf_t * elf, unsigned t)
+{
+  fprintf(self->fd, "  [%stest%s, name='%s%s%s'",
+      self->color ? PURPLE : "", self->color ? ENDCOL : "",
+      self->color ? RED : "", bt_elf_test_name(elf, t), self->color ? ENDCOL : "");
+  if (elf->setupids[t] != BT_NO_ID)
+    fprintf(self->fd, ", setup=%d", elf->setupids[t]);
+  if (elf->teardownids[t] != BT_NO_ID)
+    fprintf(self->fd, ", setup=%d", elf->teardownids[t]);
+  fprintf(self->fd, ", function=%d", elf->ids[t]);
+  if (elf->kinds[t] == BT_FN_KIND_BENCH)
+    fprintf(self->fd, ", bench");
+  if (bt_size_class(elf->tags[t]))
+    fprintf(self->fd, ", size=%s", bt_size_names[bt_size_class(elf->tags[t])]);
+  for (unsigned n = 0, first = 1; n < BT_TAG_COUNT; n++) {
+    if (!(elf->tags[t] & (1u << (BT_TAG_SHIFT + n))))
+      continue;
+    fprintf(self->fd, "%s%s", first ? ", tags=" : ",", bt_tag_names[n]);
+    first = 0;
+  }
+  fprintf(self->fd, "]\n");
+}
+
+/**
+ * lists what the butcher was able to load
+ *
+ * @param[in] self a pointer the butcher
+ *
+ * @return the operation error code
+ */
+
+int bt_list(bt_t * self)
+{
+  bt_elf_t * elf_cur;
+  bt_suite_t * suite_cur;
+  unsigned n, t;
+
+  if (!self || !self->initialized)
+    return_error(EINVAL);
+
+  fprintf(self->fd, "%slisting loaded objects%s...\n\n",
+      self->color ? GREEN : "", self->color ? ENDCOL : "");
+
+  elf_cur = self->elfs;
+  for (;;) {
+    /* objects of bt_loadv() are listed as soon as they are loaded */
+    if (!elf_cur) {
+      int err = bt_loader_take(self, &elf_cur);
+      if (err)
+        return_error(err);
+      if (!elf_cur)
+        break;
+    }
+
+    fprintf(self->fd, "[%self%s, name='%s%s%s']\n",
+        self->color ? YELLOW : "", self->color ? ENDCOL : "",
+        self->color ? RED : "", elf_cur->name, self->color ? ENDCOL : "");
+
+    /* a streamed elf is listed in the order of its records, the suite is
+     * repeated whenever it changes */
+    if (elf_cur->stream) {
+      const char * suite = NULL;
+      int err;
+
+      err = bt_stream_rewind(elf_cur);
+      if (err)
+        return_error(err);
+
+      while ((err = bt_stream_next(elf_cur)) == 0) {
+        if (!suite || strcmp(suite, bt_elf_suite_name(elf_cur, 0)) != 0) {
+          suite = bt_elf_suite_name(elf_cur, 0);
+          fprintf(self->fd, " [%ssuite%s, name='%s%s%s']\n",
+              self->color ? BLUE : "", self->color ? ENDCOL : "",
+              self->color ? GREEN : "", bt_elf_suite_name(elf_cur, 0), self->color ? ENDCOL : "");
+        }
+        bt_list_test(self, elf_cur, 0);
+      }
+      if (err != ENOENT)
+        return_error(err);
+
+      elf_cur = elf_cur->next;
+      continue;
+    }
+
+    for (n = 0; n < elf_cur->nsuites; n++) {
+      suite_cur = &elf_cur->suites[n];
+      fprintf(self->fd, " [%ssuite%s, name='%s%s%s']\n",
+          self->color ? BLUE : "", self->color ? ENDCOL : "",
+          self->color ? GREEN : "", bt_elf_suite_name(elf_cur, n), self->color ? ENDCOL : "");
+
+      for (t = suite_cur->first; t < suite_cur->first + suite_cur->count; t++)
+        bt_list_test(self, elf_cur, t);
+    }
+
+    elf_cur = elf_cur->next;
+  }
+
+  return 0;
+}
+
+#define BT_SPLICE_CHUNK (1 << 16)
+
+/**
+ * returns the arena what is received about a test is kept in, for a
+ * streamed elf it is given back before the next test
+ */
+
+static inline
+bt_arena_t * bt_test_arena(bt_t * self, bt_elf_t * elf)
+{
+  return elf->stream ? &elf->stream->scratch : &self->arena;
+}
+
+/**
+ * reads all pending messages from the control channel of a running test
+ *
+ * @param[in] arena where strings received are kept
+ * @param[in] test the test the messages are about
+ * @param[in] fd the butcher end of the control channel
+ * @param[in,out] results the results of the passes received so far
+ * @param[out] done set as soon as bexec has finished
+ *
+ * @return the operation error code
+ */
+
+static
+int bt_test_receive(bt_arena_t * arena, bt_test_t * test, int fd, char * results, int * done)
+{
+  char                   buffer[BT_MSG_MAX];
+  struct bt_msg_hdr      hdr;
+  struct bt_msg_phase    phase;
+  struct bt_msg_counters counters;
+  struct bt_msg_where    where;
+  struct bt_msg_bench    bench;
+  const char           * payload, * file, * text;
+  char                ** target;
+  ssize_t                length;
+
+  while ((length = recv(fd, buffer, sizeof(buffer), MSG_DONTWAIT)) > 0) {
+    if ((size_t) length < sizeof(hdr))
+      continue;
+
+    memcpy(&hdr, buffer, sizeof(hdr));
+    if (hdr.version != BT_PROTO_VERSION || hdr.length != length - sizeof(hdr))
+      continue;
+
+    payload = buffer + sizeof(hdr);
+
+    switch (hdr.type) {
+      case BT_MSG_PHASE:
+        if (hdr.length < sizeof(phase))
+          break;
+        memcpy(&phase, payload, sizeof(phase));
+        if (phase.pass >= BT_PASS_MAX || phase.result < BT_TEST_NONE || phase.result >= BT_TEST_MAX)
+          break;
+        results[phase.pass] = phase.result;
+        test->elapsed[phase.pass] = phase.end - phase.start;
+        break;
+      case BT_MSG_COUNTERS:
+        if (hdr.length < sizeof(counters))
+          break;
+        memcpy(&counters, payload, sizeof(counters));
+        if (counters.pass >= BT_PASS_MAX)
+          break;
+        test->counters[counters.pass] = counters.counters;
+        break;
+      case BT_MSG_ASSERT:
+      case BT_MSG_IGNORE:
+        if (hdr.length < sizeof(where))
+          break;
+        memcpy(&where, payload, sizeof(where));
+        if (sizeof(where) + where.file_length + where.text_length > hdr.length)
+          break;
+        /* only the first one is interesting */
+        target = hdr.type == BT_MSG_ASSERT ? &test->assertion : &test->reason;
+        if (*target)
+          break;
+        file = payload + sizeof(where);
+        text = file + where.file_length;
+        *target = bt_arena_printf(arena, "%.*s:%u: %.*s",
+            where.file_length ? where.file_length - 1 : 0, file, where.line,
+            where.text_length ? where.text_length - 1 : 0, text);
+        if (!*target)
+          return_error(ENOMEM);
+        break;
+      case BT_MSG_BENCH:
+        if (hdr.length < sizeof(bench))
+          break;
+        memcpy(&bench, payload, sizeof(bench));
+        if (bench.pass != BT_PASS_TEST || bench.bench.nsamples > BT_BENCH_SAMPLES_MAX
+            || sizeof(bench) + sizeof(double) * bench.bench.nsamples != hdr.length
+            || test->nbench >= BT_BENCH_SIZES_MAX)
+          break;
+        /* one summary per input size, the arrays double when full */
+        if (!(test->nbench & (test->nbench - 1))) {
+          unsigned capacity = test->nbench ? test->nbench * 2 : 1;
+          bt_bench_t * benches = bt_arena_alloc(arena, sizeof(bt_bench_t) * capacity);
+          double ** samples = bt_arena_alloc(arena, sizeof(double *) * capacity);
+          if (!benches || !samples)
+            return_error(ENOMEM);
+          if (test->nbench) {
+            memcpy(benches, test->bench, sizeof(bt_bench_t) * test->nbench);
+            memcpy(samples, test->samples, sizeof(double *) * test->nbench);
+          }
+          test->bench = benches;
+          test->samples = samples;
+        }
+        test->samples[test->nbench] = bt_arena_alloc(arena, sizeof(double) * (bench.bench.nsamples + 1));
+        if (!test->samples[test->nbench])
+          return_error(ENOMEM);
+        test->bench[test->nbench] = bench.bench;
+        memcpy(test->samples[test->nbench], payload + sizeof(bench), sizeof(double) * bench.bench.nsamples);
+        test->nbench++;
+        break;
+      case BT_MSG_DONE:
+        *done = 1;
+        break;
+      default: /* BT_MSG_HELLO and messages of newer revisions */
+        break;
+    }
+  }
+
+  if (length == -1 && errno != EAGAIN && errno != EWOULDBLOCK)
+    return_error(errno);
+
+  return 0;
+}
+
+/**
+ * creates the file the output of a test is spliced to (see bt_logdir())
+ *
+ * @param[in] self a pointer the butcher
+ * @param[in] elf the shared object where test is defined
+ * @param[in] s the index of the suite where test is defined
+ * @param[in] t the index of the test to create the log file for
+ * @param[out] fd a pointer to hold the descriptor of the log file
+ *
+ * @return the operation error code
+ */
+
+static
+int bt_test_open_logfile(bt_t * self, bt_elf_t * elf, unsigned s, unsigned t, int * fd)
+{
+  bt_test_t * test = &elf->tests[t];
+  const char * base;
+  size_t len;
+
+  base = strrchr(elf->name, '/');
+  base = base ? base + 1 : elf->name;
+
+  len = strlen(self->logdir) + strlen(base) + strlen(bt_elf_suite_name(elf, s)) + strlen(bt_elf_test_name(elf, t)) + 8;
+
+  test->logfile = bt_arena_alloc(bt_test_arena(self, elf), len);
+  if (!test->logfile)
+    return_error(ENOMEM);
+
+  snprintf(test->logfile, len, "%s/%s.%s.%s.log", self->logdir, base, bt_elf_suite_name(elf, s), bt_elf_test_name(elf, t));
+
+  *fd = open(test->logfile, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (*fd == -1) {
+    fprintf(self->fd, "could not create log file '%s'\n", test->logfile);
+    return_error(errno);
+  }
+
+  return 0;
+}
+
+/**
+ * reads the output of a test back from its log file, messages the runner
+ * added to the log are kept behind the output
+ *
+ * @param[in] test the test to load the log for
+ *
+ * @return the operation error code
+ */
+
+static
+int bt_test_load_logfile(bt_test_t * test)
+{
+  bt_log_t * log = NULL;
+  struct stat st;
+  void * map = MAP_FAILED;
+  int fd, err;
+
+  if (!test->logfile)
+    return 0;
+
+  fd = open(test->logfile, O_RDONLY | O_CLOEXEC);
+  if (fd == -1)
+    return_error(errno);
+
+  if (fstat(fd, &st) == -1) {
+    err = errno;
+    goto failure;
+  }
 
-    for (n = 0; n < elf_cur->hsize; n++) {
-      suite_cur = elf_cur->hsuites[n];
-      while (suite_cur) {
-        fprintf(self->fd, " [%ssuite%s, name='%s%s%s']\n",
-            self->color ? BLUE : "", self->color ? ENDCOL : "",
-            self->color ? GREEN : "", suite_cur->name, self->color ? ENDCOL : "");
-
-        for (m = 0; m < suite_cur->hsize; m++) {
-          test_cur = suite_cur->htests[m];
-          while (test_cur) {
-            fprintf(self->fd, "  [%stest%s, name='%s%s%s'",
-                self->color ? PURPLE : "", self->color ? ENDCOL : "",
-                self->color ? RED : "", test_cur->name, self->color ? ENDCOL : "");
-            if (test_cur->setupid != BT_NO_ID)
-              fprintf(self->fd, ", setup=%d", test_cur->setupid);
-            if (test_cur->teardownid != BT_NO_ID)
-              fprintf(self->fd, ", setup=%d", test_cur->teardownid);
-            fprintf(self->fd, ", function=%d", test_cur->id);
-            fprintf(self->fd, "]\n");
-
-            test_cur = test_cur->next;
-          }
-        }
+  err = bt_log_new(&log);
+  if (err)
+    goto failure;
 
-        suite_cur = suite_cur->next;
-      }
+  if (st.st_size > 0) {
+    map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (map == MAP_FAILED) {
+      err = errno;
+      goto failure;
     }
 
-    elf_cur = elf_cur->next;
+    err = bt_log_parse(log, map, st.st_size);
+    if (err)
+      goto failure;
+
+    munmap(map, st.st_size);
+  }
+  close(fd);
+
+  if (test->log) {
+    if (log->last)
+      log->last->next = test->log->lines;
+    else
+      log->lines = test->log->lines;
+    if (test->log->last)
+      log->last = test->log->last;
+    free(test->log);
   }
+  test->log = log;
+
+  test->logfile = NULL;
 
   return 0;
+
+failure:
+  if (map != MAP_FAILED)
+    munmap(map, st.st_size);
+  if (log)
+    bt_log_delete(&log);
+  close(fd);
+  return_error(err);
 }
 
 /**
@@ -1114,22 +2103,29 @@ int bt_list(bt_t * self)
  *
  * @param[in] self a pointer the butcher
  * @param[in] elf the shared object where test is defined
- * @param[in] suite the suite where test is defined
- * @param[in] test the test to run
+ * @param[in] s the index of the suite where test is defined
+ * @param[in] t the index of the test to run
  *
  * @return the operation error code
  */
 
-int bt_chopper(bt_t * self, bt_elf_t * elf, bt_suite_t * suite, bt_test_t * test)
+int bt_chopper(bt_t * self, bt_elf_t * elf, unsigned s, unsigned t)
 {
+  bt_test_t * test = &elf->tests[t];
   int status;
   pid_t pid;
   int err;
 
   int pipeout[2];
   int cntlout[2];
-
-  if (!self || !self->initialized || !test) {
+  int logfd = -1;
+  struct bt_board_slot * slot = NULL;
+  unsigned slotid;
+  struct timespec started, stopped;
+  uint64_t timeout;
+  int timedout = 0;
+
+  if (!self || !self->initialized || !elf || t >= elf->ntests) {
     fprintf(self->fd, "no self, not initialized or no test!\n");
     return_error(EINVAL);
   }
@@ -1141,19 +2137,21 @@ int bt_chopper(bt_t * self, bt_elf_t * elf, bt_suite_t * suite, bt_test_t * test
     char * argv[argc];
 
     setenv("butcher_elf_name", elf->name, 1);
-    if (test->setupid != BT_NO_ID) {
-      snprintf(buf, 64, "%d", test->setupid);
+    if (elf->setupids[t] != BT_NO_ID) {
+      snprintf(buf, 64, "%d", elf->setupids[t]);
       setenv("butcher_test_setup", buf, 1);
     }
-    if (test->setupid != BT_NO_ID) {
-      snprintf(buf, 64, "%d", test->teardownid);
+    if (elf->teardownids[t] != BT_NO_ID) {
+      snprintf(buf, 64, "%d", elf->teardownids[t]);
       setenv("butcher_test_teardown", buf, 1);
     }
-    if (test->id != BT_NO_ID) {
-      snprintf(buf, 64, "%d", test->id);
+    if (elf->ids[t] != BT_NO_ID) {
+      snprintf(buf, 64, "%d", elf->ids[t]);
       setenv("butcher_test_function", buf, 1);
     }
     setenv("butcher_verbose", self->messages ? "true" : "false", 1);
+    setenv("butcher_instructions", self->instructions ? "true" : "false", 1);
+    setenv("butcher_perf", self->perf ? "true" : "false", 1);
 
     k = 0;
     for (; k < self->debugger_nargs; k++)
@@ -1162,7 +2160,7 @@ int bt_chopper(bt_t * self, bt_elf_t * elf, bt_suite_t * suite, bt_test_t * test
     argv[k++] = self->bexec;
     argv[k] = NULL;
 
-    fprintf(self->fd, "running suite '%s', test '%s' \n", suite->name, test->name);
+    fprintf(self->fd, "running suite '%s', test '%s' \n", bt_elf_suite_name(elf, s), bt_elf_test_name(elf, t));
 
     execvp(argv[0], argv);
 
@@ -1181,21 +2179,67 @@ int bt_chopper(bt_t * self, bt_elf_t * elf, bt_suite_t * suite, bt_test_t * test
     return_error(err);
   }
 
+  if (self->logdir) {
+    err = bt_test_open_logfile(self, elf, s, t, &logfd);
+    if (err)
+      return_error(err);
+  }
+
   if (pipe2(pipeout, O_NONBLOCK)) {
     fprintf(self->fd, "could not create log pipe\n");
-    return_error(errno);
+    err = errno;
+    if (logfd != -1)
+      close(logfd);
+    return_error(err);
   }
-  if (pipe2(cntlout, O_NONBLOCK)) {
-    fprintf(self->fd, "could not create control pipe\n");
-    return_error(errno);
+  if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK, 0, cntlout)) {
+    fprintf(self->fd, "could not create control socket\n");
+    err = errno;
+    if (logfd != -1)
+      close(logfd);
+    return_error(err);
+  }
+
+
+  slotid = elf->slotbase + (elf->stream ? 0 : elf->ids[t]);
+  if (self->board && slotid < self->board->nslots) {
+    slot = &self->board->slots[slotid];
+
+    bt_board_slot_begin(slot);
+    slot->state = BT_SLOT_SCHEDULED;
+    slot->function = elf->ids[t];
+    slot->pid = 0;
+    slot->pass = BT_PASS_SETUP;
+    memset(slot->results, BT_TEST_NONE, BT_PASS_MAX);
+    memset(slot->start, 0, sizeof(slot->start));
+    memset(slot->end, 0, sizeof(slot->end));
+    memset(slot->counters, 0, sizeof(slot->counters));
+    snprintf(slot->name, BT_BOARD_NAME_MAX, "%s.%s", bt_elf_suite_name(elf, s), bt_elf_test_name(elf, t));
+    bt_board_slot_end(slot);
+
+    __atomic_fetch_add(&self->board->scheduled, 1, __ATOMIC_RELAXED);
   }
 
+  fprintf(self->fd, "running suite '%s', test '%s'...\r", bt_elf_suite_name(elf, s), bt_elf_test_name(elf, t));
+
+  /* under a debugger the time is up to whoever sits at it, and the one to
+   * be killed would be the debugger, so only an explicit --timeout holds;
+   * the same goes for single stepping, which is slower by orders of
+   * magnitude than what the size classes are made for */
+  if (self->timeout >= 0)
+    timeout = (uint64_t) self->timeout * 1000000000ull;
+  else if (self->debugger || self->stepping)
+    timeout = 0;
+  else
+    timeout = (uint64_t) bt_size_timeouts[bt_size_class(elf->tags[t])] * 1000000000ull;
 
-  fprintf(self->fd, "running suite '%s', test '%s'...\r", suite->name, test->name);
+  clock_gettime(CLOCK_MONOTONIC, &started);
 
   pid = fork();
 
   if (pid == -1) {
+    if (logfd != -1)
+      close(logfd);
     return_error(ENAVAIL);
   } else if (pid == 0) {
     /* forked here */
@@ -1211,17 +2255,26 @@ int bt_chopper(bt_t * self, bt_elf_t * elf, bt_suite_t * suite, bt_test_t * test
     if (elf->name)
       chunklen += strlen("butcher_elf_name") + strlen(elf->name) + 2;
 
-    if (test->setupid != BT_NO_ID)
+    if (elf->setupids[t] != BT_NO_ID)
       chunklen += strlen("butcher_test_setup") + 10 + 2;
 
-    if (test->teardownid != BT_NO_ID)
+    if (elf->teardownids[t] != BT_NO_ID)
       chunklen += strlen("butcher_test_teardown") + 10 + 2;
 
-    if (test->id != BT_NO_ID)
+    if (elf->ids[t] != BT_NO_ID)
       chunklen += strlen("butcher_test_function") + 10 + 2;
 
     chunklen += strlen("butcher_verbose") + strlen("false") + 2;
     chunklen += strlen("butcher_envdump") + strlen("false") + 2;
+    chunklen += strlen("butcher_instructions") + strlen("false") + 2;
+    chunklen += strlen("butcher_perf") + strlen("false") + 2;
+
+    chunklen += strlen("butcher_cfd") + 10 + 2;
+
+    if (slot) {
+      chunklen += strlen("butcher_board") + 10 + 2;
+      chunklen += strlen("butcher_slot") + 10 + 2;
+    }
 
     if (getenv("LD_LIBRARY_PATH"))
       chunklen += strlen("LD_LIBRARY_PATH") + strlen(getenv("LD_LIBRARY_PATH")) + 2;
@@ -1236,18 +2289,18 @@ int bt_chopper(bt_t * self, bt_elf_t * elf, bt_suite_t * suite, bt_test_t * test
       env[e++] = chunk + pos; pos += strlen(chunk + pos) + 1;
     }
 
-    if (test->setupid != BT_NO_ID) {
-      snprintf(chunk + pos, chunklen - pos, "butcher_test_setup=%d", test->setupid);
+    if (elf->setupids[t] != BT_NO_ID) {
+      snprintf(chunk + pos, chunklen - pos, "butcher_test_setup=%d", elf->setupids[t]);
       env[e++] = chunk + pos; pos += strlen(chunk + pos) + 1;
     }
 
-    if (test->teardownid != BT_NO_ID) {
-      snprintf(chunk + pos, chunklen - pos, "butcher_test_teardown=%d", test->teardownid);
+    if (elf->teardownids[t] != BT_NO_ID) {
+      snprintf(chunk + pos, chunklen - pos, "butcher_test_teardown=%d", elf->teardownids[t]);
       env[e++] = chunk + pos; pos += strlen(chunk + pos) + 1;
     }
 
-    if (test->id != BT_NO_ID) {
-      snprintf(chunk + pos, chunklen - pos, "butcher_test_function=%d", test->id);
+    if (elf->ids[t] != BT_NO_ID) {
+      snprintf(chunk + pos, chunklen - pos, "butcher_test_function=%d", elf->ids[t]);
       env[e++] = chunk + pos; pos += strlen(chunk + pos) + 1;
     }
 
@@ -1260,6 +2313,20 @@ int bt_chopper(bt_t * self, bt_elf_t * elf, bt_suite_t * suite, bt_test_t * test
     snprintf(chunk + pos, chunklen - pos, "butcher_envdump=%s", self->envdump ? "true" : "false");
     env[e++] = chunk + pos; pos += strlen(chunk + pos) + 1;
 
+    snprintf(chunk + pos, chunklen - pos, "butcher_instructions=%s", self->instructions ? "true" : "false");
+    env[e++] = chunk + pos; pos += strlen(chunk + pos) + 1;
+
+    snprintf(chunk + pos, chunklen - pos, "butcher_perf=%s", self->perf ? "true" : "false");
+    env[e++] = chunk + pos; pos += strlen(chunk + pos) + 1;
+
+    if (slot) {
+      snprintf(chunk + pos, chunklen - pos, "butcher_board=%d", self->boardfd);
+      env[e++] = chunk + pos; pos += strlen(chunk + pos) + 1;
+
+      snprintf(chunk + pos, chunklen - pos, "butcher_slot=%u", slotid);
+      env[e++] = chunk + pos; pos += strlen(chunk + pos) + 1;
+    }
+
     if (getenv("LD_LIBRARY_PATH")) {
       snprintf(chunk + pos, chunklen - pos, "LD_LIBRARY_PATH=%s", getenv("LD_LIBRARY_PATH"));
       env[e++] = chunk + pos; pos += strlen(chunk + pos) + 1;
@@ -1267,12 +2334,21 @@ int bt_chopper(bt_t * self, bt_elf_t * elf, bt_suite_t * suite, bt_test_t * test
 
     char * argv[2] = {self->bexec, NULL};
 
-    /* redirect stdout */
+    if (self->cpu >= 0) {
+      cpu_set_t cpus;
+
+      CPU_ZERO(&cpus);
+      CPU_SET(self->cpu, &cpus);
+      sched_setaffinity(0, sizeof(cpus), &cpus);
+    }
+
+    /* redirect stdout, a test writing faster than we read has to block
+     * instead of losing its output */
     close(pipeout[0]);
+    fcntl(pipeout[1], F_SETFL, fcntl(pipeout[1], F_GETFL) & ~O_NONBLOCK);
     dup2(pipeout[1], STDOUT_FILENO);
     dup2(pipeout[1], STDERR_FILENO);
     close(pipeout[1]);
-    close(STDOUT_FILENO);
     close(cntlout[0]); /* close read end of control stream */
     close(STDIN_FILENO);
 
@@ -1289,17 +2365,12 @@ int bt_chopper(bt_t * self, bt_elf_t * elf, bt_suite_t * suite, bt_test_t * test
     }
     exit(-1);
   } else {
-    struct result_rec rec = {
-      "\x01\x02\x03\x04",
-      {BT_TEST_NONE, BT_TEST_NONE, BT_TEST_NONE},
-      0
-    };
+    char              results[BT_PASS_MAX] = {BT_TEST_NONE, BT_TEST_NONE, BT_TEST_NONE};
+    int               done = 0;
     char            * buffer, * tmp;
-    char              c;
     size_t            buffer_length;
     size_t            buffer_length_new;
     size_t            buffer_cur;
-    size_t            i, n;
     size_t            bytes;
     ssize_t           length;
     pid_t             waitret;
@@ -1323,14 +2394,29 @@ int bt_chopper(bt_t * self, bt_elf_t * elf, bt_suite_t * suite, bt_test_t * test
       if (waitret == -1)
         goto loop_wait_fail;
 
-      if (waitret == pid)
+      clock_gettime(CLOCK_MONOTONIC, &stopped);
+      test->wall = (uint64_t) (stopped.tv_sec - started.tv_sec) * 1000000000ull
+        + stopped.tv_nsec - started.tv_nsec;
+
+      if (waitret == pid) {
         running = 0;
+      } else if (timeout && test->wall > timeout && !timedout) {
+        /* the test is reaped on one of the next rounds */
+        kill(pid, SIGKILL);
+        timedout = 1;
+      }
 
-      err = ioctl(cntlout[0], FIONREAD, &bytes);
+      err = bt_test_receive(bt_test_arena(self, elf), test, cntlout[0], results, &done);
       if (err)
         goto loop_io_failure;
-      for (size_t n = 0; n < bytes; n+= sizeof(rec)) {
-        read(cntlout[0], &rec, sizeof(rec));
+
+      if (logfd != -1) {
+        /* move the output from the pipe to the log file in kernel space */
+        while ((length = splice(pipeout[0], NULL, logfd, NULL, BT_SPLICE_CHUNK,
+                    SPLICE_F_MOVE | SPLICE_F_NONBLOCK)) > 0) ;
+        if (length == -1 && errno != EAGAIN)
+          goto loop_io_failure;
+        continue;
       }
 
       err = ioctl(pipeout[0], FIONREAD, &bytes);
@@ -1362,63 +2448,117 @@ int bt_chopper(bt_t * self, bt_elf_t * elf, bt_suite_t * suite, bt_test_t * test
     } while (running);
 
     close(pipeout[0]); /* close read end of log stream */
-    close(pipeout[0]); /* close read end of control stream */
+    close(cntlout[0]); /* close butcher end of control stream */
+    if (logfd != -1)
+      close(logfd);
+    logfd = -1;
 
     if (buffer) {
       /* terminate the buffer */
       buffer[buffer_cur] = '\0';
     }
 
-    i = 0;
-    while (i < buffer_cur) {
-      for (n = i; n < buffer_cur && (c = buffer[n]) != '\n' && c != '\r' && c != '\0'; n++) ;
-      err = bt_log_msgcpy(test->log, buffer + i, n - i);
+    err = bt_log_parse(test->log, buffer, buffer_cur);
+    if (err)
+      goto parse_failure;
+
+    /* a range is summed up by the complexity that fits its sizes */
+    if (test->nbench > 1) {
+      test->fit = bt_arena_alloc(bt_test_arena(self, elf), sizeof(bt_fit_t));
+      if (!test->fit) {
+        err = ENOMEM;
+        goto failure;
+      }
+      err = bt_stats_fit(test->bench, test->nbench, test->fit);
       if (err)
-        goto parse_failure;
-      i = n + 1;
+        goto failure;
     }
 
     free(buffer);
 
+    if (slot) {
+      struct bt_board_slot copy;
+
+      /* fill in whatever got lost on the control channel, unless bexec
+       * died while writing the slot; then the passes it did not tell us
+       * about count as corrupted and the slot is ours to repair */
+      if (bt_board_slot_read(slot, &copy) == 0) {
+        for (int i = 0; i < BT_PASS_MAX; i++) {
+          if (results[i] == BT_TEST_NONE && copy.results[i] > BT_TEST_NONE) {
+            results[i] = copy.results[i];
+            test->elapsed[i] = copy.end[i] - copy.start[i];
+            test->counters[i] = copy.counters[i];
+          }
+        }
+        if (copy.state == BT_SLOT_DONE)
+          done = 1;
+      } else {
+        done = 0;
+        bt_log_msgcpy(test->log, "(board slot torn)", -1);
+        __atomic_fetch_add(&slot->seq, 1, __ATOMIC_RELEASE);
+      }
+
+      bt_board_slot_begin(slot);
+      slot->state = BT_SLOT_DONE;
+      bt_board_slot_end(slot);
+
+      __atomic_fetch_add(&self->board->finished, 1, __ATOMIC_RELAXED);
+    }
+
     if (WIFEXITED(status)) {
-      if (!rec.done) {
+      if (!done) {
         for (int i = 0; i < BT_PASS_MAX; i++) {
-          test->results[i] = BT_TEST_CORRUPTED;
+          elf->results[t][i] = BT_TEST_CORRUPTED;
         }
         char msg[32];
         snprintf(msg, 32, "(test was aborted)");
         bt_log_msgcpy(test->log, msg, -1);
         fprintf(self->fd, "running suite '%s', test '%s'... aborted (how could that happen?!)\n",
-          suite->name, test->name);
+          bt_elf_suite_name(elf, s), bt_elf_test_name(elf, t));
         return 0;
       }
 
-      fprintf(self->fd, "running suite '%s', test '%s'... ", suite->name, test->name);
+      fprintf(self->fd, "running suite '%s', test '%s'... ", bt_elf_suite_name(elf, s), bt_elf_test_name(elf, t));
       int max = BT_TEST_NONE;
       for (int i = 0; i < BT_PASS_MAX; i++) {
-        test->results[i] = rec.results[i];
-        if (max < test->results[i]) {
-          max = test->results[i];
+        elf->results[t][i] = results[i];
+        if (max < elf->results[t][i]) {
+          max = elf->results[t][i];
         }
       }
-      if (max == BT_TEST_SUCCEEDED) {
+      if (max == BT_TEST_SUCCEEDED && test->fit) {
+        fprintf(self->fd, "passed, %s\n", bt_complexity_names[test->fit->complexity]);
+      } else if (max == BT_TEST_SUCCEEDED && test->bench) {
+        fprintf(self->fd, "passed, %.4g %s\n", test->bench->median, bt_bench_unit(test->bench));
+      } else if (max == BT_TEST_SUCCEEDED) {
         fprintf(self->fd, "passed\n");
       } else {
         fprintf(self->fd, "failed\n");
       }
     } else if (WIFSIGNALED(status)) {
+      /* the pass that was running is the first one that is there and has
+       * no result; it failed if it ran out of time, it crashed if not */
       for (int i = 0; i < BT_PASS_MAX; i++) {
-        if (rec.results[i] > BT_TEST_NONE)
-          test->results[i] = rec.results[i];
+        if (results[i] > BT_TEST_NONE)
+          elf->results[t][i] = results[i];
+        else if ((i == BT_PASS_SETUP && elf->setupids[t] == BT_NO_ID)
+            || (i == BT_PASS_TEARDOWN && elf->teardownids[t] == BT_NO_ID))
+          elf->results[t][i] = BT_TEST_NONE;
         else {
-          test->results[i] = BT_TEST_CORRUPTED;
+          elf->results[t][i] = timedout ? BT_TEST_FAILED : BT_TEST_CORRUPTED;
           break;
         }
       }
       char msg[32];
-      snprintf(msg, 32, "(exited with signal %d)", WTERMSIG(status));
-      bt_log_msgcpy(test->log, msg, -1);
-      fprintf(self->fd, "running suite '%s', test '%s'... signaled!\n", suite->name, test->name);
+      if (timedout) {
+        snprintf(msg, 32, "(timed out after %llus)", (unsigned long long) (timeout / 1000000000ull));
+        bt_log_msgcpy(test->log, msg, -1);
+        fprintf(self->fd, "running suite '%s', test '%s'... timed out!\n", bt_elf_suite_name(elf, s), bt_elf_test_name(elf, t));
+      } else {
+        snprintf(msg, 32, "(exited with signal %d)", WTERMSIG(status));
+        bt_log_msgcpy(test->log, msg, -1);
+        fprintf(self->fd, "running suite '%s', test '%s'... signaled!\n", bt_elf_suite_name(elf, s), bt_elf_test_name(elf, t));
+      }
     }
 
     return 0;
@@ -1432,7 +2572,8 @@ loop_wait_fail:
 loop_io_failure:
     if (!self->debugger)
       close(pipeout[0]);
-    err = errno;
+    if (!err)
+      err = errno;
     goto failure;
 
 loop_oom_failure:
@@ -1448,8 +2589,151 @@ parse_failure:
 failure:
     if (buffer)
       free(buffer);
+    if (logfd != -1)
+      close(logfd);
+    return_error(err);
+  }
+}
+
+/**
+ * describes a test for the reporters
+ *
+ * @param[out] event the event to fill in
+ * @param[in] elf the shared object where test is defined
+ * @param[in] s the index of the suite where test is defined
+ * @param[in] t the index of the test
+ */
+
+static
+void bt_test_event(bt_event_t * event, bt_elf_t * elf, unsigned s, unsigned t)
+{
+  bt_test_t * test = &elf->tests[t];
+
+  event->elf = elf->name;
+  event->suite = bt_elf_suite_name(elf, s);
+  event->test = bt_elf_test_name(elf, t);
+  event->result = bt_worst_result(elf->results[t]);
+  event->results = elf->results[t];
+  event->elapsed = test->elapsed;
+  event->counters = test->counters;
+  event->ru = &test->ru;
+  event->wall = test->wall;
+  event->assertion = test->assertion;
+  event->reason = test->reason;
+  event->log = test->log;
+  event->logfile = test->logfile;
+  event->bench = test->bench;
+  event->samples = test->samples;
+  event->nbench = test->nbench;
+  event->fit = test->fit;
+}
+
+/**
+ * runs a single test and hands the outcome to the reporters
+ *
+ * @param[in] self a pointer the butcher
+ * @param[in] elf the shared object where test is defined
+ * @param[in] s the index of the suite where test is defined
+ * @param[in] t the index of the test to run
+ *
+ * @return the operation error code
+ */
+
+static
+int bt_chop_test(bt_t * self, bt_elf_t * elf, unsigned s, unsigned t)
+{
+  bt_test_t * test = &elf->tests[t];
+  bt_event_t event;
+  int err;
+
+  if (self->reporters) {
+    bt_test_event(&event, elf, s, t);
+    err = bt_reporters_test_start(self, &event);
+    if (err)
+      return_error(err);
+  }
+
+  err = bt_chopper(self, elf, s, t);
+  if (err)
+    return_error(err);
+
+  /* a benchmark that got slower fails the run like a test */
+  if (self->baseline && test->nbench && bt_worst_result(elf->results[t]) == BT_TEST_SUCCEEDED) {
+    char msg[256];
+    int regressed;
+
+    err = bt_baseline_check(self->baseline,
+        bt_test_key(elf->name, bt_elf_suite_name(elf, s), bt_elf_test_name(elf, t)),
+        test, self->threshold, &regressed, msg, sizeof(msg));
+    if (err)
+      return_error(err);
+
+    if (regressed) {
+      elf->results[t][BT_PASS_TEST] = BT_TEST_REGRESSED;
+      self->regressions++;
+      bt_log_msgcpy(test->log, msg, -1);
+      fprintf(self->fd, "running suite '%s', test '%s'... regressed!\n",
+          bt_elf_suite_name(elf, s), bt_elf_test_name(elf, t));
+    }
+  }
+
+  if (self->reporters) {
+    if (bt_worst_result(elf->results[t]) > BT_TEST_SUCCEEDED) {
+      err = bt_test_load_logfile(test);
+      if (err)
+        return_error(err);
+    }
+
+    bt_test_event(&event, elf, s, t);
+    err = bt_reporters_test_end(self, &event);
+    if (err)
+      return_error(err);
+  }
+
+  /* nobody is going to look at the log of a passed test again */
+  if (!self->messages && bt_worst_result(elf->results[t]) <= BT_TEST_SUCCEEDED && test->log) {
+    bt_log_delete(&test->log);
+    test->log = NULL;
+  }
+
+  return 0;
+}
+
+/**
+ * runs the tests of a streamed elf in the order of its records
+ *
+ * @param[in] self a pointer the butcher
+ * @param[in] elf the elf
+ *
+ * @return the operation error code
+ */
+
+static
+int bt_chop_stream(bt_t * self, bt_elf_t * elf)
+{
+  int err;
+
+  err = bt_stream_rewind(elf);
+  if (err)
     return_error(err);
+
+  while ((err = bt_stream_next(elf)) == 0) {
+    if (!bt_selector_suite(&self->selector, bt_elf_suite_name(elf, 0))
+        || !bt_selector_tags(&self->selector, elf->tags[0])
+        || !bt_selector_test(&self->selector, elf->name, bt_elf_suite_name(elf, 0), bt_elf_test_name(elf, 0)))
+      continue;
+
+    err = bt_chop_test(self, elf, 0, 0);
+    if (err)
+      return_error(err);
+
+    if (bt_worst_result(elf->results[0]) > BT_TEST_NONE)
+      elf->stream->results[bt_worst_result(elf->results[0])]++;
   }
+  if (err != ENOENT)
+    return_error(err);
+
+  return 0;
 }
 
 /**
@@ -1464,44 +2748,178 @@ int bt_chop(bt_t * self)
 {
   bt_elf_t * elf_cur;
   bt_suite_t * suite_cur;
-  bt_test_t * test_cur;
   int err;
-  unsigned n, m;
-
-
+  unsigned n, t, nelfs, size;
 
   if (!self || !self->initialized)
     return_error(EINVAL);
 
+  if (!self->debugger) {
+    bt_board_close(self);
+    err = bt_board_open(self);
+    if (err)
+      return_error(err);
+  }
+
+  err = bt_selector_compile(&self->selector);
+  if (err)
+    return_error(err);
+
+  err = bt_reporters_run_start(self);
+  if (err)
+    return_error(err);
+
+  nelfs = 0;
+  for (elf_cur = self->elfs; elf_cur; elf_cur = elf_cur->next)
+    nelfs++;
+
   elf_cur = self->elfs;
-  while (elf_cur) {
-    for (n = 0; n < elf_cur->hsize; n++) {
-      suite_cur = elf_cur->hsuites[n];
-      while (suite_cur) {
-        if (!regexec(&self->sregex, suite_cur->name, 0, NULL, 0)) {
-          for (m = 0; m < suite_cur->hsize; m++) {
-            test_cur = suite_cur->htests[m];
-            while (test_cur) {
-              if (!regexec(&self->tregex, test_cur->name, 0, NULL, 0)) {
-                err = bt_chopper(self, elf_cur, suite_cur, test_cur);
-                if (err)
-                  return_error(err);
-              }
+  for (;;) {
+    /* objects of bt_loadv() are run as soon as they are loaded, the ones
+     * after them are still loading meanwhile */
+    if (!elf_cur) {
+      err = bt_loader_take(self, &elf_cur);
+      if (err)
+        return_error(err);
+      if (!elf_cur)
+        break;
+      if (self->board) {
+        err = bt_board_add(self, elf_cur, nelfs);
+        if (err)
+          return_error(err);
+      }
+      nelfs++;
+    }
 
-              test_cur = test_cur->next;
-            }
+    if (elf_cur->stream) {
+      err = bt_chop_stream(self, elf_cur);
+      if (err)
+        return_error(err);
+      elf_cur = elf_cur->next;
+      continue;
+    }
+
+    /* the small tests of a suite first, so failures show up early; the
+     * order of declaration is kept within a size class and the suites are
+     * not split up, the reporters see them one after the other */
+    for (n = 0; n < elf_cur->nsuites; n++) {
+      suite_cur = &elf_cur->suites[n];
+      if (!bt_selector_suite(&self->selector, bt_elf_suite_name(elf_cur, n)))
+        continue;
+      for (size = 0; size < BT_SIZE_CLASSES; size++) {
+        for (t = suite_cur->first; t < suite_cur->first + suite_cur->count; t++) {
+          if (bt_size_class(elf_cur->tags[t]) != size
+              || !bt_selector_tags(&self->selector, elf_cur->tags[t]))
+            continue;
+          if (bt_selector_test(&self->selector, elf_cur->name,
+                bt_elf_suite_name(elf_cur, n), bt_elf_test_name(elf_cur, t))) {
+            err = bt_chop_test(self, elf_cur, n, t);
+            if (err)
+              return_error(err);
           }
         }
-
-        suite_cur = suite_cur->next;
       }
     }
 
     elf_cur = elf_cur->next;
   }
+
+  err = bt_reporters_run_end(self);
+  if (err)
+    return_error(err);
+
   return 0;
 }
 
+/**
+ * reports the performance counters of every pass of a test that has them,
+ * followed by the instructions per cycle and the miss rates if both of
+ * their events were counted
+ *
+ * @param[in] self a pointer the butcher
+ * @param[in] test the test
+ * @param[in] results the results of its passes
+ */
+
+static
+void bt_report_perf(bt_t * self, const bt_test_t * test, const char * results)
+{
+  static const char * const names[BT_PERF_MAX] = {
+    "CYC", "INS", "BR", "BM", "CR", "CM", "TC", "PGF", "CS", "MIG",
+  };
+
+  for (int i = 0; i < BT_PASS_MAX; i++) {
+    const bt_counters_t * counters = &test->counters[i];
+    uint32_t mask = counters->perf_mask;
+
+    if (results[i] <= BT_TEST_NONE || !mask)
+      continue;
+
+    fprintf(self->fd, "   P(%s)",
+        i == BT_PASS_SETUP ? "setup" : i == BT_PASS_TEST ? "test" : "teardown");
+    for (int e = 0; e < BT_PERF_MAX; e++) {
+      if (mask & (1u << e))
+        fprintf(self->fd, " %s:%llu", names[e], (unsigned long long) counters->perf[e]);
+    }
+
+#define HAS(a, b) ((mask & (1u << (a))) && (mask & (1u << (b))) && counters->perf[a])
+    if (HAS(BT_PERF_CYCLES, BT_PERF_INSTRUCTIONS))
+      fprintf(self->fd, " IPC:%.2f",
+          (double) counters->perf[BT_PERF_INSTRUCTIONS] / counters->perf[BT_PERF_CYCLES]);
+    if (HAS(BT_PERF_BRANCHES, BT_PERF_BRANCH_MISSES))
+      fprintf(self->fd, " BM%%:%.2f",
+          100.0 * counters->perf[BT_PERF_BRANCH_MISSES] / counters->perf[BT_PERF_BRANCHES]);
+    if (HAS(BT_PERF_CACHE_REFERENCES, BT_PERF_CACHE_MISSES))
+      fprintf(self->fd, " CM%%:%.2f",
+          100.0 * counters->perf[BT_PERF_CACHE_MISSES] / counters->perf[BT_PERF_CACHE_REFERENCES]);
+#undef HAS
+
+    fprintf(self->fd, "\n");
+  }
+}
+
+/**
+ * reports the timings of a benchmark, a range by the complexity that fits
+ * it followed by its sizes
+ *
+ * @param[in] self a pointer the butcher
+ * @param[in] elf the shared object where the benchmark is defined
+ * @param[in] t the index of the benchmark
+ */
+
+static
+void bt_report_bench(bt_t * self, bt_elf_t * elf, unsigned t)
+{
+  const bt_test_t * test = &elf->tests[t];
+  const bt_bench_t * bench = test->bench;
+
+  if (test->fit)
+    fprintf(self->fd, "  [%sbench%s, name='%s%s%s'] %s%s%s, %.4g %s * f(n), RMS %.1f%%\n",
+        self->color ? PURPLE : "", self->color ? ENDCOL : "",
+        self->color ? RED : "", bt_elf_test_name(elf, t), self->color ? ENDCOL : "",
+        self->color ? CYAN : "", bt_complexity_names[test->fit->complexity], self->color ? ENDCOL : "",
+        test->fit->coefficient, bench->unit == BT_BENCH_INSTRUCTIONS ? "insn" : "ns",
+        test->fit->rms * 100);
+
+  for (unsigned k = 0; k < test->nbench; k++, bench++) {
+    if (test->fit)
+      fprintf(self->fd, "   n=%llu: %.4g %s, MAD %.3g, 95%% CI [%.4g, %.4g]\n",
+          (unsigned long long) bench->n, bench->median, bt_bench_unit(bench),
+          bench->mad, bench->ci_low, bench->ci_high);
+    else
+      fprintf(self->fd, "  [%sbench%s, name='%s%s%s'] %s%.4g%s %s, MAD %.3g, 95%% CI [%.4g, %.4g]\n",
+          self->color ? PURPLE : "", self->color ? ENDCOL : "",
+          self->color ? RED : "", bt_elf_test_name(elf, t), self->color ? ENDCOL : "",
+          self->color ? CYAN : "", bench->median, self->color ? ENDCOL : "", bt_bench_unit(bench),
+          bench->mad, bench->ci_low, bench->ci_high);
+
+    if (self->verbose)
+      fprintf(self->fd, "   mean %.4g, stddev %.3g, min %.4g, max %.4g, %u samples of %llu ops\n",
+          bench->mean, bench->stddev, bench->min, bench->max,
+          bench->nsamples, (unsigned long long) bench->operations);
+  }
+}
+
 /**
  * reports results of the chopper phase
  *
@@ -1515,6 +2933,7 @@ int bt_report(bt_t * self)
   bt_elf_t * elf_cur;
   bt_suite_t * suite_cur;
   bt_test_t * test_cur;
+  const char * results_cur;
   bt_log_line_t * line_cur;
 
   if (!self || !self->initialized)
@@ -1522,7 +2941,12 @@ int bt_report(bt_t * self)
 
   unsigned int    allresults[BT_TEST_MAX] = {0};
   int             allcount = 0;
-  unsigned n, m;
+  unsigned n, t;
+
+  /* all objects are in, in case bt_chop() was not called */
+  int err = bt_loader_finish(self);
+  if (err)
+    return_error(err);
 
   if (self->verbose)
     fprintf(self->fd, "%slisting results for loaded objects%s (worst counts)...\n\n",
@@ -1534,200 +2958,274 @@ int bt_report(bt_t * self)
         self->color ? YELLOW : "", self->color ? ENDCOL : "",
         self->color ? RED : "", elf_cur->name, self->color ? ENDCOL : "");
 
-    for (n = 0; n < elf_cur->hsize; n++) {
-      suite_cur = elf_cur->hsuites[n];
-      while (suite_cur) {
-        fprintf(self->fd, " [%ssuite%s, name='%s%s%s']\n",
-            self->color ? BLUE : "", self->color ? ENDCOL : "",
-            self->color ? GREEN : "", suite_cur->name, self->color ? ENDCOL : "");
-
-        unsigned int results[BT_TEST_MAX] = {0};
-        int          result;
-        int          count = 0;
-
-        for (m = 0; m < suite_cur->hsize; m++) {
-          test_cur = suite_cur->htests[m];
-          while (test_cur) {
-            result = BT_TEST_NONE;
-            for (int i = 0; i < BT_PASS_MAX; i++) {
-              if (test_cur->results[i] > result)
-                result = test_cur->results[i];
-            }
+    /* nothing is left of the tests of a streamed elf but the counts, the
+     * reporters have seen the rest */
+    if (elf_cur->stream) {
+      const unsigned * results = elf_cur->stream->results;
+      int count = 0;
+
+      for (int i = 0; i < BT_TEST_MAX; i++) {
+        allresults[i] += results[i];
+        count += results[i];
+      }
+      allcount += count;
+
+      if (count) {
+        int choice = results[BT_TEST_IGNORED] + results[BT_TEST_FAILED] + results[BT_TEST_REGRESSED] == 0;
+        fprintf(
+            self->fd,
+            "  => %s%d%s/%d test%s succeeded (%g%%) [%d ignored, %d failed, %d corrupted, %d regressed]\n",
+            self->color ? (choice ? GREEN : RED) : "", results[BT_TEST_SUCCEEDED], self->color ? ENDCOL : "",
+            count, count <= 1 ? "" : "s",
+            (double) results[BT_TEST_SUCCEEDED] / count * 100,
+            results[BT_TEST_IGNORED],
+            results[BT_TEST_FAILED],
+            results[BT_TEST_CORRUPTED],
+            results[BT_TEST_REGRESSED]);
+      }
+
+      elf_cur = elf_cur->next;
+      continue;
+    }
+
+    for (n = 0; n < elf_cur->nsuites; n++) {
+      suite_cur = &elf_cur->suites[n];
+      fprintf(self->fd, " [%ssuite%s, name='%s%s%s']\n",
+          self->color ? BLUE : "", self->color ? ENDCOL : "",
+          self->color ? GREEN : "", bt_elf_suite_name(elf_cur, n), self->color ? ENDCOL : "");
+
+      unsigned int results[BT_TEST_MAX] = {0};
+      int          result;
+      int          count = 0;
 
+      for (t = suite_cur->first; t < suite_cur->first + suite_cur->count; t++) {
+        test_cur = &elf_cur->tests[t];
+        results_cur = elf_cur->results[t];
+        result = BT_TEST_NONE;
+        for (int i = 0; i < BT_PASS_MAX; i++) {
+          if (results_cur[i] > result)
+            result = results_cur[i];
+        }
+
+        if (result > BT_TEST_SUCCEEDED) {
+          fprintf(self->fd, "  [%stest%s, name='%s%s%s']\n",
+              self->color ? PURPLE : "", self->color ? ENDCOL : "",
+              self->color ? RED : "", bt_elf_test_name(elf_cur, t), self->color ? ENDCOL : "");
+        }
+
+        if (self->messages || result > BT_TEST_SUCCEEDED) {
+          int err = bt_test_load_logfile(test_cur);
+          if (err)
+            return_error(err);
+        }
+
+        if ((self->messages || result > BT_TEST_SUCCEEDED) && test_cur->log) {
+          line_cur = test_cur->log->lines;
+          while (line_cur) {
             if (result > BT_TEST_SUCCEEDED) {
-              fprintf(self->fd, "  [%stest%s, name='%s%s%s']\n",
-                  self->color ? PURPLE : "", self->color ? ENDCOL : "",
-                  self->color ? RED : "", test_cur->name, self->color ? ENDCOL : "");
+              fprintf(self->fd, "   %s%s%s\n",
+                  self->color ? RED : "", line_cur->contents, self->color ? ENDCOL : "");
+            } else {
+              fprintf(self->fd, "   %s\n", line_cur->contents);
             }
+            line_cur = line_cur->next;
+          }
+        }
 
-            if ((self->messages || result > BT_TEST_SUCCEEDED) && test_cur->log) {
-              line_cur = test_cur->log->lines;
-              while (line_cur) {
-                if (result > BT_TEST_SUCCEEDED) {
-                  fprintf(self->fd, "   %s%s%s\n",
-                      self->color ? RED : "", line_cur->contents, self->color ? ENDCOL : "");
-                } else {
-                  fprintf(self->fd, "   %s\n", line_cur->contents);
-                }
-                line_cur = line_cur->next;
-              }
-            }
+        if (test_cur->assertion && result > BT_TEST_SUCCEEDED) {
+          fprintf(self->fd, "   %sassertion failed at %s%s\n",
+              self->color ? RED : "", test_cur->assertion, self->color ? ENDCOL : "");
+        }
+        if (test_cur->reason && result > BT_TEST_SUCCEEDED) {
+          fprintf(self->fd, "   %signored at %s%s\n",
+              self->color ? YELLOW : "", test_cur->reason, self->color ? ENDCOL : "");
+        }
 
-            if ((self->verbose && result > BT_TEST_NONE) || result > BT_TEST_SUCCEEDED) {
-              fprintf(self->fd, "   U+S:%lu U:%lu S:%lu MRSS:%ld IXRSS:%ld DU:%ld SU:%ld SPF:%ld PF:%ld SW:%ld OI:%ld OO:%ld MS:%ld MR:%ld SD:%ld\n",
-                (unsigned long)(test_cur->ru.ru_utime.tv_sec * 1000000) + test_cur->ru.ru_utime.tv_usec
-                  + (unsigned long)(test_cur->ru.ru_stime.tv_sec * 1000000) + test_cur->ru.ru_stime.tv_usec,
-                (unsigned long)(test_cur->ru.ru_utime.tv_sec * 1000000) + test_cur->ru.ru_utime.tv_usec,
-                (unsigned long)(test_cur->ru.ru_stime.tv_sec * 1000000) + test_cur->ru.ru_stime.tv_usec,
-                test_cur->ru.ru_maxrss,
-                test_cur->ru.ru_ixrss,
-                test_cur->ru.ru_idrss,
-                test_cur->ru.ru_isrss,
-                test_cur->ru.ru_minflt,
-                test_cur->ru.ru_majflt,
-                test_cur->ru.ru_nswap,
-                test_cur->ru.ru_inblock,
-                test_cur->ru.ru_oublock,
-                test_cur->ru.ru_msgsnd,
-                test_cur->ru.ru_msgrcv,
-                test_cur->ru.ru_nsignals
-              );
-
-              fprintf(self->fd, "   -> results: ");
-            }
+        if ((self->verbose && result > BT_TEST_NONE) || result > BT_TEST_SUCCEEDED) {
+          fprintf(self->fd, "   U+S:%lu U:%lu S:%lu MRSS:%ld IXRSS:%ld DU:%ld SU:%ld SPF:%ld PF:%ld SW:%ld OI:%ld OO:%ld MS:%ld MR:%ld SD:%ld\n",
+            (unsigned long)(test_cur->ru.ru_utime.tv_sec * 1000000) + test_cur->ru.ru_utime.tv_usec
+              + (unsigned long)(test_cur->ru.ru_stime.tv_sec * 1000000) + test_cur->ru.ru_stime.tv_usec,
+            (unsigned long)(test_cur->ru.ru_utime.tv_sec * 1000000) + test_cur->ru.ru_utime.tv_usec,
+            (unsigned long)(test_cur->ru.ru_stime.tv_sec * 1000000) + test_cur->ru.ru_stime.tv_usec,
+            test_cur->ru.ru_maxrss,
+            test_cur->ru.ru_ixrss,
+            test_cur->ru.ru_idrss,
+            test_cur->ru.ru_isrss,
+            test_cur->ru.ru_minflt,
+            test_cur->ru.ru_majflt,
+            test_cur->ru.ru_nswap,
+            test_cur->ru.ru_inblock,
+            test_cur->ru.ru_oublock,
+            test_cur->ru.ru_msgsnd,
+            test_cur->ru.ru_msgrcv,
+            test_cur->ru.ru_nsignals
+          );
+
+          /* counting instructions, they take the place of the time */
+          fprintf(self->fd, self->instructions ? "   I(insn)" : "   T(ns)");
+          for (int i = 0; i < BT_PASS_MAX; i++) {
+            const bt_counters_t * counters = &test_cur->counters[i];
+
+            if (results_cur[i] <= BT_TEST_NONE)
+              continue;
+            if (self->instructions && (counters->perf_mask & (1u << BT_PERF_INSTRUCTIONS)))
+              fprintf(self->fd, " %s:%llu",
+                  i == BT_PASS_SETUP ? "setup" : i == BT_PASS_TEST ? "test" : "teardown",
+                  (unsigned long long) counters->perf[BT_PERF_INSTRUCTIONS]);
+            else if (!self->instructions && test_cur->elapsed[i])
+              fprintf(self->fd, " %s:%llu",
+                  i == BT_PASS_SETUP ? "setup" : i == BT_PASS_TEST ? "test" : "teardown",
+                  (unsigned long long) test_cur->elapsed[i]);
+          }
+          fprintf(self->fd, "\n");
 
-            if (self->messages || result > BT_TEST_SUCCEEDED) {
-              for (int i = 0, flag = 0; i < BT_PASS_MAX; i++) {
-                if (test_cur->results[i] > BT_TEST_NONE) {
-                  if (flag)
-                    fprintf(self->fd, "               ");
-                  else
-                    flag = 1;
-
-                  switch (i) {
-                    case BT_PASS_SETUP:
-                      fprintf(self->fd,
-                        "%ssetup%s ",
-                        self->color ? CYAN : "",
-                        self->color ? ENDCOL : ""); break;
-                    case BT_PASS_TEST:
-                      fprintf(self->fd, "%stest%s ", self->color ? CYAN : "", self->color ? ENDCOL : "");
-                      break;
-                    case BT_PASS_TEARDOWN:
-                      fprintf(self->fd,
-                        "%steardown%s ",
-                        self->color ? CYAN : "",
-                        self->color ? ENDCOL : ""); break;
-                    default:
-                      break;
-                  }
-
-                  switch (test_cur->results[i]) {
-                    case BT_TEST_SUCCEEDED:
-                      fprintf(self->fd,
-                        "%ssucceeded%s\n",
-                        self->color ? GREEN : "",
-                        self->color ? ENDCOL : ""); break;
-                    case BT_TEST_IGNORED:
-                      fprintf(self->fd,
-                        "%signored%s\n",
-                        self->color ? YELLOW : "",
-                        self->color ? ENDCOL : ""); break;
-                    case BT_TEST_FAILED:
-                      fprintf(self->fd, "%sfailed%s\n",
-                        self->color ? RED : "",
-                        self->color ? ENDCOL : ""); break;
-                    case BT_TEST_CORRUPTED:
-                      fprintf(self->fd,
-                        "%scorrupted%s\n",
-                        self->color ? RED : "",
-                        self->color ? ENDCOL : ""); break;
-                    default:
-                      break;
-                  }
-                }
-              }
-            }
+          bt_report_perf(self, test_cur, results_cur);
+
+          fprintf(self->fd, "   -> results: ");
+        }
 
-            if ((self->verbose && result > BT_TEST_NONE) || result > BT_TEST_SUCCEEDED) {
-              if (self->messages || result > BT_TEST_SUCCEEDED)
+        if (self->messages || result > BT_TEST_SUCCEEDED) {
+          for (int i = 0, flag = 0; i < BT_PASS_MAX; i++) {
+            if (results_cur[i] > BT_TEST_NONE) {
+              if (flag)
                 fprintf(self->fd, "               ");
-              switch (result) {
+              else
+                flag = 1;
+
+              switch (i) {
+                case BT_PASS_SETUP:
+                  fprintf(self->fd,
+                    "%ssetup%s ",
+                    self->color ? CYAN : "",
+                    self->color ? ENDCOL : ""); break;
+                case BT_PASS_TEST:
+                  fprintf(self->fd, "%stest%s ", self->color ? CYAN : "", self->color ? ENDCOL : "");
+                  break;
+                case BT_PASS_TEARDOWN:
+                  fprintf(self->fd,
+                    "%steardown%s ",
+                    self->color ? CYAN : "",
+                    self->color ? ENDCOL : ""); break;
+                default:
+                  break;
+              }
+
+              switch (results_cur[i]) {
                 case BT_TEST_SUCCEEDED:
                   fprintf(self->fd,
-                    " -> [%ssucceeded%s]",
-                    self->color ? GREEN CYAN_BG : "",
+                    "%ssucceeded%s\n",
+                    self->color ? GREEN : "",
                     self->color ? ENDCOL : ""); break;
                 case BT_TEST_IGNORED:
                   fprintf(self->fd,
-                    " -> [%signored%s]",
-                    self->color ? GREEN CYAN_BG : "",
+                    "%signored%s\n",
+                    self->color ? YELLOW : "",
                     self->color ? ENDCOL : ""); break;
                 case BT_TEST_FAILED:
-                  fprintf(self->fd,
-                    " -> [%sfailed%s]",
-                    self->color ? RED_BG : "",
+                  fprintf(self->fd, "%sfailed%s\n",
+                    self->color ? RED : "",
                     self->color ? ENDCOL : ""); break;
                 case BT_TEST_CORRUPTED:
                   fprintf(self->fd,
-                    " -> [%scorrupted%s]",
-                    self->color ? RED_BG : "",
+                    "%scorrupted%s\n",
+                    self->color ? RED : "",
+                    self->color ? ENDCOL : ""); break;
+                case BT_TEST_REGRESSED:
+                  fprintf(self->fd,
+                    "%sregressed%s\n",
+                    self->color ? RED : "",
                     self->color ? ENDCOL : ""); break;
                 default:
                   break;
               }
             }
-
-            if ((self->verbose && result > BT_TEST_NONE) || result > BT_TEST_SUCCEEDED)
-              fprintf(self->fd, "\n");
-
-            if (result > BT_TEST_NONE) {
-              results[result]++;
-              count++;
-            }
-
-            test_cur = test_cur->next;
           }
         }
 
-        for (int i = 0; i < BT_TEST_MAX; i++) {
-          allresults[i] += results[i];
+        if ((self->verbose && result > BT_TEST_NONE) || result > BT_TEST_SUCCEEDED) {
+          if (self->messages || result > BT_TEST_SUCCEEDED)
+            fprintf(self->fd, "               ");
+          switch (result) {
+            case BT_TEST_SUCCEEDED:
+              fprintf(self->fd,
+                " -> [%ssucceeded%s]",
+                self->color ? GREEN CYAN_BG : "",
+                self->color ? ENDCOL : ""); break;
+            case BT_TEST_IGNORED:
+              fprintf(self->fd,
+                " -> [%signored%s]",
+                self->color ? GREEN CYAN_BG : "",
+                self->color ? ENDCOL : ""); break;
+            case BT_TEST_FAILED:
+              fprintf(self->fd,
+                " -> [%sfailed%s]",
+                self->color ? RED_BG : "",
+                self->color ? ENDCOL : ""); break;
+            case BT_TEST_CORRUPTED:
+              fprintf(self->fd,
+                " -> [%scorrupted%s]",
+                self->color ? RED_BG : "",
+                self->color ? ENDCOL : ""); break;
+            case BT_TEST_REGRESSED:
+              fprintf(self->fd,
+                " -> [%sregressed%s]",
+                self->color ? RED_BG : "",
+                self->color ? ENDCOL : ""); break;
+            default:
+              break;
+          }
         }
-        allcount += count;
-
-        if (count) {
-          int choice = results[BT_TEST_IGNORED] + results[BT_TEST_FAILED] == 0;
-          fprintf(
-              self->fd,
-              "  => %s%d%s/%d test%s succeeded (%g%%) [%d ignored, %d failed, %d corrupted]\n",
-              self->color ? (choice ? GREEN : RED) : "", results[BT_TEST_SUCCEEDED], self->color ? ENDCOL : "",
-              count, count <= 1 ? "" : "s",
-              (double) results[BT_TEST_SUCCEEDED] / count * 100,
-              results[BT_TEST_IGNORED],
-              results[BT_TEST_FAILED],
-              results[BT_TEST_CORRUPTED]);
+
+        if ((self->verbose && result > BT_TEST_NONE) || result > BT_TEST_SUCCEEDED)
+          fprintf(self->fd, "\n");
+
+        /* the numbers are what a benchmark is run for */
+        if (test_cur->bench)
+          bt_report_bench(self, elf_cur, t);
+
+        if (result > BT_TEST_NONE) {
+          results[result]++;
+          count++;
         }
-        if (self->messages)
-          fprintf(self->fd, "  \n");
+      }
 
-        suite_cur = suite_cur->next;
+      for (int i = 0; i < BT_TEST_MAX; i++) {
+        allresults[i] += results[i];
+      }
+      allcount += count;
+
+      if (count) {
+        int choice = results[BT_TEST_IGNORED] + results[BT_TEST_FAILED] + results[BT_TEST_REGRESSED] == 0;
+        fprintf(
+            self->fd,
+            "  => %s%d%s/%d test%s succeeded (%g%%) [%d ignored, %d failed, %d corrupted, %d regressed]\n",
+            self->color ? (choice ? GREEN : RED) : "", results[BT_TEST_SUCCEEDED], self->color ? ENDCOL : "",
+            count, count <= 1 ? "" : "s",
+            (double) results[BT_TEST_SUCCEEDED] / count * 100,
+            results[BT_TEST_IGNORED],
+            results[BT_TEST_FAILED],
+            results[BT_TEST_CORRUPTED],
+            results[BT_TEST_REGRESSED]);
       }
+      if (self->messages)
+        fprintf(self->fd, "  \n");
     }
 
     elf_cur = elf_cur->next;
   }
 
   {
-    int choice = allresults[BT_TEST_IGNORED] + allresults[BT_TEST_FAILED] == 0;
+    int choice = allresults[BT_TEST_IGNORED] + allresults[BT_TEST_FAILED] + allresults[BT_TEST_REGRESSED] == 0;
     fprintf(
         self->fd,
-        " => %s%d%s/%d test%s succeeded (%g%%) [%d ignored, %d failed, %d corrupted]\n",
+        " => %s%d%s/%d test%s succeeded (%g%%) [%d ignored, %d failed, %d corrupted, %d regressed]\n",
         self->color ? (choice ? GREEN : RED) : "", allresults[BT_TEST_SUCCEEDED], self->color ? ENDCOL : "",
         allcount, allcount <= 1 ? "" : "s",
         (double) allresults[BT_TEST_SUCCEEDED] / allcount * 100,
         allresults[BT_TEST_IGNORED],
         allresults[BT_TEST_FAILED],
-        allresults[BT_TEST_CORRUPTED]);
+        allresults[BT_TEST_CORRUPTED],
+        allresults[BT_TEST_REGRESSED]);
   }
 
   return 0;
@@ -1750,8 +3248,10 @@ int bt_delete(bt_t ** butcher)
 
   self = *butcher;
 
-  regfree(&self->sregex);
-  regfree(&self->tregex);
+  bt_selector_clear(&self->selector);
+
+  /* objects still loading are deleted with the rest */
+  bt_loader_finish(self);
 
   bt_elf_t * cur, * tmp;
   cur = self->elfs;
@@ -1761,13 +3261,31 @@ int bt_delete(bt_t ** butcher)
     cur = tmp;
   }
 
+  bt_board_close(self);
+  free(self->boardpath);
+
+  bt_reporter_t * rcur, * rtmp;
+  rcur = self->reporters;
+  while (rcur) {
+    rtmp = rcur->next;
+    bt_reporter_delete(&rcur);
+    rcur = rtmp;
+  }
+
+  bt_baseline_release(&self->baseline);
+
   free(self->bexec);
+  free(self->logdir);
+  free(self->cachedir);
   for (unsigned int i = 0; i < self->debugger_nargs; i++) {
     if (self->debugger[i])
       free(self->debugger[i]);
   }
   free(self->debugger);
 
+  /* the registry goes in one sweep */
+  bt_arena_release(&self->arena);
+
   free(self);
 
   return 0;
@@ -9,6 +9,7 @@
 
 #define BAPI extern
 #include <errno.h>
+#include <stdint.h>
 #include <stdio.h>
 
 /*#define return_error(_error) return _error*/
@@ -31,6 +32,9 @@ enum {
 #define BT_FLAG_DESCRIPTIONS (1 << 2)
 #define BT_FLAG_MESSAGES (1 << 3)
 #define BT_FLAG_ENVDUMP (1 << 4)
+#define BT_FLAG_STREAM (1 << 5)
+#define BT_FLAG_INSTRUCTIONS (1 << 6) /* time in retired instructions */
+#define BT_FLAG_PERF (1 << 7) /* read the performance counters */
 
 typedef struct bt_tester bt_tester_t;
 
@@ -64,8 +68,56 @@ typedef enum {
   BT_FN_KIND_FTEST,
   BT_FN_KIND_SETUP,
   BT_FN_KIND_TEARDOWN,
+  BT_FN_KIND_BENCH,
 } bt_fn_kind_t;
 
+/*
+ * the flags of a record are its kind in the low bits, the records of a
+ * test have its size class and tags above that (see BT_TEST_TAGGED())
+ */
+#define BT_FN_KIND_MASK 0xfu
+
+#define BT_SIZE_SHIFT 4
+#define BT_SIZE_MASK (3u << BT_SIZE_SHIFT)
+#define BT_SIZE_SMALL (0u << BT_SIZE_SHIFT) /* the default */
+#define BT_SIZE_MEDIUM (1u << BT_SIZE_SHIFT)
+#define BT_SIZE_LARGE (2u << BT_SIZE_SHIFT)
+
+#define BT_TAG_SHIFT 8
+#define BT_TAG_SLOW (1u << 8)
+#define BT_TAG_IO (1u << 9)
+#define BT_TAG_NET (1u << 10)
+#define BT_TAG_FLAKY (1u << 11)
+
+typedef struct bt_rec bt_rec_t;
+
+/*
+ * a record in the compact layout (see BT_COMPACT), the offsets are
+ * relative to the field they are stored in
+ */
+struct bt_rec {
+  int32_t  name;
+  int32_t  extra;
+  int32_t  function;
+  uint32_t flags;
+};
+
+typedef struct bt_bench_arg bt_bench_arg_t;
+typedef struct bt_bench_range bt_bench_range_t;
+
+/* what the loop of a benchmark is run with */
+struct bt_bench_arg {
+  unsigned long long operations;
+  unsigned long      n; /* the input size, 0 for BT_BENCH() */
+};
+
+/* the input sizes of BT_BENCH_RANGE(), from, from * multiplier, ... to */
+struct bt_bench_range {
+  unsigned long from;
+  unsigned long to;
+  unsigned long multiplier;
+};
+
 
 BAPI int bt_new(bt_t ** butcher);
 
@@ -74,19 +126,49 @@ BAPI int bt_init(bt_t * butcher,
     FILE * fd,
     const char * smatch,
     const char * tmatch);
+BAPI int bt_match_suite(bt_t * butcher, const char * pattern);
+BAPI int bt_match_test(bt_t * butcher, const char * pattern);
+BAPI int bt_select_file(bt_t * butcher, const char * path);
+BAPI int bt_select_tags(bt_t * butcher, const char * tags);
 BAPI int bt_tune(bt_t * butcher, unsigned int flags);
 BAPI int bt_debugger(bt_t * butcher, const char * path);
-
+BAPI int bt_logdir(bt_t * butcher, const char * path);
+BAPI int bt_board(bt_t * butcher, const char * path);
+BAPI int bt_cache(bt_t * butcher, const char * dir);
+BAPI int bt_timeout(bt_t * butcher, unsigned seconds);
+BAPI int bt_reporter(bt_t * butcher, const char * spec);
+BAPI int bt_history(bt_t * butcher, const char * path);
+BAPI int bt_history_stats(const char * path, const char * name, unsigned window, FILE * fd);
+BAPI int bt_archive(bt_t * butcher, const char * path);
+BAPI int bt_archive_show(const char * path, const char * name, FILE * fd);
+BAPI int bt_metrics(bt_t * butcher, const char * path, unsigned port);
+BAPI int bt_baseline(bt_t * butcher, const char * path);
+BAPI int bt_baseline_compare(bt_t * butcher, const char * path, double threshold);
+BAPI unsigned bt_regressions(bt_t * butcher);
+
+BAPI int bt_discover(bt_t * butcher, const char * dir, unsigned * count, char *** paths);
 BAPI int bt_loadv(bt_t * self, int paramc, char * paramv[]);
 BAPI int bt_load(bt_t * butcher, const char * elfname);
 
 BAPI int bt_list(bt_t * butcher);
 BAPI int bt_chop(bt_t * butcher);
 BAPI int bt_report(bt_t * butcher);
+BAPI int bt_compare(bt_t * butcher, unsigned rounds);
 
 BAPI int bt_delete(bt_t ** butcher);
 
 BAPI void bt_backtrace();
+BAPI void bt_assertion(const char * file, int line, const char * expression);
+BAPI void bt_ignored(const char * file, int line, const char * reason);
+
+/*
+ * formats a log record into a buffer private to the calling thread; the
+ * buffer is written out in one go when it is full, when the thread exits
+ * and when the test is done, every record is tagged with the thread id and
+ * the time since bexec has started
+ */
+BAPI void bt_logf(const char * format, ...) __attribute__ ((format (printf, 1, 2)));
+BAPI void bt_log_flush();
 
 /**
  *
@@ -108,65 +190,229 @@ BAPI void bt_backtrace();
  *    ...
  *  }
  * ~~~snap~~~
+ *
+ * every pointer in there takes a relocation whenever the object is loaded,
+ * which adds up for generated objects with many tests; with BT_COMPACT
+ * defined before "bt.h" is included, the records are bt_rec instead and go
+ * to the section bexec_compact, the names to bexec_strings, all of it
+ * resolved by the linker; an object may have records in both layouts, the
+ * ones in bexec are numbered first
+ *
+ * BT_TEST_TAGGED(<suite>, <test>, BT_SIZE_LARGE | BT_TAG_NET) and
+ * BT_TEST_FIXTURE_TAGGED() put the size class and tags into the flags of
+ * the record of the test, the butcher selects tests by them (--tags), runs
+ * the small tests of a suite first and gives a test as much time as its
+ * size class allows
+ *
+ * BT_BENCH(<suite>, <benchmark>) {...} is a test whose body is one
+ * operation: bexec warms it up, picks a number of operations that takes
+ * long enough to be timed and runs the body that many times per sample;
+ * the butcher reports the time per operation over the samples; a benchmark
+ * fails like a test does, as soon as the body does not return
+ * BT_RESULT_OK; it has no fixtures, the record points to a function that
+ * takes a pointer to a bt_bench_arg with the number of operations to run
+ *
+ * BT_BENCH_RANGE(<suite>, <benchmark>, 8, 8192, 4) {...} is a benchmark
+ * whose body sees an input size bt_n, it is run for bt_n = 8, 32, ... up to
+ * 8192; the butcher fits the times to O(1), O(log n), O(n), O(n log n) and
+ * O(n^2) and reports the one that fits best, so a quadratic that sneaks in
+ * shows up as such and not as a slower constant factor; bexec asks the
+ * function of a benchmark for its range by passing NULL and a pointer to a
+ * bt_bench_range pointer, which is left NULL by BT_BENCH()
  */
 
 /* client interface */
 
 /* macro voodoo */
 
-#define BT_TEST(_suite, _name) \
+#ifndef BT_COMPACT
+
+#define BT_TEST_TAGGED(_suite, _name, _tags) \
   static int _name(); \
-  static const bt_fn_t _name##rec __attribute__ ((section ("bexec"))) = { \
+  static const bt_fn_t _name##rec __attribute__ ((used, section ("bexec"))) = { \
     #_name, \
     #_suite, \
-    BT_FN_KIND_PTEST, \
+    BT_FN_KIND_PTEST | (_tags), \
     _name, \
   };\
   static int _name()
 
-#define BT_TEST_FIXTURE(_suite, _name, _setup, _teardown, _arg) \
-  static const bt_fn_t _name##_setup_rec __attribute__ ((section ("bexec"))) = { \
+#define BT_TEST_FIXTURE_TAGGED(_suite, _name, _setup, _teardown, _arg, _tags) \
+  static const bt_fn_t _name##_setup_rec __attribute__ ((used, section ("bexec"))) = { \
     #_name, \
     #_suite, \
     BT_FN_KIND_SETUP, \
     _setup, \
   };\
-  static const bt_fn_t _name##_teardown_rec __attribute__ ((section ("bexec"))) = { \
+  static const bt_fn_t _name##_teardown_rec __attribute__ ((used, section ("bexec"))) = { \
     #_name, \
     #_suite, \
     BT_FN_KIND_TEARDOWN, \
     _teardown, \
   };\
   static int _name(void *); \
-  static const bt_fn_t _name##rec __attribute__ ((section ("bexec"))) = { \
+  static const bt_fn_t _name##rec __attribute__ ((used, section ("bexec"))) = { \
     #_name, \
     #_suite, \
-    BT_FN_KIND_FTEST, \
+    BT_FN_KIND_FTEST | (_tags), \
     (int (*)(void *, void **)) _name, \
   };\
   static int _name(void * _arg)
 
+#define _BT_BENCH_REC(_suite, _name, _flags) \
+  static const bt_fn_t _name##rec __attribute__ ((used, section ("bexec"))) = { \
+    #_name, \
+    #_suite, \
+    _flags, \
+    _name, \
+  };
+
+#else /* BT_COMPACT */
+
+/* emits a record and its names from inside a function that is never
+ * called, which is the only place the address of a function can be handed
+ * to the assembler; _op and _flagsop are the operands of the function and
+ * the flags */
+#define _BT_REC_ASM(_suite, _name, _op, _flagsop) \
+  ".pushsection bexec_strings, \"a\"\n" \
+  "1: .asciz \"" #_name "\"\n" \
+  "2: .asciz \"" #_suite "\"\n" \
+  ".popsection\n" \
+  ".pushsection bexec_compact, \"a\"\n" \
+  ".balign 4\n" \
+  ".long 1b - .\n" \
+  ".long 2b - .\n" \
+  ".long %c" #_op " - .\n" \
+  ".long %c" #_flagsop "\n" \
+  ".popsection\n"
+
+#define BT_TEST_TAGGED(_suite, _name, _tags) \
+  static int _name(); \
+  __attribute__((used)) \
+  static void _name##rec(void) \
+  { \
+    __asm__ (_BT_REC_ASM(_suite, _name, 0, 1) \
+      :: "i" (_name), "i" (BT_FN_KIND_PTEST | (_tags))); \
+  } \
+  static int _name()
+
+#define BT_TEST_FIXTURE_TAGGED(_suite, _name, _setup, _teardown, _arg, _tags) \
+  static int _name(void *); \
+  __attribute__((used)) \
+  static void _name##rec(void) \
+  { \
+    __asm__ ( \
+      _BT_REC_ASM(_suite, _name, 0, 3) \
+      _BT_REC_ASM(_suite, _name, 1, 4) \
+      _BT_REC_ASM(_suite, _name, 2, 5) \
+      :: "i" (_setup), "i" (_teardown), "i" (_name), \
+         "i" (BT_FN_KIND_SETUP), "i" (BT_FN_KIND_TEARDOWN), "i" (BT_FN_KIND_FTEST | (_tags))); \
+  } \
+  static int _name(void * _arg)
+
+#define _BT_BENCH_REC(_suite, _name, _flags) \
+  __attribute__((used)) \
+  static void _name##rec(void) \
+  { \
+    __asm__ (_BT_REC_ASM(_suite, _name, 0, 1) :: "i" (_name), "i" (_flags)); \
+  }
+
+#endif /* BT_COMPACT */
+
+#define BT_TEST(_suite, _name) \
+  BT_TEST_TAGGED(_suite, _name, 0)
+
+#define BT_TEST_FIXTURE(_suite, _name, _setup, _teardown, _arg) \
+  BT_TEST_FIXTURE_TAGGED(_suite, _name, _setup, _teardown, _arg, 0)
+
+/* the operation is inlined into the loop, so the loop costs next to
+ * nothing compared to a call per operation */
+#define BT_BENCH_TAGGED(_suite, _name, _tags) \
+  static inline int _name##_op(void) __attribute__((always_inline)); \
+  static int _name(void * _arg, void ** _range) \
+  { \
+    if (_range) { \
+      *_range = NULL; \
+      return BT_RESULT_OK; \
+    } \
+    for (unsigned long long _n = ((const bt_bench_arg_t *) _arg)->operations; _n; _n--) { \
+      int _result = _name##_op(); \
+      if (_result != BT_RESULT_OK) \
+        return _result; \
+    } \
+    return BT_RESULT_OK; \
+  } \
+  _BT_BENCH_REC(_suite, _name, BT_FN_KIND_BENCH | (_tags)) \
+  static inline int _name##_op(void)
+
+#define BT_BENCH(_suite, _name) \
+  BT_BENCH_TAGGED(_suite, _name, 0)
+
+#define BT_BENCH_RANGE_TAGGED(_suite, _name, _from, _to, _multiplier, _tags) \
+  static inline int _name##_op(unsigned long bt_n) __attribute__((always_inline)); \
+  static int _name(void * _arg, void ** _range) \
+  { \
+    static const bt_bench_range_t _name##_range = {_from, _to, _multiplier}; \
+    if (_range) { \
+      *_range = (void *) &_name##_range; \
+      return BT_RESULT_OK; \
+    } \
+    const unsigned long _size = ((const bt_bench_arg_t *) _arg)->n; \
+    for (unsigned long long _n = ((const bt_bench_arg_t *) _arg)->operations; _n; _n--) { \
+      int _result = _name##_op(_size); \
+      if (_result != BT_RESULT_OK) \
+        return _result; \
+    } \
+    return BT_RESULT_OK; \
+  } \
+  _BT_BENCH_REC(_suite, _name, BT_FN_KIND_BENCH | (_tags)) \
+  static inline int _name##_op(unsigned long bt_n)
+
+#define BT_BENCH_RANGE(_suite, _name, _from, _to, _multiplier) \
+  BT_BENCH_RANGE_TAGGED(_suite, _name, _from, _to, _multiplier, 0)
+
+/* the sections are looked up by bexec, either one may be missing */
 #define BT_EXPORT() \
-  extern const struct test __start_bexec, __stop_bexec;\
+  extern const struct test __start_bexec __attribute__((weak)), __stop_bexec __attribute__((weak)); \
+  extern const struct test __start_bexec_compact __attribute__((weak)), __stop_bexec_compact __attribute__((weak)); \
   __attribute__((used)) \
-  static const struct test * __export_bexec[2] = {&__start_bexec, &__stop_bexec}
+  static const struct test * __export_bexec[4] = { \
+    &__start_bexec, &__stop_bexec, &__start_bexec_compact, &__stop_bexec_compact \
+  }
 
 
 /* test functors */
 
+/* makes the compiler believe the value is used, so the computation of it
+ * is not optimized away in a benchmark */
+#define bt_do_not_optimize(__value) \
+  __asm__ __volatile__ ("" : : "r,m" (__value) : "memory")
+
+/* makes the compiler believe all memory is read and written, so stores in
+ * a benchmark are not optimized away */
+#define bt_clobber() \
+  __asm__ __volatile__ ("" : : : "memory")
+
 #include <stdio.h>
 #include <unistd.h>
 
 #define bt_log(...) \
   do { \
-    fprintf(stdout, __VA_ARGS__); \
+    bt_logf(__VA_ARGS__); \
+  } while (0)
+
+#define bt_ignore(__reason) \
+  do { \
+    bt_ignored(__FILE__, __LINE__, __reason); \
+    return BT_RESULT_IGNORE; \
   } while (0)
 
 #define bt_assert(__expr) \
   do { \
     if (!(__expr)) { \
+      bt_assertion(__FILE__, __LINE__, # __expr); \
       bt_backtrace(); \
-      printf( \
+      bt_logf( \
           "%s:%s:%d: Assertion " # __expr " failed\n", \
           __FILE__, \
           __FUNCTION__, \
@@ -179,8 +425,9 @@ BAPI void bt_backtrace();
 #define _bt_assert_type_equal(__type, __fmt, __actual, __expected, __not, __extra) \
   do { \
     if (!((__actual) == (__expected))) { \
+      bt_assertion(__FILE__, __LINE__, # __actual " == " # __expected); \
       bt_backtrace(); \
-      printf("%s:%s:%d:\n  Assertion failed: expeced " # __actual \
+      bt_logf("%s:%s:%d:\n  Assertion failed: expeced " # __actual \
           " to be " __not __fmt ", got " __fmt __extra "\n", \
           __FILE__, __FUNCTION__, __LINE__, \
           (__type) __expected, (__type) __actual); \
@@ -193,8 +440,9 @@ BAPI void bt_backtrace();
     __type act = (__actual); \
     __type exp = (__expected);\
     if (((act) == (exp))) { \
+      bt_assertion(__FILE__, __LINE__, # __actual " != " # __expected); \
       bt_backtrace(); \
-      printf("%s:%s:%d:\n  Assertion failed: expeced " # __actual \
+      bt_logf("%s:%s:%d:\n  Assertion failed: expeced " # __actual \
           " "__not "to be " __fmt ", got " __fmt __extra "\n", \
           __FILE__, __FUNCTION__, __LINE__, \
           (__type) exp, (__type) act); \
@@ -205,8 +453,9 @@ BAPI void bt_backtrace();
 #define bt_assert_str_equal(__actual, __expected) \
   do { \
     if (strcmp((__actual), (__expected)) != 0) { \
+      bt_assertion(__FILE__, __LINE__, # __actual " == " # __expected); \
       bt_backtrace(); \
-      printf("%s:%s:%d:\n  Assertion failed: expeced '%s' , got '%s' \n", \
+      bt_logf("%s:%s:%d:\n  Assertion failed: expeced '%s' , got '%s' \n", \
           __FILE__, __FUNCTION__, __LINE__, \
           (__expected), (__actual)); \
       return BT_RESULT_FAIL; \
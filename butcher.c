@@ -30,6 +30,29 @@ enum butcher_opt {
   OPT_VALGRIND,
   OPT_CGDB,
   OPT_GDB,
+  OPT_LOGDIR,
+  OPT_BOARD,
+  OPT_REPORTER,
+  OPT_HISTORY,
+  OPT_HISTORY_STATS,
+  OPT_HISTORY_WINDOW,
+  OPT_ARCHIVE,
+  OPT_SHOW_LOG,
+  OPT_METRICS,
+  OPT_METRICS_PORT,
+  OPT_SELECT_FILE,
+  OPT_CACHE,
+  OPT_STREAM,
+  OPT_RECURSIVE,
+  OPT_TAGS,
+  OPT_TIMEOUT,
+  OPT_SAVE_BASELINE,
+  OPT_COMPARE_BASELINE,
+  OPT_THRESHOLD,
+  OPT_COMPARE,
+  OPT_ROUNDS,
+  OPT_INSTRUCTIONS,
+  OPT_PERF,
 };
 
 static const struct options {
@@ -43,12 +66,33 @@ static const struct options {
     .long_name = "match-suite",
     .short_name = 's', .need_arg = 1,
     .help = "run only tests in matched suites; <arg> is a regex\n"
-      "as povided by the POSIX2 specification (man 7 regex)"
+      "as povided by the POSIX2 specification (man 7 regex),\n"
+      "a leading '!' skips matched suites instead, repeatable"
   },
   {OPT_MATCH_TEST,
     .long_name = "match-test",
     .short_name = 't', .need_arg = 1,
-    .help = "run only matched tests; <arg> is a regex"
+    .help = "run only matched tests; <arg> is a regex,\n"
+      "a leading '!' skips matched tests instead, repeatable"
+  },
+  {OPT_SELECT_FILE,
+    .long_name = "select-file",
+    .short_name = 0, .need_arg = 1,
+    .help = "run only the tests listed in file <arg> ('-' for stdin), one\n"
+      "<suite>/<test> or <shared-object>/<suite>/<test> per line"
+  },
+  {OPT_TAGS,
+    .long_name = "tags",
+    .short_name = 0, .need_arg = 1,
+    .help = "run only tests of the size classes (small, medium, large)\n"
+      "and with the tags (slow, io, net, flaky) in the comma separated\n"
+      "list <arg>, a leading '!' skips them instead, repeatable"
+  },
+  {OPT_TIMEOUT,
+    .long_name = "timeout",
+    .short_name = 0, .need_arg = 1,
+    .help = "kill tests after <arg> seconds, 0 for never; by default\n"
+      "small, medium and large tests get 60, 300 and 900 seconds"
   },
   {OPT_VERBOSE,
     .long_name = "verbose",
@@ -115,6 +159,123 @@ static const struct options {
     .short_name = 'G', .need_arg = 0,
     .help = "equivalent of -g 'gdb'"
   },
+  {OPT_LOGDIR,
+    .long_name = "log-dir",
+    .short_name = 'L', .need_arg = 1,
+    .help = "store the raw output of every test in a file inside <arg>"
+  },
+  {OPT_BOARD,
+    .long_name = "board",
+    .short_name = 0, .need_arg = 1,
+    .help = "publish live results on a shared memory board in file <arg>"
+  },
+  {OPT_CACHE,
+    .long_name = "cache",
+    .short_name = 0, .need_arg = 1,
+    .help = "keep the test tables of shared objects in directory <arg>,\n"
+      "so unchanged objects load without being read again"
+  },
+  {OPT_STREAM,
+    .long_name = "stream",
+    .short_name = 0, .need_arg = 0,
+    .help = "run tests in the order they are declared without keeping\n"
+      "them around, for objects with very many tests; the summary\n"
+      "only has counts, use --reporter for the details"
+  },
+  {OPT_RECURSIVE,
+    .long_name = "recursive",
+    .short_name = 'r', .need_arg = 1,
+    .help = "also load every shared object with tests found below\n"
+      "directory <arg>, symbolic links are not followed, repeatable"
+  },
+  {OPT_REPORTER,
+    .long_name = "reporter",
+    .short_name = 'R', .need_arg = 1,
+    .help = "stream results as they come in; <arg> is <format>:<file>\n"
+      "with format junit, json or tap and file '-' for stdout, repeatable"
+  },
+  {OPT_HISTORY,
+    .long_name = "history",
+    .short_name = 0, .need_arg = 1,
+    .help = "append the outcome of every test to the history database <arg>"
+  },
+  {OPT_HISTORY_STATS,
+    .long_name = "history-stats",
+    .short_name = 0, .need_arg = 1,
+    .help = "print the recent history of test <arg>, given as\n"
+      "<shared-object>/<suite>/<test>, from the database of --history"
+  },
+  {OPT_HISTORY_WINDOW,
+    .long_name = "history-window",
+    .short_name = 0, .need_arg = 1,
+    .help = "the number of recent runs --history-stats looks at (200)"
+  },
+  {OPT_ARCHIVE,
+    .long_name = "archive",
+    .short_name = 0, .need_arg = 1,
+    .help = "store the compressed output of every test in the archive <arg>"
+  },
+  {OPT_SHOW_LOG,
+    .long_name = "show-log",
+    .short_name = 0, .need_arg = 1,
+    .help = "print the output of test <arg>, given as\n"
+      "<shared-object>/<suite>/<test>, from the archive of --archive"
+  },
+  {OPT_METRICS,
+    .long_name = "metrics",
+    .short_name = 0, .need_arg = 1,
+    .help = "write OpenMetrics of the run to file <arg> when it is over"
+  },
+  {OPT_METRICS_PORT,
+    .long_name = "metrics-port",
+    .short_name = 0, .need_arg = 1,
+    .help = "serve the metrics of --metrics on http://127.0.0.1:<arg>/metrics\n"
+      "while the run is in progress"
+  },
+  {OPT_SAVE_BASELINE,
+    .long_name = "save-baseline",
+    .short_name = 0, .need_arg = 1,
+    .help = "store the timings of every test in file <arg> when the run\n"
+      "is over, replacing what is there; a benchmark that regressed\n"
+      "keeps its old timings, performance counters are not stored"
+  },
+  {OPT_COMPARE_BASELINE,
+    .long_name = "compare-baseline",
+    .short_name = 0, .need_arg = 1,
+    .help = "compare the benchmarks against the baseline in file <arg>;\n"
+      "one that got significantly slower regresses, which fails the run"
+  },
+  {OPT_THRESHOLD,
+    .long_name = "threshold",
+    .short_name = 0, .need_arg = 1,
+    .help = "the slowdown --compare-baseline tolerates in percent (5%)"
+  },
+  {OPT_COMPARE,
+    .long_name = "compare",
+    .short_name = 0, .need_arg = 0,
+    .help = "run the tests of two builds of a shared object against each\n"
+      "other, in turn and on one core, and print the differences of\n"
+      "their timings and resource usage instead of the usual report"
+  },
+  {OPT_ROUNDS,
+    .long_name = "rounds",
+    .short_name = 0, .need_arg = 1,
+    .help = "the number of times --compare runs each test of a pair (10)"
+  },
+  {OPT_INSTRUCTIONS,
+    .long_name = "instructions",
+    .short_name = 0, .need_arg = 0,
+    .help = "time tests and benchmarks in instructions retired in user\n"
+      "space, which unlike the time do not depend on the load of the\n"
+      "machine; counted by the PMU or, much slower, by single stepping,\n"
+      "which lifts the default timeouts"
+  },
+  {OPT_PERF,
+    .long_name = "perf",
+    .short_name = 0, .need_arg = 0,
+    .help = "read the performance counters (cycles, instructions, cache\n"
+      "and branch misses, ...) of every pass and report them with -v"
+  },
   {OPT_ERROR, NULL, 0, 0, NULL}
 };
 
@@ -123,12 +284,13 @@ void usage(FILE * fd)
   unsigned int idx;
 
   fprintf(fd,
-      "The BUTCHER unit test - runs test functions inside shared objects \n"
-      "with the help of libelf and libdl. See \"bt.h\" for details.\n"
+      "The BUTCHER unit test - runs test functions inside shared objects,\n"
+      "every test in a bexec process of its own. See \"bt.h\" for details.\n"
       "\n"
       "Usage: \n"
       "	export LD_LIBRARY_PATH=<path to link dependencies>\n"
-      "	butcher <options> <shared-objects>\n");
+      "	butcher <options> <shared-objects>\n"
+      "	butcher <options> -r <directory> [<shared-objects>]\n");
   fprintf(fd,
       "Options: \n");
 
@@ -173,10 +335,30 @@ int main(int argc, char * argv[], char * env[])
   char       * paramv[argc + 1];
   int          i, shortflag;
   size_t       len;
-  char       * smatch, * tmatch;
-  int          list, help, verbose, color;
+  char       * smatch[argc], * tmatch[argc];
+  int          nsmatch = 0, ntmatch = 0;
+  char       * select_file;
+  char       * tags[argc];
+  int          ntags = 0;
+  char       * timeout;
+  int          list, help, verbose, color, stream, instructions, perf;
   unsigned int idx;
-  char       * argument, * bexec, * debugger;
+  char       * argument, * bexec, * debugger, * logdir, * board, * cache;
+  char       * reporters[argc];
+  int          nreporters = 0;
+  char       * recursive[argc];
+  int          nrecursive = 0;
+  char      ** loadv = NULL;
+  int          loadc = 0;
+  char       * history, * history_stats;
+  char       * archive, * show_log;
+  char       * metrics;
+  unsigned     metrics_port;
+  char       * save_baseline, * compare_baseline;
+  double       threshold;
+  int          compare;
+  unsigned     rounds;
+  unsigned     history_window;
   FILE       * fd = NULL;
   int          ofd = STDOUT_FILENO;
 
@@ -186,15 +368,33 @@ int main(int argc, char * argv[], char * env[])
   if (err)
     return_error(err);
 
-  smatch = NULL;
-  tmatch = NULL;
+  select_file = NULL;
+  timeout = NULL;
   list = 0;
   help = 0;
   verbose = 0;
   color = 1;
+  stream = 0;
+  instructions = 0;
+  perf = 0;
   shortflag = 0;
   bexec = NULL;
   debugger = NULL;
+  logdir = NULL;
+  board = NULL;
+  cache = NULL;
+  history = NULL;
+  history_stats = NULL;
+  history_window = 200;
+  archive = NULL;
+  show_log = NULL;
+  metrics = NULL;
+  metrics_port = 0;
+  save_baseline = NULL;
+  compare_baseline = NULL;
+  threshold = 5;
+  compare = 0;
+  rounds = 10;
 
   /*
    * this IS a mess... but again: it is only an example
@@ -305,9 +505,15 @@ next_flag:
 handle_opt: {
       switch (options[idx].id) {
         case OPT_MATCH_SUITE:
-          smatch = argument; break;
+          smatch[nsmatch++] = argument; break;
         case OPT_MATCH_TEST:
-          tmatch = argument; break;
+          tmatch[ntmatch++] = argument; break;
+        case OPT_SELECT_FILE:
+          select_file = argument; break;
+        case OPT_TAGS:
+          tags[ntags++] = argument; break;
+        case OPT_TIMEOUT:
+          timeout = argument; break;
         case OPT_VERBOSE:
           verbose++; break;
         case OPT_QUIET:
@@ -333,6 +539,47 @@ handle_opt: {
           debugger = "cgdb"; break;
         case OPT_GDB:
           debugger = "gdb"; break;
+        case OPT_LOGDIR:
+          logdir = argument; break;
+        case OPT_BOARD:
+          board = argument; break;
+        case OPT_CACHE:
+          cache = argument; break;
+        case OPT_STREAM:
+          stream = 1; break;
+        case OPT_RECURSIVE:
+          recursive[nrecursive++] = argument; break;
+        case OPT_REPORTER:
+          reporters[nreporters++] = argument; break;
+        case OPT_HISTORY:
+          history = argument; break;
+        case OPT_HISTORY_STATS:
+          history_stats = argument; break;
+        case OPT_HISTORY_WINDOW:
+          history_window = strtoul(argument, NULL, 10); break;
+        case OPT_ARCHIVE:
+          archive = argument; break;
+        case OPT_SHOW_LOG:
+          show_log = argument; break;
+        case OPT_METRICS:
+          metrics = argument; break;
+        case OPT_METRICS_PORT:
+          metrics_port = strtoul(argument, NULL, 10); break;
+        case OPT_SAVE_BASELINE:
+          save_baseline = argument; break;
+        case OPT_COMPARE_BASELINE:
+          compare_baseline = argument; break;
+        case OPT_THRESHOLD:
+          /* "5%" and "5" are the same */
+          threshold = strtod(argument, NULL); break;
+        case OPT_COMPARE:
+          compare = 1; break;
+        case OPT_ROUNDS:
+          rounds = strtoul(argument, NULL, 10); break;
+        case OPT_INSTRUCTIONS:
+          instructions = 1; break;
+        case OPT_PERF:
+          perf = 1; break;
         default:
           goto failure;
       }
@@ -353,7 +600,27 @@ failure: {
     goto finalize;
   }
 
-  if (help || paramc == 0) {
+  if (history_stats && !help) {
+    if (!history) {
+      fprintf(stderr, "'--history-stats' needs '--history'\n");
+      err = EINVAL;
+      goto finalize;
+    }
+    err = bt_history_stats(history, history_stats, history_window, fd);
+    goto finalize;
+  }
+
+  if (show_log && !help) {
+    if (!archive) {
+      fprintf(stderr, "'--show-log' needs '--archive'\n");
+      err = EINVAL;
+      goto finalize;
+    }
+    err = bt_archive_show(archive, show_log, fd);
+    goto finalize;
+  }
+
+  if (help || (paramc == 0 && nrecursive == 0)) {
     usage(fd);
     goto finalize;
   }
@@ -372,13 +639,19 @@ failure: {
   }
 
   if (debugger) {
-    if (!tmatch)
-      tmatch = "[^A-Za-z0-9_]\\+";
+    if (!ntmatch)
+      tmatch[ntmatch++] = "[^A-Za-z0-9_]\\+";
   }
 
-  if (smatch || tmatch)
-    fprintf(fd, "tests matching '%s' in suites matching '%s' are going to be loaded\n",
-        tmatch ? tmatch : ".*", smatch ? smatch : ".*");
+  if (nsmatch || ntmatch) {
+    fprintf(fd, "tests matching");
+    for (int i = 0; i < ntmatch; i++)
+      fprintf(fd, "%s '%s'", i ? "," : "", tmatch[i]);
+    fprintf(fd, "%s in suites matching", ntmatch ? "" : " '.*'");
+    for (int i = 0; i < nsmatch; i++)
+      fprintf(fd, "%s '%s'", i ? "," : "", smatch[i]);
+    fprintf(fd, "%s are going to be loaded\n", nsmatch ? "" : " '.*'");
+  }
 
   if (!bexec) {
     size_t plen = 0;
@@ -400,10 +673,40 @@ failure: {
     free(path);
   }
 
-  err = bt_init(butcher, bexec, fd, smatch, tmatch);
+  err = bt_init(butcher, bexec, fd, NULL, NULL);
   if (err)
     goto finalize;
 
+  for (int i = 0; i < nsmatch; i++) {
+    err = bt_match_suite(butcher, smatch[i]);
+    if (err)
+      goto finalize;
+  }
+
+  for (int i = 0; i < ntmatch; i++) {
+    err = bt_match_test(butcher, tmatch[i]);
+    if (err)
+      goto finalize;
+  }
+
+  if (select_file) {
+    err = bt_select_file(butcher, select_file);
+    if (err)
+      goto finalize;
+  }
+
+  for (int i = 0; i < ntags; i++) {
+    err = bt_select_tags(butcher, tags[i]);
+    if (err)
+      goto finalize;
+  }
+
+  if (timeout) {
+    err = bt_timeout(butcher, strtoul(timeout, NULL, 10));
+    if (err)
+      goto finalize;
+  }
+
   free(bexec);
   bexec = NULL;
 
@@ -413,21 +716,120 @@ failure: {
       goto finalize;
   }
 
+  if (logdir) {
+    err = bt_logdir(butcher, logdir);
+    if (err)
+      goto finalize;
+  }
+
+  if (board) {
+    err = bt_board(butcher, board);
+    if (err)
+      goto finalize;
+  }
+
+  if (cache) {
+    err = bt_cache(butcher, cache);
+    if (err)
+      goto finalize;
+  }
+
+  for (int i = 0; i < nreporters; i++) {
+    err = bt_reporter(butcher, reporters[i]);
+    if (err)
+      goto finalize;
+  }
+
+  if (history) {
+    err = bt_history(butcher, history);
+    if (err)
+      goto finalize;
+  }
+
+  if (archive) {
+    err = bt_archive(butcher, archive);
+    if (err)
+      goto finalize;
+  }
+
+  if (metrics_port && !metrics) {
+    fprintf(stderr, "'--metrics-port' needs '--metrics'\n");
+    err = EINVAL;
+    goto finalize;
+  }
+
+  if (metrics) {
+    err = bt_metrics(butcher, metrics, metrics_port);
+    if (err)
+      goto finalize;
+  }
+
+  if (compare && rounds < 2) {
+    fprintf(stderr, "'--rounds' needs to be at least 2 for '--compare'\n");
+    err = EINVAL;
+    goto finalize;
+  }
+
+  if (compare_baseline) {
+    err = bt_baseline_compare(butcher, compare_baseline, threshold / 100);
+    if (err)
+      goto finalize;
+  }
+
+  /* after the comparison, the baseline may be the same file */
+  if (save_baseline) {
+    err = bt_baseline(butcher, save_baseline);
+    if (err)
+      goto finalize;
+  }
+
   err = bt_tune(butcher,
       ((verbose>=1) ? BT_FLAG_VERBOSE : 0) |
       ((verbose>=2) ? BT_FLAG_DESCRIPTIONS : 0) |
       ((verbose>=3) ? BT_FLAG_MESSAGES : 0) |
       ((verbose>=4) ? BT_FLAG_ENVDUMP : 0) |
-      (color ? BT_FLAG_COLOR : 0)
+      (color ? BT_FLAG_COLOR : 0) |
+      (stream ? BT_FLAG_STREAM : 0) |
+      (instructions ? BT_FLAG_INSTRUCTIONS : 0) |
+      (perf ? BT_FLAG_PERF : 0)
                );
   if (err)
     goto finalize;
 
-  err = bt_loadv(butcher, paramc, paramv);
+  loadv = malloc(sizeof(char *) * (paramc + 1));
+  if (!loadv) {
+    err = ENOMEM;
+    goto finalize;
+  }
+  memcpy(loadv, paramv, sizeof(char *) * paramc);
+  loadc = paramc;
+
+  for (int i = 0; i < nrecursive; i++) {
+    unsigned nfound;
+    char ** found, ** v;
+
+    err = bt_discover(butcher, recursive[i], &nfound, &found);
+    if (err)
+      goto finalize;
+
+    v = realloc(loadv, sizeof(char *) * (loadc + nfound + 1));
+    if (!v) {
+      err = ENOMEM;
+      goto finalize;
+    }
+    loadv = v;
+    memcpy(loadv + loadc, found, sizeof(char *) * nfound);
+    loadc += nfound;
+  }
+  loadv[loadc] = NULL;
+
+  err = bt_loadv(butcher, loadc, loadv);
   if (err) {
     fprintf(fd, "could not load one of shared objects in:\n");
     for (int i = 0; i < paramc; i++)
       fprintf(fd, "	'%s'\n", paramv[i]);
+    for (int i = 0; i < nrecursive; i++)
+      fprintf(fd, "	'%s/'\n", recursive[i]);
     fprintf(fd, "the last error was: %d\n", err);
     goto finalize;
   }
@@ -437,6 +839,10 @@ failure: {
       err = bt_list(butcher);
       if (err)
         goto finalize;
+    } else if (compare) {
+      err = bt_compare(butcher, rounds);
+      if (err)
+        goto finalize;
     } else {
       err = bt_chop(butcher);
       if (err)
@@ -446,6 +852,9 @@ failure: {
         if (err)
           goto finalize;
       }
+      /* a regression fails the run */
+      if (bt_regressions(butcher))
+        err = EXIT_FAILURE;
     }
   }
 
@@ -453,6 +862,7 @@ finalize: {
     if (bexec)
       free(bexec);
     bt_delete(&butcher);
+    free(loadv);
     if (fd)
       fclose(fd);
     exit(err);
@@ -0,0 +1,11 @@
+
+/* the records of this file are in the compact layout, the ones of
+ * libsample.c are not; an object may have both */
+#define BT_COMPACT
+
+#include <bt.h>
+
+BT_TEST(compact, test_compact)
+{
+  return BT_RESULT_OK;
+}
@@ -0,0 +1,35 @@
+
+#include <bt.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+BT_EXPORT();
+
+static unsigned sample_data[4096];
+
+BT_TEST_TAGGED(samples, test_large, BT_SIZE_LARGE | BT_TAG_IO)
+{
+  memset(sample_data, 0, sizeof(sample_data));
+  bt_assert(sample_data[0] == 0);
+  return BT_RESULT_OK;
+}
+
+BT_BENCH(samples, bench_copy)
+{
+  static unsigned copy[64];
+
+  memcpy(copy, sample_data, sizeof(copy));
+  bt_clobber();
+  return BT_RESULT_OK;
+}
+
+BT_BENCH_RANGE(samples, bench_sum, 16, 4096, 4)
+{
+  unsigned sum = 0;
+
+  for (unsigned long i = 0; i < bt_n; i++)
+    sum += sample_data[i];
+  bt_do_not_optimize(sum);
+  return BT_RESULT_OK;
+}